@@ -0,0 +1,386 @@
+// ===========================================================================
+/// @file
+/// @brief		Benchmarks of xcp.
+/// @author		Mura.
+/// @copyright	(c) 2023-, Mura.
+// ===========================================================================
+
+// Includes local headers.
+#include "lexer.hpp"
+#include "preprocessor.hpp"
+#include "utility.hpp"
+
+// Includes standard headers.
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// ===========================================================================
+namespace {
+
+/// @brief	Number of allocations by the global operator new.
+std::atomic<std::size_t> allocations{};
+
+/// @brief	Allocates memory by the global operator new, which counts the allocations.
+///		Every allocation is aligned, so that all the forms of operator delete release it in the same way.
+/// @param[in]	size		Size in bytes.
+/// @param[in]	alignment	Alignment.
+/// @return		Allocated memory.
+void*
+allocate(std::size_t size, std::align_val_t alignment = std::align_val_t{alignof(std::max_align_t)}) {
+	allocations.fetch_add(1u, std::memory_order_relaxed);
+	auto const a = std::max(static_cast<std::size_t>(alignment), alignof(std::max_align_t));
+	auto const n = (std::max(size, std::size_t{1u}) + a - 1u) / a * a;
+#if defined(_MSC_VER)
+	if (auto const p = ::_aligned_malloc(n, a)) return p;
+#else
+	if (auto const p = std::aligned_alloc(a, n)) return p;
+#endif
+	throw std::bad_alloc{};
+}
+/// @brief	Deallocates memory by the global operator delete.
+/// @param[in]	p	Memory allocated by @ref allocate.
+void
+deallocate(void* p) noexcept {
+#if defined(_MSC_VER)
+	::_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void  operator delete(void* p) noexcept { deallocate(p); }
+void  operator delete[](void* p) noexcept { deallocate(p); }
+void  operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+void  operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete(void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+
+// ===========================================================================
+namespace xxx::bench {
+
+/// @brief	Corpus, which is a file to benchmark.
+struct corpus_t {
+	std::string			  name; ///< @brief	Name of the corpus.
+	std::filesystem::path path; ///< @brief	Path of the file.
+	std::string			  text; ///< @brief	Contents of the file.
+};
+
+/// @brief	Result of a benchmark.
+struct result_t {
+	std::string	   name;		///< @brief	Name of the benchmark.
+	double		   seconds;		///< @brief	The shortest time of the iterations.
+	std::size_t	   iterations;	///< @brief	Number of the iterations.
+	std::size_t	   tokens;		///< @brief	Number of the tokens processed in an iteration, or zero if it does not produce tokens.
+	std::size_t	   allocations;	///< @brief	Number of the allocations in an iteration.
+	std::ptrdiff_t rss_growth;	///< @brief	Growth of the resident set size of this process in KiB over the benchmark, e.g., by the caches.
+	std::string	   error;		///< @brief	Error message if the benchmark fails.
+};
+
+// -----------------------------------
+// corpus generator
+
+/// @brief	Generates lines until the text reaches the size.
+/// @param[in]	size	Size of the text.
+/// @param[in]	line	Function which generates the i-th line.
+/// @return		Generated text.
+std::string
+generate(std::size_t size, std::function<std::string(std::size_t)> const& line) {
+	std::string text;
+	text.reserve(size + 4096u);
+	for (std::size_t i{}; text.size() < size; ++i) text += line(i);
+	return text;
+}
+
+/// @brief	Generates macros like Boost.PP, i.e., deep nesting of function-like macros, concatenation, and repetition.
+std::string
+generate_macros(std::size_t size) {
+	std::ostringstream oss;
+	oss << "#define XCP_CAT(a, b) XCP_CAT_I(a, b)\n#define XCP_CAT_I(a, b) a ## b\n#define XCP_STR(...) #__VA_ARGS__\n";
+	oss << "#define XCP_REPEAT_0(m, d)\n";
+	for (auto i = 1; i <= 32; ++i) oss << "#define XCP_REPEAT_" << i << "(m, d) XCP_REPEAT_" << i - 1 << "(m, d) m(" << i - 1 << ", d)\n";
+	oss << "#define XCP_NEST_0(x) x\n";
+	for (auto i = 1; i <= 64; ++i) oss << "#define XCP_NEST_" << i << "(x) XCP_NEST_" << i - 1 << "((x) + " << i << ")\n";
+	oss << "#define XCP_DECL(n, d) int XCP_CAT(d, n) = XCP_NEST_4(n);\n#define XCP_LOG(...) log(__VA_ARGS__ __VA_OPT__(,) XCP_STR(__VA_ARGS__))\n";
+	auto const header = oss.str();
+	return header + generate(size, [](std::size_t i) {
+			   // The deepest nesting is used rarely, since its expansion costs quadratic time of the depth.
+			   auto const n = std::to_string(i);
+			   return "XCP_REPEAT_4(XCP_DECL, v" + n + "_)\nint n" + n + " = XCP_NEST_" + (i % 16u == 0u ? "64" : "8") + "(" + n + ");\nXCP_LOG(a, b, " + n + ");\n";
+		   });
+}
+/// @brief	Generates huge tables of strings with escapes and raw strings.
+std::string
+generate_strings(std::size_t size) {
+	return generate(size, [](std::size_t i) {
+		auto const n = std::to_string(i);
+		return "char const* const table" + n + "[] = {\"alpha\\t" + n + "\", \"beta\\\"quoted\\\"\", u8\"gamma\\u00E9\", R\"x(raw \"" + n + "\" string)x\", 'c', L'\\x41'};\n";
+	});
+}
+/// @brief	Generates code with a lot of comments.
+std::string
+generate_comments(std::size_t size) {
+	return generate(size, [](std::size_t i) {
+		auto const n = std::to_string(i);
+		return "/// @brief	Function " + n + ".\n///	@param[in]	a	Argument.\n/* block comment\n * which spans lines " + n + "\n */\nint f" + n + "(int a); // trailing comment\n";
+	});
+}
+/// @brief	Generates very long lines.
+std::string
+generate_long_lines(std::size_t size) {
+	return generate(size, [](std::size_t i) {
+		std::string line = "int long" + std::to_string(i) + " = 0";
+		for (auto j = 0; j < 4096; ++j) line += " + a" + std::to_string(j);
+		return line + ";\n";
+	});
+}
+/// @brief	Generates conditional groups like platform switches, most of which are excluded.
+std::string
+generate_conditionals(std::size_t size) {
+	return "#define XCP_OS 3\n#define XCP_ARCH 2\n" + generate(size, [](std::size_t i) {
+			   auto const n = std::to_string(i);
+			   return "#if XCP_OS == 1\nint win" + n + ";\n#  ifdef XCP_ARM\nint arm" + n + ";\n#  endif\n#elif XCP_OS == 2 && XCP_ARCH > 1\nint mac" + n + ";\n#elif defined(XCP_OS) && (XCP_OS == 3)\nint linux" + n +
+					  ";\n#else\n#  error unknown\n#endif\n#ifdef XCP_UNDEFINED_" + n + "\nint dead" + n + " = 0;\nint dead_too" + n + " = 1;\n#endif\n";
+		   });
+}
+/// @brief	Generates non-ASCII identifiers and strings.
+std::string
+generate_unicode(std::size_t size) {
+	return generate(size, [](std::size_t i) {
+		auto const n = std::to_string(i);
+		return "int \xE5\xA4\x89\xE6\x95\xB0_" + n + " = \xCE\xB1\xCE\xB2\xCE\xB3_" + n + "; // \xE3\x82\xB3\xE3\x83\xA1\xE3\x83\xB3\xE3\x83\x88\nchar const* s" + n + " = \"\xC3\xA9t\xC3\xA9 \xF0\x9F\x98\x80\";\n";
+	});
+}
+
+/// @brief	Generates the synthetic corpora into the directory.
+/// @param[in]	directory	Directory to write the corpora.
+/// @param[in]	size		Size of each corpus.
+/// @return		Generated corpora.
+std::vector<corpus_t>
+generate_corpora(std::filesystem::path const& directory, std::size_t size) {
+	std::vector<std::pair<std::string, std::function<std::string(std::size_t)>>> const generators{
+		{"macros", &generate_macros},
+		{"strings", &generate_strings},
+		{"comments", &generate_comments},
+		{"long_lines", &generate_long_lines},
+		{"conditionals", &generate_conditionals},
+		{"unicode", &generate_unicode},
+	};
+	std::filesystem::create_directories(directory);
+	std::vector<corpus_t> corpora;
+	for (auto const& [name, generator] : generators) {
+		auto const path = directory / (name + ".cpp");
+		auto	   text = generator(size);
+		std::ofstream{path, std::ios::binary} << text;
+		corpora.push_back({name, path, std::move(text)});
+	}
+	return corpora;
+}
+
+// -----------------------------------
+// runner
+
+/// @brief	Gets current resident set size of this process.
+///		The peak is not used, since it is the high-water mark of the whole process and cannot be attributed to a benchmark.
+/// @return		Resident set size in KiB, or zero if it is unknown.
+std::ptrdiff_t
+resident_size() {
+#if defined(__linux__)
+	// The second field is the number of the resident pages.
+	std::size_t size{}, resident{};
+	if (std::ifstream statm{"/proc/self/statm"}; statm >> size >> resident) return static_cast<std::ptrdiff_t>(resident * static_cast<std::size_t>(::sysconf(_SC_PAGESIZE)) / 1024u);
+#endif
+	return 0;
+}
+
+/// @brief	Keeps the result from being optimized away.
+///		The compiler has to assume that the result escapes into the assembly, which does nothing actually.
+/// @param[in]	a	Result, which has size.
+/// @return		Zero, since the result is not tokens.
+template<typename T>
+std::size_t
+keep(T const& a) noexcept {
+	auto const size = a.size();
+#if defined(__GNUC__) || defined(__clang__)
+	asm volatile("" : : "r"(&a), "r"(size) : "memory");
+#else
+	static std::atomic<std::size_t> sink;
+	sink.store(size, std::memory_order_relaxed);
+#endif
+	return 0u;
+}
+
+/// @brief	Runs the benchmark until it takes the minimum time.
+/// @param[in]	name		Name of the benchmark.
+/// @param[in]	minimum		Minimum time of all the iterations.
+/// @param[in]	f			Function to benchmark, which returns number of the processed tokens.
+/// @return		Result of the benchmark.
+result_t
+run(std::string const& name, std::chrono::duration<double> minimum, std::function<std::size_t()> const& f) {
+	result_t   result{name, std::numeric_limits<double>::max(), 0u, 0u, 0u, 0, {}};
+	auto const resident = resident_size();
+	try {
+		std::chrono::duration<double> total{};
+		while (result.iterations < 3u || total < minimum) {
+			auto const before  = allocations.load(std::memory_order_relaxed);
+			auto const started = std::chrono::steady_clock::now();
+			result.tokens	   = f();
+			auto const elapsed = std::chrono::duration<double>{std::chrono::steady_clock::now() - started};
+			result.allocations = allocations.load(std::memory_order_relaxed) - before;
+			result.seconds	   = std::min(result.seconds, elapsed.count());
+			total += elapsed;
+			++result.iterations;
+		}
+	} catch (std::exception const& e) {
+		result.error = e.what();
+	}
+	result.rss_growth = resident_size() - resident;
+	return result;
+}
+
+/// @brief	Benchmarks each phase with the corpus.
+/// @param[in]	corpus		Corpus.
+/// @param[in]	minimum		Minimum time of each benchmark.
+/// @return		Results of the benchmarks.
+std::vector<result_t>
+run_phases(corpus_t const& corpus, std::chrono::duration<double> minimum) {
+	using namespace xcp;
+	std::vector<result_t> results;
+	results.push_back(run("to_32string", minimum, [&corpus]() { return keep(uc::to_32string(corpus.text)); }));
+	results.push_back(run("escape_non_basic_source_character_set", minimum, [&corpus]() { return keep(lex::escape_non_basic_source_character_set(corpus.text)); }));
+	results.push_back(run("splice_lines", minimum, [&corpus]() { return keep(std::get<0>(lex::splice_lines(corpus.text))); }));
+	results.push_back(run("scan", minimum, [&corpus]() { return lex::scan(corpus.path).size(); }));
+	auto const tokens = lex::scan(corpus.path);
+	results.push_back(run("split_lines", minimum, [&tokens]() { return keep(cpp::split_lines(tokens)) + tokens.size(); }));
+	// The tokens of the file are cached after the first iteration, so that it measures the phase 4 only.
+	results.push_back(run("preprocess", minimum, [&corpus]() {
+		cpp::context_t context;
+		return cpp::preprocess(corpus.path, context).size();
+	}));
+	results.push_back(run("scan_dependencies", minimum, [&corpus]() {
+		cpp::context_t context;
+		return keep(cpp::scan_dependencies(corpus.path, context));
+	}));
+	return results;
+}
+
+/// @brief	Writes the results as JSON.
+/// @param[in,out]	os		Output stream.
+/// @param[in]		corpora	Corpora.
+/// @param[in]		results	Results of each corpus.
+void
+write_json(std::ostream& os, std::vector<corpus_t> const& corpora, std::vector<std::vector<result_t>> const& results) {
+	auto const isa = simd::detect() == simd::isa_t::avx2 ? "avx2" : simd::detect() == simd::isa_t::sse2 ? "sse2"
+																										  : "scalar";
+	os << std::fixed << std::setprecision(3);
+#if defined(__OPTIMIZE__) || defined(NDEBUG)
+	auto const optimized = "true";
+#else
+	auto const optimized = "false";
+#endif
+	os << "{\n  \"isa\": \"" << isa << "\",\n  \"optimized\": " << optimized << ",\n  \"corpora\": [";
+	for (std::size_t i{}; i < corpora.size(); ++i) {
+		auto const megabytes = static_cast<double>(corpora[i].text.size()) / (1024.0 * 1024.0);
+		os << (i == 0u ? "" : ",") << "\n    {\"name\": " << util::quote_json(corpora[i].name) << ", \"path\": " << util::quote_json(corpora[i].path.string()) << ", \"bytes\": " << corpora[i].text.size() << ", \"benchmarks\": [";
+		for (std::size_t j{}; j < results[i].size(); ++j) {
+			auto const& r = results[i][j];
+			os << (j == 0u ? "" : ",") << "\n      {\"name\": " << util::quote_json(r.name);
+			if (r.error.empty()) {
+				os << ", \"seconds\": " << std::setprecision(6) << r.seconds << std::setprecision(3) << ", \"iterations\": " << r.iterations
+				   << ", \"mb_per_s\": " << megabytes / r.seconds << ", \"tokens\": " << r.tokens << ", \"tokens_per_s\": " << static_cast<double>(r.tokens) / r.seconds
+				   << ", \"allocations\": " << r.allocations;
+			} else {
+				os << ", \"error\": " << util::quote_json(r.error);
+			}
+			os << ", \"rss_growth_kib\": " << r.rss_growth << "}";
+		}
+		os << "\n    ]}";
+	}
+	os << "\n  ]\n}\n";
+}
+
+} // namespace xxx::bench
+
+// ===========================================================================
+
+/// @brief	Usage of this program.
+static constexpr auto const Usage =
+	"[Usage] $ xcp_bench  (options)  {source_files}\n"
+	"[Options]\n"
+	" --size={megabytes} :       Size of each synthetic corpus (default: 2).\n"
+	" --time={seconds} :         Minimum time of each benchmark (default: 0.5).\n"
+	" --corpus={directory} :     Directory to write the synthetic corpora (default: temporary directory).\n"
+	"The source files are benchmarked as real-world corpora in addition to the synthetic ones.\n"
+	"The results are written to the standard output as JSON.\n";
+
+/// @brief  Main entry of the benchmarks.
+/// @param[in]  ac  Arugument count.
+/// @param[in]  av  AArgument values.
+/// @return Result code of this program.
+int
+main(int ac, char* av[]) {
+	try {
+		std::ios::sync_with_stdio(false);
+
+		double				  size	  = 2.0;
+		double				  minimum = 0.5;
+		std::filesystem::path directory = std::filesystem::temp_directory_path() / "xcp_bench";
+		std::vector<std::filesystem::path> paths;
+		for (std::string_view const arg : std::vector<std::string_view>(av + 1, av + ac)) {
+			if (arg.starts_with("--size=")) {
+				size = std::stod(std::string{arg.substr(7u)});
+			} else if (arg.starts_with("--time=")) {
+				minimum = std::stod(std::string{arg.substr(7u)});
+			} else if (arg.starts_with("--corpus=")) {
+				directory = arg.substr(9u);
+			} else if (arg.starts_with("-")) {
+				std::clog << Usage << std::endl;
+				return arg == "-h" || arg == "--help" ? 1 : -1;
+			} else {
+				paths.emplace_back(arg);
+			}
+		}
+
+		auto corpora = xxx::bench::generate_corpora(directory, static_cast<std::size_t>(size * 1024.0 * 1024.0));
+		for (auto const& path : paths) corpora.push_back({path.filename().string(), path, xxx::util::load_file(path)});
+
+		std::vector<std::vector<xxx::bench::result_t>> results;
+		for (auto const& corpus : corpora) {
+			std::clog << corpus.name << std::endl;
+			results.push_back(xxx::bench::run_phases(corpus, std::chrono::duration<double>{minimum}));
+		}
+		xxx::bench::write_json(std::cout, corpora, results);
+		return 0;
+	} catch (std::exception const& e) {
+		std::cerr << e.what() << std::endl;
+	}
+	return -1;
+}
@@ -13,6 +13,7 @@
 #include "preprocessor.hpp"
 
 #include <filesystem>
+#include <utility>
 
 // ================================================================================
 namespace xxx::xcp::tu {
@@ -34,7 +35,7 @@ public:
 	/// @param[in]	path	Path of the file.
 	/// @param[in]	tokens	Tokens of the file.
 	/// @param[in]	context	Context of the file.
-	translation_unit_t(std::filesystem::path const& path, lex::tokens_t const& tokens, cpp::context_t const& context) : path_{path}, tokens_{tokens}, context_{context} {}
+	translation_unit_t(std::filesystem::path const& path, lex::tokens_t tokens, cpp::context_t const& context) : path_{path}, tokens_{std::move(tokens)}, context_{context} {}
 
 private:
 	std::filesystem::path path_;	///< Path of the file.
@@ -15,18 +15,36 @@
 #include <string_view>
 #include <unordered_set>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <concepts>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
 #include <filesystem>
+#include <initializer_list>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
 #include <optional>
 #include <ranges>
 #include <regex>
+#include <shared_mutex>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <tuple>
+#include <type_traits>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -164,37 +182,42 @@ std::unordered_set<std::string_view> const keywords{
 //	@brief	Multiple-lines comment (/*...*/).
 //	@note	VC++ does not support multiline.
 // std::regex const block_comment_re{R"(^(/[*](?:[^*]|[*][^/]|^|$|[\r\n])*[*]/).*)", std::regex_constants::multiline};
-///	@brief	Escaped new line (@\LF).
-std::regex const escaped_newline_re{R"(\\\r?\n)"};
-///	@brief	Single-line comment (//... LF+).
-std::regex const line_comment_re{R"(^(//[^\r\n]*).*)"};
-///	@brief	Inline whitespaces (WS+).
-std::regex const inline_whitespaces_re{R"(^([ \t\v\f]+).*)"};
-///	@brief	Identifier ([A-Za-z_][A-Za-z0-9_]*).
-std::regex const identifier_re{R"(^([a-zA-Z_]\w*).*)"};
-///	@brief	Preprocessing number (pp-number LF*).
-std::regex const pp_number_re{R"(^([.]?\d+(?:'\w*|[eEpP][-+]|[.])?).*)"};
-///	@brief	String literal (u8|[UL])?"..."ID*).
-std::regex const string_literal_re{R"(^((?:u8?|[UL])?"(?:[^'\r\n]|\\['"?\abfnrtv]|\\u[0-9a-fA-f]{4}|\\U[0-9a-fA-f]{8})*"\w*).*)"};
-///	@brief	Character literal (u8|[UL])?'...'ID*).
-std::regex const character_literal_re{R"(^((?:u8?|[UL])?'(?:[^'\r\n]|\\['"?\abfnrtv]|\\u[0-9a-fA-f]{4}|\\U[0-9a-fA-f]{8})+'\w*).*)"};
-///	@brief	Header name (@<path@>).
-std::regex const header_name_re{R"(^(<[^>\r\n]+>).*)"}; // "" is also matched by string_literal_re
-
-///	@brief	Preprocessing operators and punctuators.
-std::regex const preprocessing_op_or_punc_re{
-	"^("
-	R"([.]{3}|(?:%:){1,2})"				   // ... %:%: %:
-	R"(|\[|\]|(?:[.]|->)[*]?)"			   // [ ] . .* -> ->*
-	R"(|&&?|-[-=]?|\+[+=]?|##?|::?|\|\|?)" // && || -- ++ ## :: & | - + # : += -=
-	R"(|<[:%]|[:%]>)"					   // <: <% :> %>
-	R"(|>>?=?|<<?=?)"					   // >>= <<= >> << >= <= > <
-	R"(|[*/%^&|~!=]=?)"					   // *= /= %= ^= &= |= ~= != == * / % ^ & | ~ ! =
-	R"(|[{}();?,])"						   // { } ( ) ; ? ,
-	").*"};								   // ( new delete and and_eq bitand bitor compl not not_eq or or_eq xor xor_eq )
+
+// -----------------------------------
+// character classes
+
+///	@brief	Character classes, which are combined as bits.
+enum class char_class_t : std::uint8_t {
+	digit		= 0b0000'0001, ///< @brief	Digit ([0-9]).
+	nondigit	= 0b0000'0010, ///< @brief	Non-digit ([A-Za-z_]).
+	hexadecimal = 0b0000'0100, ///< @brief	Hexadecimal digit ([0-9A-Fa-f]).
+	blank		= 0b0000'1000, ///< @brief	Inline whitespace ([ \t\v\f]).
+	newline		= 0b0001'0000, ///< @brief	Newline ([\r\n]).
+	d_char		= 0b0010'0000, ///< @brief	Delimiter character of raw string literal.
+};
+
+///	@brief	Character class table indexed by byte.
+constexpr std::array<std::uint8_t, 256u> const char_classes = [] {
+	auto const set = [](auto& table, std::string_view const& chars, char_class_t cls) {
+		for (auto const ch : chars) table[static_cast<unsigned char>(ch)] |= static_cast<std::uint8_t>(cls);
+	};
+	std::string_view const digits{"0123456789"};
+	std::string_view const letters{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz_"};
+
+	std::array<std::uint8_t, 256u> table{};
+	set(table, digits, char_class_t::digit);
+	set(table, letters, char_class_t::nondigit);
+	set(table, "0123456789ABCDEFabcdef", char_class_t::hexadecimal);
+	set(table, " \t\v\f", char_class_t::blank);
+	set(table, "\r\n", char_class_t::newline);
+	set(table, digits, char_class_t::d_char);
+	set(table, letters, char_class_t::d_char);
+	set(table, "{}[]#<>%:;.?*+-/^&|~!=,\"'", char_class_t::d_char);
+	return table;
+}();
 
 ///	@brief	Basic source character set.
-std::string_view const basic_source_character_set{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_{}[]#()<>%:;.?*+-/^&|~!=,\\\"’ \t\v\f\r\n"};
+constexpr std::string_view const basic_source_character_set{"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789_{}[]#()<>%:;.?*+-/^&|~!=,\\\"' \t\v\f\r\n"};
 
 } // namespace def
 
@@ -205,7 +228,20 @@ std::string_view const basic_source_character_set{"ABCDEFGHIJKLMNOPQRSTUVWXYZabc
 /// @return		Whether the @p ch is a basic source character or not.
 constexpr inline bool
 is_basic_source_character_set(char32_t ch) noexcept {
-	return uc::is_head1(ch) && def::basic_source_character_set.find(static_cast<char>(ch)) != std::string_view::npos;
+	return ch < 0x80u && simd::scalar::is_basic(static_cast<char>(ch));
+}
+static_assert(std::ranges::all_of(def::basic_source_character_set, [](char ch) { return is_basic_source_character_set(static_cast<unsigned char>(ch)); }));
+static_assert(std::ranges::count_if(std::views::iota(0u, 0x80u), [](auto ch) { return is_basic_source_character_set(ch); }) == std::ssize(def::basic_source_character_set));
+
+///	@brief	Appends the character as an universal character name (@\UXXXXXXXX).
+///	@param[in,out]	str		The string to append.
+///	@param[in]		ch		The character.
+inline void
+append_universal_character_name(std::string& str, char32_t ch) {
+	constexpr std::string_view digits{"0123456789ABCDEF"};
+	std::array<char, 10u>	   ucn{'\\', 'U'};
+	for (auto i = ucn.size(); 2u < i; ch >>= 4) ucn[--i] = digits[ch & 0xFu];
+	str.append(ucn.data(), ucn.size());
 }
 
 ///	@brief	Escapes the non basic source character set.
@@ -213,19 +249,161 @@ is_basic_source_character_set(char32_t ch) noexcept {
 ///	@return		The escaped string.
 inline std::string
 escape_non_basic_source_character_set(std::u32string_view const& str) {
-	auto escaped = str
-				 | std::views::transform([](auto const& ch) {
-					   if (is_basic_source_character_set(ch)) {
-						   return std::string(1u, ch);
-					   } else {
-						   std::ostringstream oss;
-						   oss << R"(\U)" << std::hex << std::uppercase << std::setw(8) << std::setfill('0') << static_cast<std::uint32_t>(ch);
-						   return oss.str();
-					   }
-				   })
-				 | std::views::join
-				 | std::views::common;
-	return std::accumulate(escaped.begin(), escaped.end(), std::move(std::ostringstream{}), [](auto&& oss, auto const& s) { oss << s; return std::move(oss); }).str();
+	std::string escaped;
+	escaped.reserve(str.size());
+	for (auto const ch : str) {
+		if (is_basic_source_character_set(ch)) {
+			escaped.push_back(static_cast<char>(ch));
+		} else {
+			append_universal_character_name(escaped, ch);
+		}
+	}
+	return escaped;
+}
+///	@overload
+///		It streams the UTF-8 string once, so that runs of the basic source character set are validated by blocks and copied in bulk.
+///	@throw	std::invalid_argument	The @p str is not valid UTF-8 string.
+inline std::string
+escape_non_basic_source_character_set(std::string_view const& str) {
+	prof::scope_t const scope{prof::phase_t::ucn, str.size()};
+
+	std::string escaped;
+	escaped.reserve(str.size());
+	for (std::size_t pos{}; pos < str.size();) {
+		auto const basic = simd::skip_basic(str.substr(pos));
+		escaped.append(str.data() + pos, basic);
+		pos += basic;
+		if (pos == str.size()) break;
+
+		auto const [rest, ch] = uc::get_head_ucs32(str.substr(pos));
+		append_universal_character_name(escaped, ch);
+		pos = str.size() - rest.size();
+	}
+	return escaped;
+}
+
+///	@brief	Line splice, which is removed by the phase 2.
+struct splice_t {
+	std::uint32_t logical; ///< @brief	Offset in the logical source where the physical line is spliced.
+	std::uint32_t line;	   ///< @brief	Physical line number (0-origin), which starts from the offset.
+};
+
+///	@brief	Sorted table of line splices.
+using splices_t = std::vector<splice_t>;
+
+///	@brief	Source, which is an immutable buffer of logical source shared by tokens.
+class source_t : public std::enable_shared_from_this<source_t> {
+public:
+	///	@brief	Gets path of the source.
+	///	@return	Path of the source.
+	auto const& path() const noexcept { return path_; }
+	///	@brief	Gets text of the source.
+	///	@return	Text of the source.
+	std::string_view text() const noexcept { return text_; }
+	///	@brief	Gets line splices of the source.
+	///	@return	Line splices, which are sorted by the logical offset.
+	auto const& splices() const noexcept { return splices_; }
+	///	@brief	Gets serial number of the source.
+	///	@return	Serial number, which is never reused even if the source is freed.
+	auto serial() const noexcept { return serial_; }
+
+	///	@brief	Gets physical position of the offset.
+	///		The column is counted in bytes after the phase 1.
+	///	@param[in]	offset	Offset in the text.
+	///	@return	Physical position.
+	///		The first of tuple is line number (1-origin).
+	///		The second of tuple is column number (1-origin).
+	std::tuple<std::size_t, std::size_t> position(std::size_t offset) const noexcept {
+		offset					= std::min(offset, text_.size());
+		auto const splice		= std::ranges::upper_bound(splices_, offset, {}, &splice_t::logical);
+		auto const [base, line] = splice == splices_.begin() ? std::tuple<std::size_t, std::size_t>{} : std::tuple<std::size_t, std::size_t>{std::prev(splice)->logical, std::prev(splice)->line};
+		auto const segment		= text_.substr(base, offset - base);
+		auto const newline		= segment.rfind('\n');
+		return {line + simd::count(segment, '\n') + 1u, (newline == std::string_view::npos ? segment.size() : segment.size() - newline - 1u) + 1u};
+	}
+	///	@overload
+	///	@param[in]	str		String which refers into the text.
+	std::tuple<std::size_t, std::size_t> position(std::string_view const& str) const noexcept { return position(static_cast<std::size_t>(str.data() - text_.data())); }
+
+	///	@brief	Constructor.
+	///	@param[in]	path	Path of the source.
+	///	@param[in]	text	Text of the source.
+	///	@param[in]	splices	Line splices of the source.
+	source_t(std::filesystem::path const& path, std::string&& text, splices_t&& splices = {}) : path_{path}, buffer_{std::make_shared<util::string_buffer_t const>(std::move(text))}, text_{buffer_->bytes()}, splices_{std::move(splices)}, serial_{next_serial()} {}
+	///	@brief	Constructor.
+	///	@param[in]	path	Path of the source.
+	///	@param[in]	buffer	Buffer of the file, which is kept as long as the source.
+	///	@param[in]	text	Text of the source, which refers into the @p buffer.
+	///	@param[in]	splices	Line splices of the source.
+	source_t(std::filesystem::path const& path, util::file_buffer_ptr_t const& buffer, std::string_view const& text, splices_t&& splices = {}) : path_{path}, buffer_{buffer}, text_{text}, splices_{std::move(splices)}, serial_{next_serial()} {}
+
+private:
+	source_t(source_t const&) = delete;
+
+	///	@brief	Gets the next serial number.
+	static std::uint64_t next_serial() noexcept {
+		static std::atomic<std::uint64_t> serial{};
+		return serial.fetch_add(1u, std::memory_order_relaxed) + 1u;
+	}
+
+private:
+	std::filesystem::path		  path_;	///< @brief	Path of the source.
+	util::file_buffer_ptr_t const buffer_;	///< @brief	Buffer which owns the text.
+	std::string_view const		  text_;	///< @brief	Text of the source.
+	splices_t const				  splices_; ///< @brief	Line splices of the source.
+	std::uint64_t const			  serial_;	///< @brief	Serial number of the source.
+};
+
+///	@brief	Shared pointer of source.
+using source_ptr_t = std::shared_ptr<source_t const>;
+
+///	@brief	Source manager, which creates sources and owns strings referred by tokens.
+///		Tokens only refer into the sources, so that they can be copied without any allocation.
+///		A collection of tokens shares the sources which its tokens refer into, so that a source is freed with the last of them.
+class source_manager_t {
+public:
+	///	@brief	Creates a source.
+	///	@param[in]	path	Path of the source.
+	///	@param[in]	text	Text of the source.
+	///	@return		Created source.
+	///	@param[in]	splices	Line splices of the source.
+	source_ptr_t add(std::filesystem::path const& path, std::string&& text, splices_t&& splices = {}) { return std::make_shared<source_t const>(path, std::move(text), std::move(splices)); }
+	///	@brief	Creates a source, which refers into the file buffer.
+	///	@param[in]	path	Path of the source.
+	///	@param[in]	buffer	Buffer of the file.
+	///	@param[in]	text	Text of the source, which refers into the @p buffer.
+	///	@param[in]	splices	Line splices of the source.
+	///	@return		Created source.
+	source_ptr_t add(std::filesystem::path const& path, util::file_buffer_ptr_t const& buffer, std::string_view const& text, splices_t&& splices = {}) { return std::make_shared<source_t const>(path, buffer, text, std::move(splices)); }
+
+	///	@brief	Interns a string, which is not a part of any source, e.g., a concatenated token.
+	///		The same strings are interned only once, so that repeated expansions do not grow the manager.
+	///	@param[in]	str		String to intern.
+	///	@return		Interned string, which lives as long as the manager.
+	std::string_view intern(std::string_view const& str) {
+		std::lock_guard lock{mutex_};
+		if (auto const found = interned_.find(str); found != interned_.end()) return *found;
+		return *interned_.emplace(scratch_.emplace_back(str)).first; // std::deque never moves its elements.
+	}
+
+	///	@brief	Constructor.
+	source_manager_t() : mutex_{}, scratch_{}, interned_{} {}
+
+private:
+	source_manager_t(source_manager_t const&) = delete;
+
+private:
+	std::mutex							 mutex_;	///< @brief	Mutex.
+	std::deque<std::string>				 scratch_;	///< @brief	Interned strings.
+	std::unordered_set<std::string_view> interned_; ///< @brief	Index of the interned strings.
+};
+
+///	@brief	Gets the source manager of this process.
+///	@return	The source manager.
+inline source_manager_t&
+source_manager() {
+	static source_manager_t manager;
+	return manager;
 }
 
 ///	@brief	Whitespaces.
@@ -251,7 +429,7 @@ private:
 };
 
 ///	@brief	Preprocessing token type.
-enum class preprocessing_token_type_t {
+enum class preprocessing_token_type_t : std::uint8_t {
 	unknown,				  ///< @brief	Unknown as default.
 	string_literal,			  ///< @brief	String literal.
 	character_literal,		  ///< @brief	Character literal.
@@ -265,28 +443,727 @@ enum class preprocessing_token_type_t {
 class preprocessing_token_t {
 public:
 	///	@brief	Gets token string.
-	///	@return	Token string.
-	auto const& str() const noexcept { return str_; }
+	///	@return	Token string, which refers into a source or an interned string.
+	auto str() const noexcept { return str_; }
 	///	@brief	Gets token type.
 	///	@return	Token type.
 	auto type() const noexcept { return type_; }
+	///	@brief	Gets source of the token.
+	///	@return	Source which the token refers into, or null if the token refers into other string.
+	auto source() const noexcept { return source_; }
 
 	/// @brief	Constructor.
-	preprocessing_token_t() noexcept : type_{}, str_{} {}
+	preprocessing_token_t() noexcept : type_{}, str_{}, source_{} {}
 	///	@overload
-	/// @param[in]	str		Token string.
+	/// @param[in]	str		Token string, which shall outlive the token such as a source or a string literal.
 	/// @param[in]	type	Token type.
-	explicit preprocessing_token_t(std::string_view const& str, preprocessing_token_type_t type = preprocessing_token_type_t{}) noexcept : type_{type}, str_{str} {}
+	/// @param[in]	source	Source which the @p str refers into if exists.
+	explicit preprocessing_token_t(std::string_view const& str, preprocessing_token_type_t type = preprocessing_token_type_t{}, source_t const* source = nullptr) noexcept : type_{type}, str_{str}, source_{source} {}
 
 private:
-	preprocessing_token_type_t type_; ///< @brief	Token type.
-	std::string				   str_;  ///< @brief	Token string.
+	preprocessing_token_type_t type_;	///< @brief	Token type.
+	std::string_view		   str_;	///< @brief	Token string.
+	source_t const*			   source_; ///< @brief	Source which the token refers into.
 };
 
 ///	@brief	Token, which is either whitespace or preprocessing token.
 using token_t = std::variant<whitespace_t, preprocessing_token_t>;
+
 ///	@brief	Collection of tokens.
-using tokens_t = std::vector<token_t>;
+///		The tokens are stored as struct of arrays, which are kinds, flags, offsets, and lengths.
+///		The offsets refer into texts of spans, which are shared by copies of the collection.
+///		The iterator gets each token as a @ref token_t value, so that algorithms can deal with tokens as before.
+///		Text lines may be deferred as a token which refers into their raw text, and they shall be tokenized by @ref tokenize_deferred to be read as tokens.
+class tokens_t {
+public:
+	///	@brief	Kind of token, which is the preprocessing token type or the whitespace.
+	using kind_t = std::uint8_t;
+	///	@brief	Kind of whitespace.
+	static constexpr kind_t const whitespace_kind = 0xFFu;
+	///	@brief	Kind of text lines deferred to be tokenized.
+	static constexpr kind_t const deferred_kind = 0xFEu;
+
+	///	@brief	Flags of token.
+	enum class flag_t : std::uint8_t {
+		newline = 0b0000'0001, ///< @brief	The whitespace includes newlines.
+	};
+
+	///	@brief	Columns of tokens.
+	struct columns_t {
+		std::span<kind_t const>		   kinds;	///< @brief	Kinds of tokens.
+		std::span<std::uint8_t const>  flags;	///< @brief	Flags of tokens.
+		std::span<std::uint32_t const> offsets; ///< @brief	Offsets of preprocessing tokens.
+		std::span<std::uint32_t const> lengths; ///< @brief	Lengths of preprocessing tokens, or numbers of newlines of whitespaces.
+	};
+
+	///	@brief	Random access iterator, which gets token as value.
+	class const_iterator {
+	public:
+		using iterator_concept	= std::random_access_iterator_tag; ///< @brief	Iterator concept.
+		using iterator_category = std::input_iterator_tag;		   ///< @brief	Iterator category, which is input because of the value reference.
+		using value_type		= token_t;						   ///< @brief	Value type.
+		using reference			= token_t;						   ///< @brief	Reference type, which is a value.
+		using difference_type	= std::ptrdiff_t;				   ///< @brief	Difference type.
+
+		///	@brief	Gets index of the token in the collection.
+		///	@return	Index of the token.
+		auto index() const noexcept { return index_; }
+
+		reference	  operator*() const { return (*tokens_)[index_]; }
+		reference	  operator[](difference_type n) const { return (*tokens_)[index_ + n]; }
+		const_iterator& operator++() noexcept { return ++index_, *this; }
+		const_iterator	operator++(int) noexcept { return const_iterator{tokens_, index_++}; }
+		const_iterator& operator--() noexcept { return --index_, *this; }
+		const_iterator	operator--(int) noexcept { return const_iterator{tokens_, index_--}; }
+		const_iterator& operator+=(difference_type n) noexcept { return index_ += n, *this; }
+		const_iterator& operator-=(difference_type n) noexcept { return index_ -= n, *this; }
+		const_iterator	operator+(difference_type n) const noexcept { return const_iterator{tokens_, index_ + n}; }
+		const_iterator	operator-(difference_type n) const noexcept { return const_iterator{tokens_, index_ - n}; }
+		difference_type operator-(const_iterator const& rhs) const noexcept { return static_cast<difference_type>(index_) - static_cast<difference_type>(rhs.index_); }
+		friend const_iterator operator+(difference_type n, const_iterator const& itr) noexcept { return itr + n; }
+		bool				  operator==(const_iterator const& rhs) const noexcept { return index_ == rhs.index_; }
+		auto				  operator<=>(const_iterator const& rhs) const noexcept { return index_ <=> rhs.index_; }
+
+		///	@brief	Constructor.
+		const_iterator() noexcept : tokens_{}, index_{} {}
+		///	@overload
+		///	@param[in]	tokens	Collection of tokens.
+		///	@param[in]	index	Index of the token.
+		const_iterator(tokens_t const* tokens, std::size_t index) noexcept : tokens_{tokens}, index_{index} {}
+
+	private:
+		friend class tokens_t;
+
+		tokens_t const* tokens_; ///< @brief	Collection of tokens.
+		std::size_t		index_;	 ///< @brief	Index of the token.
+	};
+	using iterator				 = const_iterator;						 ///< @brief	Iterator, which is the same as the const iterator.
+	using const_reverse_iterator = std::reverse_iterator<const_iterator>; ///< @brief	Reverse iterator.
+	using value_type			 = token_t;								 ///< @brief	Value type.
+	using size_type				 = std::size_t;							 ///< @brief	Size type.
+	using difference_type		 = std::ptrdiff_t;						 ///< @brief	Difference type.
+
+	// -----------------------------------
+
+	auto size() const noexcept { return kinds_.size(); }
+	auto empty() const noexcept { return kinds_.empty(); }
+	auto begin() const noexcept { return const_iterator{this, 0u}; }
+	auto end() const noexcept { return const_iterator{this, size()}; }
+	auto cbegin() const noexcept { return begin(); }
+	auto cend() const noexcept { return end(); }
+	auto rbegin() const noexcept { return const_reverse_iterator{end()}; }
+	auto rend() const noexcept { return const_reverse_iterator{begin()}; }
+	auto crbegin() const noexcept { return rbegin(); }
+	auto crend() const noexcept { return rend(); }
+
+	///	@brief	Gets the token.
+	///	@param[in]	index	Index of the token.
+	///	@return		The token.
+	token_t operator[](std::size_t index) const {
+		if (is_whitespace(index)) return whitespace_t{lengths_[index]};
+		auto const& span = span_of(offsets_[index]);
+		return preprocessing_token_t{span.text.substr(offsets_[index] - span.base, lengths_[index]), type(index), span.source.get()};
+	}
+	///	@overload
+	///	@throw	std::out_of_range	The @p index is out of range.
+	token_t at(std::size_t index) const {
+		if (size() <= index) throw std::out_of_range(std::to_string(index));
+		return (*this)[index];
+	}
+	token_t front() const { return (*this)[0u]; }
+	token_t back() const { return (*this)[size() - 1u]; }
+
+	///	@brief	Gets whether the token is whitespace or not.
+	///	@param[in]	index	Index of the token.
+	///	@return		Whether the token is whitespace or not.
+	bool is_whitespace(std::size_t index) const noexcept { return kinds_[index] == whitespace_kind; }
+	///	@brief	Gets whether the token is deferred text lines or not.
+	///	@param[in]	index	Index of the token.
+	///	@return		Whether the token is deferred text lines or not.
+	bool is_deferred(std::size_t index) const noexcept { return kinds_[index] == deferred_kind; }
+	///	@brief	Gets type of the preprocessing token.
+	///	@param[in]	index	Index of the token.
+	///	@return		Type of the preprocessing token.
+	preprocessing_token_type_t type(std::size_t index) const noexcept { return static_cast<preprocessing_token_type_t>(kinds_[index]); }
+	///	@brief	Gets string of the preprocessing token.
+	///	@param[in]	index	Index of the token.
+	///	@return		String of the preprocessing token, or empty if the token is whitespace.
+	std::string_view str(std::size_t index) const {
+		if (is_whitespace(index)) return {};
+		auto const& span = span_of(offsets_[index]);
+		return span.text.substr(offsets_[index] - span.base, lengths_[index]);
+	}
+	///	@brief	Gets number of newlines of the whitespace or the deferred text lines.
+	///	@param[in]	index	Index of the token.
+	///	@return		Number of newlines, which are counted in the raw text of deferred text lines, or zero if the token is a preprocessing token.
+	std::size_t newlines(std::size_t index) const {
+		if (is_whitespace(index)) return lengths_[index];
+		return is_deferred(index) ? simd::count(str(index), '\n') : 0u;
+	}
+
+	///	@brief	Finds the next preprocessing token.
+	///	@param[in]	index	Index to start finding.
+	///	@return		Index of the found token, or size of the collection if not found.
+	std::size_t next_preprocessing_token(std::size_t index) const noexcept {
+		auto const first = kinds_.data();
+		auto const last	 = first + kinds_.size();
+		return std::find_if(first + std::min(index, size()), last, [](auto kind) { return kind != whitespace_kind; }) - first;
+	}
+	///	@brief	Finds the next whitespace including newlines.
+	///		The flags column is searched by the SIMD kernel, since the newline is the only flag.
+	///	@param[in]	index	Index to start finding.
+	///	@return		Index of the found token, or size of the collection if not found.
+	std::size_t next_newline(std::size_t index) const noexcept {
+		auto const first  = std::min(index, size());
+		auto const column = std::string_view{reinterpret_cast<char const*>(flags_.data()), flags_.size()}.substr(first);
+		auto const ch	  = static_cast<char>(flag_t::newline);
+		return first + simd::find_either(column, ch, ch);
+	}
+
+	///	@brief	Gets the columns of tokens.
+	///	@return		Columns of tokens, whose offsets are relative to the spans.
+	columns_t columns() const noexcept { return {kinds_, flags_, offsets_, lengths_}; }
+	///	@brief	Gets total size of the texts which the tokens refer into.
+	///	@return		Total size of the spans.
+	std::size_t text_size() const noexcept { return table_ && ! table_->spans.empty() ? table_->spans.back().base + table_->spans.back().text.size() : 0u; }
+	///	@brief	Gets total size of the columns of the deferred text lines which have been tokenized.
+	///	@return		Size of the columns.
+	std::size_t deferred_size() const noexcept { return table_ && table_->deferred ? table_->deferred->size.load(std::memory_order_relaxed) : 0u; }
+	///	@brief	Charges sizes of the deferred text lines which are tokenized from now on to the counter, e.g., the size of a cache.
+	///	@param[in]	counter	Counter, which shall outlive the charges, or nullptr to stop charging.
+	///	@return		Total size of the columns of the deferred text lines which have been tokenized until now.
+	std::size_t charge(std::atomic<std::size_t>* counter) const {
+		if (! table_ || ! table_->deferred) return 0u;
+		std::lock_guard lock{table_->deferred->mutex};
+		table_->deferred->counter = counter;
+		return table_->deferred->size.load(std::memory_order_relaxed);
+	}
+
+	///	@brief	Gets tokens of the deferred text lines, which are tokenized at the first use and shared by copies of the collection.
+	///	@tparam		F			Type of @p tokenize.
+	///	@param[in]	index		Index of the deferred token.
+	///	@param[in]	tokenize	Function which tokenizes the text lines.
+	///	@return		Tokens of the text lines.
+	///	@throw	std::invalid_argument	The token is not deferred text lines.
+	template<typename F>
+	std::shared_ptr<tokens_t const> deferred(std::size_t index, F&& tokenize) const {
+		if (! is_deferred(index) || ! table_->deferred) throw std::invalid_argument("not deferred:" + std::to_string(index));
+		auto& deferred = *table_->deferred;
+		{
+			std::lock_guard lock{deferred.mutex};
+			if (auto const found = deferred.tokens.find(offsets_[index]); found != deferred.tokens.end()) return found->second;
+		}
+		// Text lines are tokenized without the lock, and the first of racing threads wins.
+		auto const tokens = std::make_shared<tokens_t const>(tokenize());
+		std::lock_guard lock{deferred.mutex};
+		auto const [found, inserted] = deferred.tokens.emplace(offsets_[index], tokens);
+		if (inserted) {
+			auto const size = tokens->size() * (sizeof(kind_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) * 2u);
+			deferred.size.fetch_add(size, std::memory_order_relaxed);
+			if (deferred.counter) deferred.counter->fetch_add(size, std::memory_order_relaxed);
+		}
+		return found->second;
+	}
+
+	// -----------------------------------
+
+	///	@brief	Reserves capacity.
+	///	@param[in]	capacity	Number of tokens.
+	void reserve(std::size_t capacity) {
+		kinds_.reserve(capacity);
+		flags_.reserve(capacity);
+		offsets_.reserve(capacity);
+		lengths_.reserve(capacity);
+	}
+	///	@brief	Attaches text, which following preprocessing tokens refer into.
+	///	@param[in]	text	Text.
+	///	@param[in]	source	Source which owns the @p text if exists.
+	void attach(std::string_view const& text, source_ptr_t const& source = {}) {
+		if (auto const found = find_span(text.data()); found && text.data() + text.size() <= found->text.data() + found->text.size()) return;
+		auto&		table = writable_table();
+		auto const	base  = table.spans.empty() ? std::size_t{} : table.spans.back().base + table.spans.back().text.size();
+		if (std::numeric_limits<std::uint32_t>::max() < base + text.size()) throw std::length_error("too large tokens");
+		table.addresses[text.data()] = table.spans.size();
+		table.spans.push_back(span_t{static_cast<std::uint32_t>(base), text, source});
+	}
+
+	///	@brief	Appends whitespace.
+	///	@param[in]	ws		Whitespace to append.
+	void push_back(whitespace_t const& ws) {
+		if (std::numeric_limits<std::uint32_t>::max() < ws.newlines()) throw std::length_error("too many newlines");
+		append(whitespace_kind, 0u < ws.newlines() ? static_cast<std::uint8_t>(flag_t::newline) : std::uint8_t{}, 0u, static_cast<std::uint32_t>(ws.newlines()));
+	}
+	///	@overload
+	///	@param[in]	token	Preprocessing token to append.
+	void push_back(preprocessing_token_t const& token) {
+		auto const str = token.str();
+		auto	   span = find_span(str.data());
+		if (! span || str.data() + str.size() > span->text.data() + span->text.size()) {
+			if (auto const source = token.source()) {
+				attach(source->text(), source->shared_from_this());
+			} else {
+				attach(str);
+			}
+			span = find_span(str.data());
+		}
+		append(static_cast<kind_t>(token.type()), std::uint8_t{}, static_cast<std::uint32_t>(span->base + (str.data() - span->text.data())), static_cast<std::uint32_t>(str.size()));
+	}
+	///	@brief	Appends text lines deferred to be tokenized.
+	///	@param[in]	lines	Text lines, which shall refer into an attached text.
+	///	@throw	std::invalid_argument	The @p lines do not refer into any attached text.
+	void defer(std::string_view const& lines) {
+		auto const span = find_span(lines.data());
+		if (! span || lines.data() + lines.size() > span->text.data() + span->text.size()) throw std::invalid_argument("deferred lines out of text");
+		auto const offset = static_cast<std::uint32_t>(span->base + (lines.data() - span->text.data()));
+		auto&	   table  = writable_table();
+		if (! table.deferred) table.deferred = std::make_shared<deferred_t>();
+		append(deferred_kind, lines.find('\n') != std::string_view::npos ? static_cast<std::uint8_t>(flag_t::newline) : std::uint8_t{}, offset, static_cast<std::uint32_t>(lines.size()));
+	}
+	///	@overload
+	///	@param[in]	token	Token to append.
+	void push_back(token_t const& token) {
+		std::visit([this](auto const& a) { push_back(a); }, token);
+	}
+	///	@brief	Appends token.
+	///	@tparam	T	Type of the token.
+	///	@param[in]	token	Token to append.
+	template<typename T>
+	void emplace_back(T&& token) { push_back(std::forward<T>(token)); }
+	///	@brief	Appends tokens.
+	///	@param[in]	first	The first of tokens to append.
+	///	@param[in]	last	The last of tokens to append.
+	///	@note	The columns are copied directly if the tokens share the spans.
+	void append(const_iterator first, const_iterator last) {
+		if (first == last) return;
+		auto const& tokens = *first.tokens_;
+		if (&tokens == this) {
+			tokens_t const copied(first, last);
+			append(copied.cbegin(), copied.cend());
+			return;
+		}
+		if (! table_) table_ = tokens.table_;
+		if (table_ != tokens.table_) {
+			for (; first != last; ++first) push_back(*first);
+			return;
+		}
+		auto const b = first.index();
+		auto const e = last.index();
+		kinds_.insert(kinds_.end(), tokens.kinds_.begin() + b, tokens.kinds_.begin() + e);
+		flags_.insert(flags_.end(), tokens.flags_.begin() + b, tokens.flags_.begin() + e);
+		offsets_.insert(offsets_.end(), tokens.offsets_.begin() + b, tokens.offsets_.begin() + e);
+		lengths_.insert(lengths_.end(), tokens.lengths_.begin() + b, tokens.lengths_.begin() + e);
+	}
+
+	// -----------------------------------
+
+	///	@brief	Constructor.
+	tokens_t() noexcept : kinds_{}, flags_{}, offsets_{}, lengths_{}, table_{}, cache_{} {}
+	///	@overload
+	///	@param[in]	first	The first of tokens.
+	///	@param[in]	last	The last of tokens.
+	///	@note	It shares the spans if the tokens are in the same collection.
+	tokens_t(const_iterator first, const_iterator last) : tokens_t{} {
+		if (first == last) return;
+		auto const& tokens = *first.tokens_;
+		auto const	b	   = first.index();
+		auto const	e	   = last.index();
+		kinds_.assign(tokens.kinds_.begin() + b, tokens.kinds_.begin() + e);
+		flags_.assign(tokens.flags_.begin() + b, tokens.flags_.begin() + e);
+		offsets_.assign(tokens.offsets_.begin() + b, tokens.offsets_.begin() + e);
+		lengths_.assign(tokens.lengths_.begin() + b, tokens.lengths_.begin() + e);
+		table_ = tokens.table_;
+	}
+	///	@overload
+	///	@tparam	I	Type of the input iterator.
+	///	@tparam	S	Type of the sentinel.
+	template<std::input_iterator I, std::sentinel_for<I> S>
+	tokens_t(I first, S last) : tokens_t{} {
+		for (; first != last; ++first) push_back(*first);
+	}
+	///	@overload
+	///	@param[in]	tokens	Tokens.
+	tokens_t(std::initializer_list<token_t> tokens) : tokens_t(tokens.begin(), tokens.end()) {}
+	///	@overload
+	///	@param[in]	columns	Columns of tokens, whose offsets refer into the text of the @p source.
+	///	@param[in]	source	Source.
+	///	@throw	std::invalid_argument	The columns are inconsistent, or any token is out of the text.
+	tokens_t(columns_t const& columns, source_ptr_t const& source) : tokens_t{} {
+		auto const n = columns.kinds.size();
+		if (columns.flags.size() != n || columns.offsets.size() != n || columns.lengths.size() != n) throw std::invalid_argument("inconsistent columns");
+		auto const text = source->text();
+		for (std::size_t i{}; i < n; ++i) {
+			if (columns.kinds[i] != whitespace_kind && text.size() < std::uint64_t{columns.offsets[i]} + columns.lengths[i]) throw std::invalid_argument("token out of source");
+		}
+		attach(text, source);
+		if (std::ranges::find(columns.kinds, deferred_kind) != columns.kinds.end()) writable_table().deferred = std::make_shared<deferred_t>();
+		kinds_.assign(columns.kinds.begin(), columns.kinds.end());
+		flags_.assign(columns.flags.begin(), columns.flags.end());
+		offsets_.assign(columns.offsets.begin(), columns.offsets.end());
+		lengths_.assign(columns.lengths.begin(), columns.lengths.end());
+	}
+
+private:
+	///	@brief	Span of text, which tokens refer into.
+	struct span_t {
+		std::uint32_t	 base;	 ///< @brief	Base offset of the span.
+		std::string_view text;	 ///< @brief	Text of the span.
+		source_ptr_t	 source; ///< @brief	Source which owns the text if exists.
+	};
+	///	@brief	Tokens of deferred text lines, which are keyed by their offsets.
+	struct deferred_t {
+		std::mutex														   mutex;	  ///< @brief	Mutex.
+		std::unordered_map<std::uint32_t, std::shared_ptr<tokens_t const>> tokens;	  ///< @brief	Tokenized text lines.
+		std::atomic<std::size_t>										   size{};	  ///< @brief	Total size of the columns of the tokenized text lines.
+		std::atomic<std::size_t>*										   counter{}; ///< @brief	Counter which is charged with the sizes as well.
+	};
+	///	@brief	Table of spans.
+	struct table_t {
+		std::vector<span_t>				   spans;	  ///< @brief	Spans in order of the base offset.
+		std::map<char const*, std::size_t> addresses; ///< @brief	Indices of the spans in order of the address.
+		std::shared_ptr<deferred_t>		   deferred;  ///< @brief	Tokens of deferred text lines, which are shared by copies of the table.
+	};
+
+	///	@brief	Appends token as columns.
+	void append(kind_t kind, std::uint8_t flags, std::uint32_t offset, std::uint32_t length) {
+		kinds_.push_back(kind);
+		flags_.push_back(flags);
+		offsets_.push_back(offset);
+		lengths_.push_back(length);
+	}
+	///	@brief	Gets the span which includes the offset.
+	span_t const& span_of(std::uint32_t offset) const noexcept {
+		auto const& spans = table_->spans;
+		if (spans.size() == 1u) return spans.front();
+		return *(std::ranges::upper_bound(spans, offset, {}, &span_t::base) - 1);
+	}
+	///	@brief	Finds the span which includes the address.
+	span_t const* find_span(char const* address) noexcept {
+		if (! table_) return nullptr;
+		auto const& spans	 = table_->spans;
+		auto const	includes = [address](span_t const& span) { return span.text.data() <= address && address <= span.text.data() + span.text.size(); };
+		if (cache_ < spans.size() && includes(spans[cache_])) return &spans[cache_];
+		auto const itr = table_->addresses.upper_bound(address);
+		if (itr == table_->addresses.begin() || ! includes(spans[std::prev(itr)->second])) return nullptr;
+		cache_ = std::prev(itr)->second;
+		return &spans[cache_];
+	}
+	///	@brief	Gets the table of spans to modify, which is copied if it is shared.
+	table_t& writable_table() {
+		if (! table_) {
+			table_ = std::make_shared<table_t>();
+		} else if (1 < table_.use_count()) {
+			table_ = std::make_shared<table_t>(*table_);
+		}
+		return *table_;
+	}
+
+private:
+	std::vector<kind_t>		   kinds_;	 ///< @brief	Kinds of tokens.
+	std::vector<std::uint8_t>  flags_;	 ///< @brief	Flags of tokens.
+	std::vector<std::uint32_t> offsets_; ///< @brief	Offsets of preprocessing tokens in the spans.
+	std::vector<std::uint32_t> lengths_; ///< @brief	Lengths of preprocessing tokens, or numbers of newlines of whitespaces.
+	std::shared_ptr<table_t>   table_;	 ///< @brief	Table of spans shared by copies.
+	std::size_t				   cache_;	 ///< @brief	Index of the span found lastly.
+};
+
+// -----------------------------------
+// scanner engine
+
+///	@brief	Gets whether the character belongs to the character classes or not.
+///	@param[in]	ch		Character.
+///	@param[in]	classes	Character classes.
+///	@return		Whether the @p ch belongs to any of the @p classes or not.
+constexpr inline bool
+has_char_class(char ch, std::same_as<def::char_class_t> auto... classes) noexcept {
+	return (def::char_classes[static_cast<unsigned char>(ch)] & (static_cast<std::uint8_t>(classes) | ...)) != 0u;
+}
+
+///	@brief	Scans universal character name (@\uXXXX or @\UXXXXXXXX).
+///	@param[in]	str		String.
+///	@param[in]	pos		Position to start scanning.
+///	@return		Length of the universal character name, or zero if it does not exist.
+constexpr inline std::size_t
+scan_universal_character_name(std::string_view const& str, std::size_t pos) noexcept {
+	using enum def::char_class_t;
+	if (str.size() < pos + 2u || str[pos] != '\\') return 0u;
+	std::size_t const digits = str[pos + 1u] == 'u' ? 4u : str[pos + 1u] == 'U' ? 8u : 0u;
+	if (digits == 0u || str.size() < pos + 2u + digits) return 0u;
+	for (auto i = pos + 2u; i < pos + 2u + digits; ++i) {
+		if (! has_char_class(str[i], hexadecimal)) return 0u;
+	}
+	return 2u + digits;
+}
+
+///	@brief	Scans trailing characters of identifier.
+///	@param[in]	str		String.
+///	@param[in]	pos		Position to start scanning.
+///	@return		Position next to the last character of the identifier.
+constexpr inline std::size_t
+scan_identifier_continue(std::string_view const& str, std::size_t pos) noexcept {
+	using enum def::char_class_t;
+	while (pos < str.size()) {
+		if (has_char_class(str[pos], digit, nondigit)) {
+			++pos;
+		} else if (auto const ucn = scan_universal_character_name(str, pos); 0u < ucn) {
+			pos += ucn;
+		} else {
+			break;
+		}
+	}
+	return pos;
+}
+
+///	@brief	Scans identifier.
+///	@param[in]	str		String.
+///	@param[in]	pos		Position to start scanning.
+///	@return		Position next to the last character of the identifier, or @p pos if it does not exist.
+constexpr inline std::size_t
+scan_identifier(std::string_view const& str, std::size_t pos) noexcept {
+	using enum def::char_class_t;
+	if (str.size() <= pos) return pos;
+	if (has_char_class(str[pos], nondigit)) return scan_identifier_continue(str, pos + 1u);
+	if (auto const ucn = scan_universal_character_name(str, pos); 0u < ucn) return scan_identifier_continue(str, pos + ucn);
+	return pos;
+}
+
+///	@brief	Scans preprocessing number.
+///	@param[in]	str		String.
+///	@return		Length of the preprocessing number, or zero if it does not exist.
+constexpr inline std::size_t
+scan_pp_number(std::string_view const& str) noexcept {
+	using enum def::char_class_t;
+	std::size_t pos = str.starts_with('.') ? 1u : 0u;
+	if (str.size() <= pos || ! has_char_class(str[pos], digit)) return 0u;
+	for (++pos; pos < str.size();) {
+		auto const ch = str[pos];
+		if ((ch == 'e' || ch == 'E' || ch == 'p' || ch == 'P') && pos + 1u < str.size() && (str[pos + 1u] == '+' || str[pos + 1u] == '-')) {
+			pos += 2u;
+		} else if (has_char_class(ch, digit, nondigit) || ch == '.') {
+			++pos;
+		} else if (ch == '\'' && pos + 1u < str.size() && has_char_class(str[pos + 1u], digit, nondigit)) {
+			pos += 2u;
+		} else if (auto const ucn = scan_universal_character_name(str, pos); 0u < ucn) {
+			pos += ucn;
+		} else {
+			break;
+		}
+	}
+	return pos;
+}
+
+///	@brief	Scans quoted characters of string literal or character literal.
+///	@param[in]	str		String.
+///	@param[in]	pos		Position of the opening quote.
+///	@return		Position next to the closing quote, or zero if it is not terminated.
+constexpr inline std::size_t
+scan_quoted(std::string_view const& str, std::size_t pos) noexcept {
+	using enum def::char_class_t;
+	auto const quote = str[pos];
+	for (auto i = pos + 1u; i < str.size(); ++i) {
+		auto const ch = str[i];
+		if (ch == quote) {
+			return (quote == '\'' && i == pos + 1u) ? 0u : i + 1u; // Empty character literal is invalid.
+		} else if (ch == '\\') {
+			if (++i == str.size() || has_char_class(str[i], newline)) return 0u;
+		} else if (has_char_class(ch, newline)) {
+			return 0u;
+		}
+	}
+	return 0u;
+}
+
+///	@brief	Scans raw string literal (R"delimiter(...)delimiter").
+///	@param[in]	str		String.
+///	@param[in]	pos		Position of the opening double quote.
+///	@return		Position next to the closing double quote, or zero if it is not terminated.
+constexpr inline std::size_t
+scan_raw_string(std::string_view const& str, std::size_t pos) noexcept {
+	using enum def::char_class_t;
+	auto open = pos + 1u;
+	while (open < str.size() && has_char_class(str[open], d_char)) ++open;
+	if (str.size() <= open || str[open] != '(' || 16u < open - pos - 1u) return 0u;
+
+	auto const delimiter = str.substr(pos + 1u, open - pos - 1u);
+	for (auto close = str.find(')', open + 1u); close != std::string_view::npos; close = str.find(')', close + 1u)) {
+		auto const end = close + 1u + delimiter.size();
+		if (end < str.size() && str[end] == '"' && str.substr(close + 1u, delimiter.size()) == delimiter) return end + 1u;
+	}
+	return 0u;
+}
+
+///	@brief	Scans preprocessing operator or punctuator with the longest match.
+///	@param[in]	str		String.
+///	@return		Length of the operator or punctuator, or zero if it does not exist.
+constexpr inline std::size_t
+scan_preprocessing_op_or_punc(std::string_view const& str) noexcept {
+	auto const at = [&str](std::size_t i) noexcept { return i < str.size() ? str[i] : '\0'; };
+	if (str.empty()) return 0u;
+	switch (str[0]) {
+	case '{':
+	case '}':
+	case '[':
+	case ']':
+	case '(':
+	case ')':
+	case ';':
+	case '?':
+	case ',':
+	case '~': return 1u;
+	case '#': return at(1) == '#' ? 2u : 1u;										// ## #
+	case '.': return (at(1) == '.' && at(2) == '.') ? 3u : at(1) == '*' ? 2u : 1u; // ... .* .
+	case ':': return (at(1) == ':' || at(1) == '>') ? 2u : 1u;					// :: :> :
+	case '-': return at(1) == '>' ? (at(2) == '*' ? 3u : 2u) : (at(1) == '-' || at(1) == '=') ? 2u : 1u; // ->* -> -- -= -
+	case '+': return (at(1) == '+' || at(1) == '=') ? 2u : 1u;					// ++ += +
+	case '&': return (at(1) == '&' || at(1) == '=') ? 2u : 1u;					// && &= &
+	case '|': return (at(1) == '|' || at(1) == '=') ? 2u : 1u;					// || |= |
+	case '*':
+	case '/':
+	case '^':
+	case '!':
+	case '=': return at(1) == '=' ? 2u : 1u; // *= /= ^= != == * / ^ ! =
+	case '%':
+		if (at(1) == ':') return (at(2) == '%' && at(3) == ':') ? 4u : 2u; // %:%: %:
+		return (at(1) == '>' || at(1) == '=') ? 2u : 1u;					// %> %= %
+	case '<':
+		if (at(1) == '<') return at(2) == '=' ? 3u : 2u; // <<= <<
+		if (at(1) == '=') return at(2) == '>' ? 3u : 2u; // <=> <=
+		if (at(1) == ':') {
+			// <:: is treated as < followed by :: unless the next character is : or >.
+			return (at(2) == ':' && at(3) != ':' && at(3) != '>') ? 1u : 2u;
+		}
+		return at(1) == '%' ? 2u : 1u; // <% <
+	case '>':
+		if (at(1) == '>') return at(2) == '=' ? 3u : 2u; // >>= >>
+		return at(1) == '=' ? 2u : 1u;					 // >= >
+	default: return 0u;
+	}
+}
+
+///	@brief	Scans a preprocessing token at the head of the string.
+///		It recognizes all the classes of preprocessing token in a single linear pass.
+///	@param[in]	str					String.
+///	@param[in]	accepts_header_name	Whether header name is acceptable or not, e.g., just after the #include.
+///	@return	Scanned preprocessing token.
+///		The first of tuple is length of the token, which is zero if no valid token exists.
+///		The second of tuple is type of the token.
+constexpr inline std::tuple<std::size_t, preprocessing_token_type_t>
+scan_preprocessing_token(std::string_view const& str, bool accepts_header_name = false) noexcept {
+	using enum preprocessing_token_type_t;
+	if (str.empty()) return {0u, unknown};
+
+	auto const ch = str[0];
+	// -----------------------------------
+	// header name, which is recognized only in specific contexts.
+	if (accepts_header_name && ch == '<') {
+		if (auto const end = str.find_first_of(">\r\n", 1u); end != std::string_view::npos && 1u < end && str[end] == '>') return {end + 1u, header_name};
+	}
+	// -----------------------------------
+	// literals with encoding prefix (u8, u, U, L) and raw string literals.
+	if (ch == 'u' || ch == 'U' || ch == 'L' || ch == 'R') {
+		auto const prefix = str.starts_with("u8") ? 2u : (ch == 'R') ? 0u : 1u;
+		if (str.substr(prefix).starts_with("R\"")) {
+			if (auto const end = scan_raw_string(str, prefix + 1u); 0u < end) return {scan_identifier(str, end), string_literal};
+		} else if (0u < prefix && prefix < str.size() && (str[prefix] == '"' || str[prefix] == '\'')) {
+			if (auto const end = scan_quoted(str, prefix); 0u < end) return {scan_identifier(str, end), str[prefix] == '"' ? string_literal : character_literal};
+		}
+	}
+	// -----------------------------------
+	// other classes, which are determined by the first character.
+	if (ch == '"' || ch == '\'') {
+		if (auto const end = scan_quoted(str, 0u); 0u < end) return {scan_identifier(str, end), ch == '"' ? string_literal : character_literal};
+		return {0u, unknown};
+	} else if (auto const number = scan_pp_number(str); 0u < number) {
+		return {number, pp_number};
+	} else if (auto const name = scan_identifier(str, 0u); 0u < name) {
+		return {name, identifier};
+	} else if (auto const punctuator = scan_preprocessing_op_or_punc(str); 0u < punctuator) {
+		return {punctuator, preprocessing_op_or_punc};
+	} else {
+		return {0u, unknown};
+	}
+}
+
+///	@brief	Scans newlines (LF or CR+LF).
+///	@param[in]	str		String.
+///	@return	Scanned newlines.
+///		The first of tuple is length of the newlines.
+///		The second of tuple is number of the newlines.
+///	@throw	std::invalid_argument	Single carriage return appears.
+constexpr inline std::tuple<std::size_t, std::size_t>
+scan_newlines(std::string_view const& str) {
+	std::size_t pos{}, newlines{};
+	for (; pos < str.size(); ++pos, ++newlines) {
+		if (str[pos] == '\r') {
+			if (str.size() <= pos + 1u || str[pos + 1u] != '\n') throw std::invalid_argument("unsupported single carridge return");
+			++pos;
+		} else if (str[pos] != '\n') {
+			break;
+		}
+	}
+	return {pos, newlines};
+}
+
+///	@brief	Scans block comment (/ *...* /).
+///	@param[in]	str		String.
+///	@return	Scanned block comment.
+///		The first of tuple is length of the comment, which is zero if the comment does not exist.
+///		The second of tuple is number of newlines in the comment.
+///	@throw	std::invalid_argument	The comment is not terminated.
+constexpr inline std::tuple<std::size_t, std::size_t>
+scan_block_comment(std::string_view const& str) {
+	if (! str.starts_with("/*")) return {0u, 0u};
+	if (std::is_constant_evaluated()) {
+		auto const end = str.find("*/", 2u);
+		if (end == std::string_view::npos) throw std::invalid_argument("unterminated block comment");
+		auto const comment = str.substr(0u, end + 2u);
+		return {comment.size(), static_cast<std::size_t>(std::ranges::count(comment, '\n'))};
+	}
+	// jumps from an asterisk to the next one by the SIMD kernel.
+	for (auto pos = 2u + simd::find_either(str.substr(2u), '*', '*'); pos + 1u < str.size(); pos += 1u + simd::find_either(str.substr(pos + 1u), '*', '*')) {
+		if (str[pos + 1u] == '/') return {pos + 2u, simd::count(str.substr(0u, pos), '\n')};
+	}
+	throw std::invalid_argument("unterminated block comment");
+}
+
+///	@brief	Scans line comment (//...), which does not include the terminating newline.
+///	@param[in]	str		String.
+///	@return		Length of the comment, or zero if the comment does not exist.
+constexpr inline std::size_t
+scan_line_comment(std::string_view const& str) noexcept {
+	if (! str.starts_with("//")) return 0u;
+	if (std::is_constant_evaluated()) return std::min(str.find_first_of("\r\n", 2u), str.size());
+	return 2u + simd::find_either(str.substr(2u), '\r', '\n');
+}
+
+///	@brief	Scans whitespaces, which consist of inline whitespaces, newlines, and comments.
+///	@param[in]	str		String.
+///	@return	Scanned whitespaces.
+///		The first of tuple is length of the whitespaces, which is zero if no whitespace exists.
+///		The second of tuple is number of newlines in the whitespaces.
+///	@throw	std::invalid_argument	Single carriage return or unterminated block comment appears.
+constexpr inline std::tuple<std::size_t, std::size_t>
+scan_whitespaces(std::string_view const& str) {
+	using enum def::char_class_t;
+	std::size_t pos{}, newlines{};
+	while (pos < str.size()) {
+		auto const s = str.substr(pos);
+		if (has_char_class(s[0], blank)) {
+			pos += std::is_constant_evaluated() ? 1u : simd::skip_blanks(s);
+		} else if (has_char_class(s[0], newline)) {
+			auto const [length, lf] = scan_newlines(s);
+			pos += length;
+			newlines += lf;
+		} else if (auto const line = scan_line_comment(s); 0u < line) {
+			pos += line;
+		} else if (auto const [block, lf] = scan_block_comment(s); 0u < block) {
+			pos += block;
+			newlines += lf;
+		} else {
+			break;
+		}
+	}
+	return {pos, newlines};
+}
 
 ///	@brief	Parses newlines.
 ///	@param[in]	str		String.
@@ -295,13 +1172,8 @@ using tokens_t = std::vector<token_t>;
 ///		The second of tuple is number of new lines.
 inline std::tuple<std::string_view, std::size_t>
 parse_newlines(std::string_view const& str) {
-	if (auto const pos = str.find_first_not_of("\r\n"); pos == std::string_view::npos) {
-		return {std::string_view{}, 0u};
-	} else if (str.find("\r\r") != std::string_view::npos || str.at(pos - 1) == '\r') {
-		throw std::invalid_argument("unsupported single carridge return");
-	} else {
-		return {str.substr(pos), std::ranges::count(str, '\n')};
-	}
+	auto const [length, newlines] = scan_newlines(str);
+	return {str.substr(length), newlines};
 }
 
 ///	@brief	Parses block comments.
@@ -311,13 +1183,8 @@ parse_newlines(std::string_view const& str) {
 ///		The second of tuple is number of new lines.
 inline std::tuple<std::string_view, std::size_t>
 parse_block_comments(std::string_view const& str) {
-	if (! str.starts_with("/*")) {
-		return {str, 0u};
-	} else {
-		auto const s   = str.substr(2);
-		auto const end = s.find_first_of("*/");
-		return {s, end};
-	}
+	auto const [length, newlines] = scan_block_comment(str);
+	return {str.substr(length), newlines};
 }
 
 ///	@brief	Parses whitespaces.
@@ -328,67 +1195,292 @@ parse_block_comments(std::string_view const& str) {
 inline std::tuple<std::string_view, std::optional<whitespace_t>>
 parse_whitespaces(std::string_view const& str) {
 	log::logger_t logger;
-	log::tracer_t tracer{logger, util::escape(str)};
-
-	std::size_t newlines{};
-	svmatch		r;
-	if (auto const [s1, lf1] = parse_newlines(str); 0u < lf1) {
-		tracer.trace(std::to_string(__LINE__) + " {newlines:" + std::to_string(lf1));
-		return {s1, whitespace_t{lf1}};
-	} else if (auto const [s2, lf2] = parse_block_comments(str); 0u < lf2) {
-		tracer.trace(std::to_string(__LINE__) + " {block comments:" + std::to_string(lf2));
-		return {s2, whitespace_t{lf2}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::line_comment_re)) {
-		newlines = std::ranges::count(r.str(1), '\n');
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1) + " " + std::to_string(newlines));
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::inline_whitespaces_re)) {
-		// nothing to do
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1) + " " + std::to_string(newlines));
-	} else {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1) + " " + std::to_string(newlines));
+	log::tracer_t tracer{logger, log::escaped{str}};
+
+	auto const [length, newlines] = scan_whitespaces(str);
+	if (length == 0u) {
 		tracer.set_result(0);
 		return {str, std::nullopt};
 	}
-	auto const sss = str.substr(r.str(1).size());
+	auto const rest = str.substr(length);
 
-	tracer.set_result(std::to_string(newlines) + ":" + util::escape(sss));
-	return {sss, whitespace_t{newlines}};
+	tracer.set_result(newlines, ":", log::escaped{rest});
+	return {rest, whitespace_t{newlines}};
 }
 
 ///	@brief	Parses preprocessing token.
-///	@param[in]	str		String.
+///	@param[in]	str					String.
+///	@param[in]	accepts_header_name	Whether header name is acceptable or not.
 ///	@return	Parsed preprocessing token.
 ///		The first of tuple is remaining string.
 ///		The second of tuple is parsed tokens if exists.
 inline std::tuple<std::string_view, token_t>
-parse_preprocessing_token(std::string_view const& str) {
+parse_preprocessing_token(std::string_view const& str, bool accepts_header_name = false) {
 	log::logger_t logger;
-	log::tracer_t tracer{logger, util::escape(str)};
+	log::tracer_t tracer{logger, log::escaped{str}};
 
 	if (str.empty()) throw std::invalid_argument("empty string");
 
 	// parses preprocessing tokens
-	if (svmatch r; std::regex_match(str.cbegin(), str.cend(), r, def::string_literal_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::string_literal}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::character_literal_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::character_literal}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::header_name_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::header_name}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::pp_number_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::pp_number}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::identifier_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::identifier}};
-	} else if (std::regex_match(str.cbegin(), str.cend(), r, def::preprocessing_op_or_punc_re)) {
-		tracer.trace(std::to_string(__LINE__) + " " + r.str(1));
-		return {str.substr(r.str(1).size()), preprocessing_token_t{r.str(1), preprocessing_token_type_t::preprocessing_op_or_punc}};
-	} else {
-		throw std::invalid_argument("invalid preprocessing token:" + util::escape(str));
+	auto const [length, type] = scan_preprocessing_token(str, accepts_header_name);
+	if (length == 0u) throw std::invalid_argument("invalid preprocessing token:" + util::escape(str));
+
+	auto const token = str.substr(0u, length);
+	tracer.trace(__LINE__, " ", token);
+	return {str.substr(length), preprocessing_token_t{token, type}};
+}
+
+///	@brief	Gets whether the next preprocessing token can be a header name or not.
+///		The header name is recognized only just after the #include directive, whose # may be spelled as the digraph %:, or the __has_include.
+///	@param[in]	tokens	Tokens parsed so far.
+///	@return		Whether the next preprocessing token can be a header name or not.
+inline bool
+accepts_header_name(tokens_t const& tokens) {
+	auto const is = [&tokens](std::size_t n, std::string_view const& str) { return n <= tokens.size() && ! tokens.is_whitespace(tokens.size() - n) && tokens.str(tokens.size() - n) == str; };
+
+	// The directive follows a newline, or deferred text lines which end with their newline.
+	if (is(1u, "include") && (is(2u, "#") || is(2u, "%:"))) return tokens.size() == 2u || tokens.is_whitespace(tokens.size() - 3u) || tokens.is_deferred(tokens.size() - 3u);
+	return is(1u, "(") && is(2u, "__has_include");
+}
+
+///	@brief	Parses preprocessing tokens of logical source (phase 3).
+///		It advances a cursor over the immutable @p text, so that each token costs its own length only.
+///	@param[in]	text	Logical source, which is terminated by a newline character.
+///	@param[in]	source	Source which owns the @p text if exists.
+///	@return		Parsed tokens.
+inline tokens_t
+tokenize(std::string_view const& text, source_ptr_t const& source) {
+	prof::scope_t const scope{prof::phase_t::tokenize, text.size()};
+
+	tokens_t tokens;
+	tokens.attach(text, source);
+	for (std::size_t pos{}; pos < text.size();) {
+		auto const s = text.substr(pos);
+		// -----------------------------------
+		// replaces whilespaces, which just keep count of new lines.
+		if (auto const [length, newlines] = scan_whitespaces(s); 0u < length) {
+			if (0u < newlines) tokens.emplace_back(whitespace_t{newlines});
+			pos += length;
+			continue;
+		}
+
+		// -----------------------------------
+		// parses preprocessing tokens.
+		auto const [length, type] = scan_preprocessing_token(s, accepts_header_name(tokens));
+		if (length == 0u) throw std::invalid_argument("invalid preprocessing token:" + util::escape(s));
+		tokens.emplace_back(preprocessing_token_t{s.substr(0u, length), type, source.get()});
+		pos += length;
+	}
+	return tokens;
+}
+///	@overload
+inline tokens_t
+tokenize(source_ptr_t const& source) { return tokenize(source->text(), source); }
+///	@overload
+inline tokens_t
+tokenize(std::string_view const& text) { return tokenize(text, source_ptr_t{}); }
+
+///	@brief	Finds a line splice, i.e., a backslash followed by a newline.
+///	@param[in]	str		String.
+///	@param[in]	pos		Position to start finding.
+///	@return		Position of the backslash, or std::string_view::npos if not found.
+inline std::size_t
+find_splice(std::string_view const& str, std::size_t pos = 0u) noexcept {
+	for (pos = str.find('\\', pos); pos != std::string_view::npos; pos = str.find('\\', pos + 1u)) {
+		auto const next = str.substr(pos + 1u);
+		if (next.starts_with('\n') || next.starts_with("\r\n")) return pos;
+	}
+	return std::string_view::npos;
+}
+
+///	@brief	Splices physical lines into logical lines (phase 2).
+///		It copies the segments between the splices once, and records where the splices were.
+///	@param[in]	str		Physical source.
+///	@return	Logical source.
+///		The first of tuple is text of the logical source, which is terminated by a newline character.
+///		The second of tuple is line splices.
+///	@throw	std::invalid_argument	The source is too large to record the splices.
+inline std::tuple<std::string, splices_t>
+splice_lines(std::string_view const& str) {
+	if (std::numeric_limits<std::uint32_t>::max() <= str.size()) throw std::invalid_argument("too large source");
+	prof::scope_t const scope{prof::phase_t::splice, str.size()};
+
+	std::string logical;
+	splices_t	splices;
+	logical.reserve(str.size() + 1u);
+	std::size_t line{};
+	for (std::size_t pos{};;) {
+		auto const splice  = find_splice(str, pos);
+		auto const segment = str.substr(pos, splice - pos);
+		logical.append(segment);
+		if (splice == std::string_view::npos) break;
+
+		line += simd::count(segment, '\n') + 1u;
+		splices.push_back({static_cast<std::uint32_t>(logical.size()), static_cast<std::uint32_t>(line)});
+		pos = splice + (str[splice + 1u] == '\r' ? 3u : 2u);
+	}
+	// Any source file shall be terminated by a newline character.
+	if (! logical.empty() && logical.back() != '\n') logical.push_back('\n'); // Extra line would be added if the last LF is escaped.
+	return {std::move(logical), std::move(splices)};
+}
+
+///	@brief	Gets the end of the logical line, which skips comments, literals, and line splices.
+///	@param[in]	text	Physical source.
+///	@param[in]	pos		Position in the line.
+///	@return		Position next to the newline which ends the line, or size of the @p text if not found.
+inline std::size_t
+skip_logical_line(std::string_view const& text, std::size_t pos) noexcept {
+	auto const is_word	 = [](char ch) noexcept { return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_' || ch == '.'; };
+	auto const word		 = [&text, &is_word](std::size_t end) noexcept {
+		auto begin = end;
+		while (0u < begin && is_word(text[begin - 1u])) --begin;
+		return text.substr(begin, end - begin);
+	};
+	// An unmatched quote ends at the newline, which still ends the line, e.g., an apostrophe in #error.
+	auto const skip_quoted = [&text](std::size_t p, char quote) noexcept {
+		for (++p; p < text.size() && text[p] != quote && text[p] != '\n'; ++p) {
+			if (text[p] == '\\') ++p;
+		}
+		return p < text.size() && text[p] == quote ? p + 1u : std::min(p, text.size());
+	};
+
+	while ((pos = text.find_first_of("\n\\/\"'", pos)) != std::string_view::npos) {
+		switch (text[pos]) {
+		case '\n': return pos + 1u;
+		case '\\': pos += text.substr(pos + 1u).starts_with("\r\n") ? 3u : 2u; break; // A splice or an escape just continues.
+		case '/':
+			if (text.substr(pos).starts_with("//")) {
+				// A line comment is continued by splices.
+				for (pos = text.find('\n', pos); pos != std::string_view::npos && (text[pos - 1u] == '\\' || (text[pos - 1u] == '\r' && text[pos - 2u] == '\\')); pos = text.find('\n', pos + 1u)) {}
+				return pos == std::string_view::npos ? text.size() : pos + 1u;
+			} else if (text.substr(pos).starts_with("/*")) {
+				pos = text.find("*/", pos + 2u);
+				if (pos == std::string_view::npos) return text.size();
+				pos += 2u;
+			} else {
+				++pos;
+			}
+			break;
+		case '"':
+			if (auto const prefix = word(pos); prefix == "R" || prefix == "LR" || prefix == "uR" || prefix == "UR" || prefix == "u8R") {
+				auto const open	 = text.find('(', pos);
+				auto const close = open == std::string_view::npos ? open : text.find(")" + std::string{text.substr(pos + 1u, open - pos - 1u)} + "\"", open);
+				if (close == std::string_view::npos) return text.size();
+				pos = close + (open - pos) + 1u;
+			} else {
+				pos = skip_quoted(pos, '"');
+			}
+			break;
+		default:
+			// A single quote in a number is a digit separator.
+			if (auto const w = word(pos); ! w.empty() && std::isdigit(static_cast<unsigned char>(w.front()))) {
+				++pos;
+			} else {
+				pos = skip_quoted(pos, '\'');
+			}
+			break;
+		}
 	}
+	return text.size();
+}
+
+///	@brief	Minimizes the physical source to its directives.
+///		Lines beginning with a pound are kept as they are, and the other lines are replaced by their newlines,
+///		so that the minimized source keeps positions of the directives.
+///		Block comments before the pound are skipped as well as blanks, e.g., /* c */ #include <a.h>.
+///	@param[in]	text	Physical source.
+///	@return		Minimized source.
+inline std::string
+minimize_directives(std::string_view const& text) {
+	std::string minimized;
+	for (std::size_t pos{}; pos < text.size();) {
+		auto head = text.substr(pos + simd::skip_blanks(text.substr(pos)));
+		while (head.starts_with("/*")) {
+			auto const close = head.find("*/", 2u);
+			if (close == std::string_view::npos) break; // The unterminated comment is left to the scan of the line.
+			head = head.substr(close + 2u);
+			head = head.substr(simd::skip_blanks(head));
+		}
+		auto const end	= skip_logical_line(text, pos);
+		auto const line = text.substr(pos, end - pos);
+		if (head.starts_with('#') || head.starts_with("%:")) {
+			minimized.append(line);
+		} else {
+			minimized.append(simd::count(line, '\n'), '\n');
+		}
+		pos = end;
+	}
+	return minimized;
+}
+
+///	@brief	Parses preprocessing tokens of directives in logical source, and defers the text lines (phase 3).
+///		Each run of text lines up to the next directive is appended as a deferred token which refers into the raw text,
+///		so that the text lines which are excluded by the preprocessor are never tokenized.
+///		An unmatched quote in a directive is parsed as a token of itself whose type is unknown, as GCC and Clang do,
+///		since the directive may be excluded, e.g., #error can't, and the preprocessor diagnoses it only if the directive is processed.
+///	@param[in]	text	Logical source, which is terminated by a newline character.
+///	@param[in]	source	Source which owns the @p text.
+///	@return		Parsed tokens.
+inline tokens_t
+tokenize_lazily(std::string_view const& text, source_ptr_t const& source) {
+	prof::scope_t scope{prof::phase_t::tokenize};
+
+	auto const is_directive = [&text](std::size_t pos) { return text[pos] == '#' || text.substr(pos).starts_with("%:"); };
+	tokens_t   tokens;
+	tokens.attach(text, source);
+	for (std::size_t pos{}; pos < text.size();) {
+		if (auto const [length, newlines] = scan_whitespaces(text.substr(pos)); 0u < length) {
+			if (0u < newlines) tokens.emplace_back(whitespace_t{newlines});
+			pos += length;
+			continue;
+		}
+		// -----------------------------------
+		// The text lines are deferred with the following whitespaces, so that they are tokenized as the same tokens later.
+		if (! is_directive(pos)) {
+			auto end = pos;
+			do {
+				end = skip_logical_line(text, end);
+				end += std::get<0>(scan_whitespaces(text.substr(end)));
+			} while (end < text.size() && ! is_directive(end));
+			tokens.defer(text.substr(pos, end - pos));
+			pos = end;
+			continue;
+		}
+		// -----------------------------------
+		// The directive is tokenized up to its newline.
+		auto const first = pos;
+		for (auto newline = false; ! newline && pos < text.size();) {
+			auto const s = text.substr(pos);
+			if (auto const [length, newlines] = scan_whitespaces(s); 0u < length) {
+				if (0u < newlines) tokens.emplace_back(whitespace_t{newlines});
+				newline = 0u < newlines;
+				pos += length;
+				continue;
+			}
+			auto const [scanned, type] = scan_preprocessing_token(s, accepts_header_name(tokens));
+			auto const length		   = scanned == 0u && (s[0] == '\'' || s[0] == '"') ? 1u : scanned;
+			if (length == 0u) throw std::invalid_argument("invalid preprocessing token:" + util::escape(s));
+			tokens.emplace_back(preprocessing_token_t{s.substr(0u, length), type, source.get()});
+			pos += length;
+		}
+		scope.add(pos - first);
+	}
+	return tokens;
+}
+///	@overload
+inline tokens_t
+tokenize_lazily(source_ptr_t const& source) { return tokenize_lazily(source->text(), source); }
+
+///	@brief	Parses preprocessing tokens of the deferred text lines, which are shared by copies of the @p tokens.
+///	@param[in]	tokens	Tokens.
+///	@param[in]	index	Index of the deferred token.
+///	@return		Parsed tokens of the text lines.
+inline std::shared_ptr<tokens_t const>
+tokenize_deferred(tokens_t const& tokens, std::size_t index) {
+	return tokens.deferred(index, [&tokens, index] {
+		auto const source = std::get<preprocessing_token_t>(tokens[index]).source();
+		return tokenize(tokens.str(index), source ? source->shared_from_this() : source_ptr_t{});
+	});
 }
 
 ///	@brief	Scans file.
@@ -396,82 +1488,407 @@ parse_preprocessing_token(std::string_view const& str) {
 /// 	- phase 2: converts physical source to logical source.
 /// 	- phase 3: parses preprocessing tokens and replaces comments exespting new line.
 /// 	- phase 4: preprocessing directies are executed.
-///	@param[in]	path	Path.
+///	@param[in]	path		Path.
+///	@param[in]	file		Buffer of the opened file.
+///	@param[in]	defers_text	Whether text lines are deferred to be tokenized or not, see @ref tokenize_lazily.
 ///	@return		Parsed tokens.
 inline tokens_t
-scan(std::filesystem::path const& path) {
+scan(std::filesystem::path const& path, util::file_buffer_ptr_t const& file, bool defers_text = false) {
 	log::logger_t logger;
-	log::tracer_t tracer{logger, path.string()};
+	log::tracer_t tracer{logger, path};
+	prof::file_scope_t const profiled{path};
+	log::span_t const		 span{"Scan", path};
 
 	// -----------------------------------
-	// Loads file and strip BOM if exists.
-	auto const physical_source = util::load_file(path);
+	// The view of file excludes BOM if exists.
+	auto const physical_source = file->view();
 	if (physical_source.empty()) {
 		tracer.set_result(0);
 		return {};
 	}
 	// -----------------------------------
-	// All the charcaters are converted to 32bit string once.
-	auto const chars = uc::to_32string(physical_source);
-	if (chars.empty()) {
-		auto const msg = __func__ + std::to_string(__LINE__);
-		tracer.set_result(msg);
-		throw std::invalid_argument(msg);
-	}
 	// replaces all the non basic source character set to universal character set.
-	auto const phase1 = escape_non_basic_source_character_set(chars);
-	if (phase1.empty()) {
-		auto const msg = __func__ + std::to_string(__LINE__);
-		tracer.set_result(msg);
-		throw std::invalid_argument(msg);
+	auto const escapes = prof::measure(prof::phase_t::decode, physical_source.size(), [&physical_source] { return simd::skip_basic(physical_source) != physical_source.size(); });
+	auto	   phase1  = escapes ? escape_non_basic_source_character_set(physical_source) : std::string{};
+	auto const text	   = escapes ? std::string_view{phase1} : physical_source;
+
+	// -----------------------------------
+	// converts physical source to logical source, which is skipped if nothing is spliced.
+	source_ptr_t source;
+	if (text.ends_with('\n') && prof::measure(prof::phase_t::splice, text.size(), [&text] { return find_splice(text); }) == std::string_view::npos) {
+		// The tokens refer into the file buffer directly if no phase changes the source.
+		source = escapes ? source_manager().add(path, std::move(phase1)) : source_manager().add(path, file, physical_source);
+	} else {
+		auto [phase2, splices] = splice_lines(text);
+		if (phase2.empty()) {
+			auto const msg = __func__ + std::to_string(__LINE__);
+			tracer.set_result(msg);
+			throw std::invalid_argument(msg);
+		}
+		source = source_manager().add(path, std::move(phase2), std::move(splices));
 	}
 
 	// -----------------------------------
-	// converts physical source to logical source.
-	auto const phase2 = std::regex_replace(phase1, def::escaped_newline_re, "");
-	if (phase2.empty()) {
+	// parses preprocessing tokens, which share the source.
+	auto const phase3 = defers_text ? tokenize_lazily(source) : tokenize(source);
+	if (phase3.empty()) {
 		auto const msg = __func__ + std::to_string(__LINE__);
 		tracer.set_result(msg);
 		throw std::invalid_argument(msg);
 	}
-	// Any source file shall be terminated by a newline character.
-	auto const terminated = phase2.back() == '\n' ? phase2 : phase2 + '\n'; // Extra line would be added if the last LF is escaped.
 
-	// -----------------------------------
-	// parses preprocessing tokens
-	tokens_t phase3;
-	for (auto s = terminated; ! s.empty();) {
-		// -----------------------------------
-		// replaces whilespaces, which just keep count of new lines.
-		if (auto const [rest, ws] = parse_whitespaces(s); ws) {
-			if (0u < ws->newlines()) {
-				if (phase3.empty() || ! std::holds_alternative<whitespace_t>(phase3.back())) {
-					phase3.emplace_back(*ws);
-					tracer.trace(std::to_string(__LINE__) + " " + std::to_string(ws->newlines()));
-				} else {
-					auto const sum = std::get<whitespace_t>(phase3.back()).appent(ws->newlines());
-					phase3.back()  = sum;
-					tracer.trace(std::to_string(__LINE__) + " " + std::to_string(sum.newlines()));
-				}
+	tracer.set_result(phase3.size());
+	return phase3;
+}
+///	@overload
+inline tokens_t
+scan(std::filesystem::path const& path, bool defers_text = false) {
+	prof::file_scope_t const profiled{path};
+	return scan(path, util::open_file(path), defers_text);
+}
+
+///	@brief	Scans directives of the file, i.e., the other lines are dropped before the phase 1.
+///		It is enough to find dependencies, and much faster than the full scan since the most lines are not tokenized.
+///	@param[in]	path	Path.
+///	@return		Parsed tokens of the directives, and newlines of the other lines.
+inline tokens_t
+scan_directives(std::filesystem::path const& path) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger, path};
+	prof::file_scope_t const profiled{path};
+	log::span_t const		 span{"Scan", path};
+
+	auto const file		 = util::open_file(path);
+	auto const minimized = prof::measure(prof::phase_t::minimize, file->view().size(), [&file] { return minimize_directives(file->view()); });
+	auto const escapes	 = prof::measure(prof::phase_t::decode, minimized.size(), [&minimized] { return simd::skip_basic(minimized) != minimized.size(); });
+	auto [text, splices] = splice_lines(escapes ? escape_non_basic_source_character_set(minimized) : minimized);
+	if (text.empty()) return {};
+	auto const tokens = tokenize(source_manager().add(path, std::move(text), std::move(splices)));
+	tracer.set_result(tokens.size());
+	return tokens;
+}
+
+///	@brief	Store of scanned files on a directory, which is shared by processes.
+///		Each entry is named by the hash of contents of the file, so that the same contents are scanned once even via other paths.
+///		An entry is a versioned binary image, which consists of a header, the splices, the columns of tokens, and the logical source.
+///		The tokens of a loaded entry refer into the mapped entry, so that loading costs a mapping and a validation instead of scanning.
+///		Entries are saved atomically, so that concurrent processes can share the directory.
+class token_store_t {
+public:
+	///	@brief	Version of the format, which shall be incremented if the format or the scanner changes.
+	static constexpr std::uint32_t const format_version = 1u;
+	///	@brief	Extension of the entries.
+	static constexpr std::string_view const extension = ".xcpt";
+
+	///	@brief	Gets the directory.
+	///	@return		The directory, or empty if the store is disabled.
+	auto const& directory() const noexcept { return directory_; }
+	///	@brief	Sets the directory, which shall be set before scanning.
+	///	@param[in]	directory	The directory, or empty to disable the store.
+	///	@throw	std::invalid_argument	The directory cannot be created.
+	void directory(std::filesystem::path const& directory) {
+		std::error_code error;
+		if (! directory.empty()) std::filesystem::create_directories(directory, error);
+		if (error) throw std::invalid_argument("token cache:" + directory.string());
+		directory_ = directory;
+	}
+
+	///	@brief	Scans the file, or loads its tokens from the store.
+	///		Entries of the deferred text lines are named apart from the others.
+	///	@param[in]	path		Path of the file.
+	///	@param[in]	defers_text	Whether text lines are deferred to be tokenized or not.
+	///	@return		Tokens of the file.
+	///	@throw	std::invalid_argument	The file cannot be scanned.
+	tokens_t scan(std::filesystem::path const& path, bool defers_text = false) const {
+		log::logger_t logger;
+		log::tracer_t tracer{logger, path};
+
+		if (directory_.empty()) return lex::scan(path, defers_text);
+		prof::file_scope_t const profiled{path};
+		prof::scope_t const		 scope{prof::phase_t::load}; // Entries are loaded and saved, while scanning is measured as its phases.
+
+		auto const file	 = util::open_file(path);
+		auto const bytes = file->bytes();
+		if (bytes.empty()) return lex::scan(path, file, defers_text);
+
+		auto const hash	 = util::hash64(bytes);
+		auto const entry = directory_ / (hex(hash) + (defers_text ? "-lazy" : "") + std::string{extension});
+		if (auto loaded = load(entry, path, hash, bytes.size())) {
+			tracer.set_result("hit");
+			return std::move(*loaded);
+		}
+		auto tokens = lex::scan(path, file, defers_text);
+		if (auto const image = save(tokens, hash, bytes.size()); ! image.empty()) {
+			try {
+				util::save_file(entry, image);
+			} catch (std::invalid_argument const& e) {
+				tracer.set_result("unsaved:", e.what()); // The store is just a cache.
 			}
-			s = rest;
-			continue;
 		}
+		return tokens;
+	}
 
-		// -----------------------------------
-		// parses preprocessing tokens.
-		auto const [rest, token] = parse_preprocessing_token(s);
-		phase3.emplace_back(token);
-		s = rest;
+	///	@brief	Serializes the tokens as an entry.
+	///	@param[in]	tokens	Tokens of a scanned file.
+	///	@param[in]	hash	Hash of contents of the file.
+	///	@param[in]	size	Size of contents of the file.
+	///	@return		Image of the entry, or empty if the tokens cannot be stored.
+	static std::string save(tokens_t const& tokens, std::uint64_t hash, std::uint64_t size) {
+		auto const first = tokens.next_preprocessing_token(0u);
+		if (first == tokens.size()) return {};
+		auto const source = std::get<preprocessing_token_t>(tokens[first]).source();
+		if (! source || tokens.str(first).data() != source->text().data() + tokens.columns().offsets[first]) return {};
+
+		auto const columns = tokens.columns();
+		auto const text	   = source->text();
+		auto const header  = header_t{{'X', 'C', 'P', 'T'}, format_version, hash, size, static_cast<std::uint32_t>(text.size()), static_cast<std::uint32_t>(source->splices().size()), static_cast<std::uint32_t>(tokens.size()), 0u};
+
+		std::string image;
+		image.reserve(sizeof(header) + source->splices().size() * sizeof(splice_t) + tokens.size() * 10u + text.size());
+		auto const write = [&image](auto const& span) { image.append(reinterpret_cast<char const*>(span.data()), span.size_bytes()); };
+		write(std::span{&header, 1u});
+		write(std::span{source->splices()});
+		write(columns.offsets);
+		write(columns.lengths);
+		write(columns.kinds);
+		write(columns.flags);
+		image.append(text);
+		return image;
 	}
-	if (phase3.empty()) {
-		auto const msg = __func__ + std::to_string(__LINE__);
-		tracer.set_result(msg);
-		throw std::invalid_argument(msg);
+	///	@brief	Loads the entry.
+	///	@param[in]	entry	Path of the entry.
+	///	@param[in]	path	Path of the file, which is the path of the source.
+	///	@param[in]	hash	Hash of contents of the file.
+	///	@param[in]	size	Size of contents of the file.
+	///	@return		Tokens of the file, or std::nullopt if the entry does not exist or is invalid.
+	static std::optional<tokens_t> load(std::filesystem::path const& entry, std::filesystem::path const& path, std::uint64_t hash, std::uint64_t size) {
+		std::error_code error;
+		if (! std::filesystem::is_regular_file(entry, error)) return std::nullopt;
+		try {
+			auto const buffer = util::open_file(entry);
+			auto const bytes  = buffer->bytes();
+
+			header_t header{};
+			if (bytes.size() < sizeof(header)) return std::nullopt;
+			std::memcpy(&header, bytes.data(), sizeof(header));
+			if (std::string_view{header.magic, sizeof(header.magic)} != "XCPT" || header.version != format_version || header.hash != hash || header.size != size) return std::nullopt;
+			auto const n = std::size_t{header.tokens};
+			if (bytes.size() != sizeof(header) + header.splices * sizeof(splice_t) + n * 10u + header.text) return std::nullopt;
+
+			auto const data = bytes.data() + sizeof(header);
+			if (reinterpret_cast<std::uintptr_t>(data) % alignof(std::uint32_t) != 0u) return std::nullopt;
+			splices_t splices(header.splices);
+			std::memcpy(splices.data(), data, header.splices * sizeof(splice_t));
+			auto const offsets = data + header.splices * sizeof(splice_t);
+			auto const lengths = offsets + n * sizeof(std::uint32_t);
+			auto const kinds   = lengths + n * sizeof(std::uint32_t);
+			auto const flags   = kinds + n;
+			auto const text	   = std::string_view{flags + n, header.text};
+			if (! text.ends_with('\n')) return std::nullopt;
+
+			tokens_t::columns_t const columns{
+				{reinterpret_cast<tokens_t::kind_t const*>(kinds), n},
+				{reinterpret_cast<std::uint8_t const*>(flags), n},
+				{reinterpret_cast<std::uint32_t const*>(offsets), n},
+				{reinterpret_cast<std::uint32_t const*>(lengths), n},
+			};
+			return tokens_t{columns, source_manager().add(path, buffer, text, std::move(splices))};
+		} catch (std::invalid_argument const&) {
+			return std::nullopt; // The entry is broken or removed by another process.
+		}
 	}
 
-	tracer.set_result(phase3.size());
-	return phase3;
+	///	@brief	Constructor.
+	///	@param[in]	directory	The directory, or empty to disable the store.
+	explicit token_store_t(std::filesystem::path const& directory = {}) : directory_{} { this->directory(directory); }
+
+private:
+	token_store_t(token_store_t const&) = delete;
+
+	///	@brief	Header of the entry.
+	struct header_t {
+		char		  magic[4]; ///< @brief	Magic number, which also detects other byte order.
+		std::uint32_t version;	///< @brief	Version of the format.
+		std::uint64_t hash;		///< @brief	Hash of contents of the file.
+		std::uint64_t size;		///< @brief	Size of contents of the file.
+		std::uint32_t text;		///< @brief	Size of the logical source.
+		std::uint32_t splices;	///< @brief	Number of the splices.
+		std::uint32_t tokens;	///< @brief	Number of the tokens.
+		std::uint32_t reserved; ///< @brief	Reserved.
+	};
+	static_assert(sizeof(header_t) == 40u && sizeof(splice_t) == 8u);
+
+	///	@brief	Formats the hash as hexadecimal digits.
+	static std::string hex(std::uint64_t hash) {
+		std::ostringstream oss;
+		oss << std::hex << std::setw(16) << std::setfill('0') << hash;
+		return oss.str();
+	}
+
+	std::filesystem::path directory_; ///< @brief	The directory.
+};
+
+///	@brief	Gets the token store of this process.
+///	@return	The token store, which is disabled unless its directory is set.
+inline token_store_t&
+token_store() {
+	static token_store_t store;
+	return store;
+}
+
+///	@brief	Shared pointer of immutable tokens.
+using tokens_ptr_t = std::shared_ptr<tokens_t const>;
+
+///	@brief	Cache of scanned files, which is shared by translation units on any threads.
+///		Entries are keyed by identity of the files, and validated by their size and modification time.
+///		The cache is partitioned into shards, and lookups share a lock of the shard, so that parallel hits do not contend.
+///		Entries which have not been used recently are evicted if the shard exceeds its budget.
+///		A clock hand sweeps the entries of the shard and evicts the first one which has not been used since its last pass, which approximates the least recent use in constant time.
+///	@note	Entries own the sources via their tokens, so that the budget counts the texts as well as the tokens.
+///		The source of an evicted entry is freed unless it is still in use, e.g., by a translation unit.
+///		Deferred text lines which are tokenized after the insertion are charged to the running size of the shard, and evicted from at the next insertion.
+class token_cache_t {
+public:
+	///	@brief	Number of shards.
+	static constexpr std::size_t const shard_count = 16u;
+	///	@brief	Default budget of memory.
+	static constexpr std::size_t const default_budget = 256u * 1024u * 1024u;
+	///	@brief	Scanner of files.
+	using scanner_t = tokens_t (*)(std::filesystem::path const& path);
+
+	///	@brief	Scans the file, or gets its tokens from the cache.
+	///	@param[in]	path	Path of the file.
+	///	@return		Tokens of the file.
+	///	@throw	std::invalid_argument	The file cannot be scanned.
+	tokens_ptr_t scan(std::filesystem::path const& path) {
+		log::logger_t logger;
+		log::tracer_t tracer{logger, path};
+
+		auto const stamp = util::file_stamp(path);
+		if (! stamp) return std::make_shared<tokens_t const>(scanner_(path));
+
+		auto& shard = shards_[util::file_id_hash_t{}(stamp->id) % shard_count];
+		{
+			std::shared_lock lock{shard.mutex};
+			if (auto const found = shard.entries.find(stamp->id); found != shard.entries.end() && (*found->second)->stamp == *stamp) {
+				auto const& entry = *found->second;
+				// The bit is stored only if it is cleared, so that parallel hits do not contend for the cache line.
+				if (! entry->referenced.load(std::memory_order_relaxed)) entry->referenced.store(true, std::memory_order_relaxed);
+				hits_.fetch_add(1u, std::memory_order_relaxed);
+				tracer.set_result("hit");
+				return entry->tokens;
+			}
+		}
+
+		// Scans the file without the lock, so that other files are not blocked.
+		auto const tokens = std::make_shared<tokens_t const>(scanner_(path));
+		auto const entry  = std::make_shared<entry_t>(*stamp, tokens);
+		misses_.fetch_add(1u, std::memory_order_relaxed);
+
+		std::unique_lock lock{shard.mutex};
+		if (auto const found = shard.entries.find(stamp->id); found != shard.entries.end()) erase(shard, found->second);
+		// The new entry is placed just behind the hand, so that the hand visits it last.
+		shard.entries.emplace(stamp->id, shard.ring.insert(shard.hand, entry));
+		shard.size.fetch_add(footprint(*tokens) + tokens->charge(&shard.size), std::memory_order_relaxed);
+		while (budget_ / shard_count < shard.size.load(std::memory_order_relaxed) && 1u < shard.ring.size()) evict(shard);
+		tracer.set_result("miss");
+		return tokens;
+	}
+
+	///	@brief	Gets the number of hits.
+	///	@return		Number of hits.
+	std::size_t hits() const noexcept { return hits_.load(std::memory_order_relaxed); }
+	///	@brief	Gets the number of misses.
+	///	@return		Number of misses.
+	std::size_t misses() const noexcept { return misses_.load(std::memory_order_relaxed); }
+	///	@brief	Gets the number of the cached files.
+	///	@return		Number of the cached files.
+	std::size_t size() const {
+		return std::accumulate(shards_.begin(), shards_.end(), std::size_t{}, [](auto size, auto const& shard) {
+			std::shared_lock lock{shard.mutex};
+			return size + shard.entries.size();
+		});
+	}
+
+	///	@brief	Constructor.
+	///	@param[in]	budget	Budget of memory.
+	///	@param[in]	scanner	Scanner of files, which scans them via the token store by default.
+	explicit token_cache_t(std::size_t budget = default_budget, scanner_t scanner = [](std::filesystem::path const& path) { return token_store().scan(path); }) : budget_{budget}, scanner_{scanner}, hits_{}, misses_{}, shards_{} {}
+	///	@brief	Destructor, which stops charging the shards since the tokens may outlive the cache.
+	~token_cache_t() {
+		for (auto& shard : shards_) {
+			for (auto const& entry : shard.ring) entry->tokens->charge(nullptr);
+		}
+	}
+
+private:
+	token_cache_t(token_cache_t const&) = delete;
+
+	///	@brief	Entry of the cache, which is immutable except its reference bit.
+	struct entry_t {
+		util::file_stamp_t const stamp;		 ///< @brief	Stamp of the file.
+		tokens_ptr_t const		 tokens;	 ///< @brief	Tokens of the file.
+		std::atomic<bool>		 referenced; ///< @brief	Whether the entry has been used since the last pass of the hand or not.
+
+		entry_t(util::file_stamp_t const& stamp, tokens_ptr_t const& tokens) : stamp{stamp}, tokens{tokens}, referenced{true} {}
+	};
+	///	@brief	Ring of entries, which is swept by the clock hand.
+	using ring_t = std::list<std::shared_ptr<entry_t>>;
+	///	@brief	Shard of the cache.
+	struct shard_t {
+		mutable std::shared_mutex													mutex;			  ///< @brief	Mutex.
+		std::unordered_map<util::file_id_t, ring_t::iterator, util::file_id_hash_t>	entries;		  ///< @brief	Entries, which refer into the ring.
+		ring_t																		ring;			  ///< @brief	Ring of the entries.
+		ring_t::iterator															hand{ring.end()}; ///< @brief	Clock hand, which points the next entry to visit.
+		std::atomic<std::size_t>													size{};			  ///< @brief	Running size of the entries, which is charged with their deferred text lines as well.
+	};
+
+	///	@brief	Erases the entry from the shard, and discharges its footprint.
+	///	@param[in,out]	shard	Shard.
+	///	@param[in]		entry	Entry in the ring.
+	static void erase(shard_t& shard, ring_t::iterator entry) {
+		auto const& tokens = *(*entry)->tokens;
+		shard.size.fetch_sub(footprint(tokens) + tokens.charge(nullptr), std::memory_order_relaxed);
+		if (shard.hand == entry) ++shard.hand;
+		shard.entries.erase((*entry)->stamp.id);
+		shard.ring.erase(entry);
+	}
+	///	@brief	Evicts the first entry which the hand finds unused since its last pass, and clears the reference bits of the passed ones.
+	///	@param[in,out]	shard	Shard, which shall not be empty.
+	static void evict(shard_t& shard) {
+		for (;; ++shard.hand) {
+			if (shard.hand == shard.ring.end()) shard.hand = shard.ring.begin();
+			if (! (*shard.hand)->referenced.exchange(false, std::memory_order_relaxed)) break;
+		}
+		erase(shard, shard.hand);
+	}
+
+	///	@brief	Gets footprint of the tokens, which are kinds, flags, offsets, lengths, and the texts which they refer into.
+	///		The tokenized deferred text lines are charged apart, since they grow after the insertion.
+	static std::size_t footprint(tokens_t const& tokens) noexcept { return sizeof(tokens_t) + tokens.size() * (sizeof(tokens_t::kind_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) * 2u) + tokens.text_size(); }
+
+	std::size_t const				 budget_;  ///< @brief	Budget of memory.
+	scanner_t const					 scanner_; ///< @brief	Scanner of files.
+	std::atomic<std::size_t>		 hits_;	   ///< @brief	Number of hits.
+	std::atomic<std::size_t>		 misses_;  ///< @brief	Number of misses.
+	std::array<shard_t, shard_count> shards_;  ///< @brief	Shards.
+};
+
+///	@brief	Gets the token cache of this process.
+///		Text lines are deferred to be tokenized, so that the lines excluded by the preprocessor are never tokenized.
+///	@return	The token cache.
+inline token_cache_t&
+token_cache() {
+	static token_cache_t cache{token_cache_t::default_budget, [](std::filesystem::path const& path) { return token_store().scan(path, true); }};
+	return cache;
+}
+
+///	@brief	Gets the cache of the directives scanned for dependencies in this process.
+///	@return	The cache of directives.
+inline token_cache_t&
+directive_cache() {
+	static token_cache_t cache{token_cache_t::default_budget, &scan_directives};
+	return cache;
 }
 
 } // namespace xcp::lex
@@ -7,6 +7,7 @@
 
 // Includes local headers.
 #include "lexer.hpp"
+#include "preprocessor.hpp"
 #include "utility.hpp"
 
 // Includes standard headers.
@@ -14,6 +15,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <clocale>
 #include <exception>
@@ -21,6 +23,7 @@
 #include <iostream>
 #include <ranges>
 #include <regex>
+#include <sstream>
 #include <string>
 #include <tuple>
 #include <vector>
@@ -62,6 +65,12 @@ static constexpr auto const Usage =
 	"[Options]\n"
 	" --help/-h :                Show this usage only\n"
 	" --version/-v :             Show program version only\n"
+	" --trace :                  Trace the processing unless it is removed at build time.\n"
+	" -j{jobs} :                 Process the files by the jobs in parallel (default: hardware threads).\n"
+	" --token-cache={dir} :      Share scanned files via the directory among invocations.\n"
+	" --scan-deps[={format}] :   Output dependencies of the files as make (default) or json only.\n"
+	" --time-report[={format}] : Report time of each phase as a table (default) or json.\n"
+	" --trace-out={file} :       Write spans of the files and the traced functions as Chrome trace events.\n"
 	" -D{macro_name} :           Define the macro.\n"
 	" -D{macro_name}={value} :   Define the macro with the value.\n"
 	" -l{library_name} :         Set the name of library.\n"
@@ -90,7 +99,7 @@ static auto const Unexpected			 = "Unexpected exception occurred."s;
 namespace impl {
 
 using arguments_t = std::vector<std::string_view>;					   ///< @brief Type of program arguments.
-using paths_t	  = std::unordered_set<std::filesystem::path>;		   ///< @brief Type of source file paths.
+using paths_t	  = std::vector<std::filesystem::path>;				   ///< @brief Type of source file paths in order of the arguments.
 using options_t	  = std::unordered_multimap<std::string, std::string>; ///< @brief Type of options.
 using messages_t  = std::unordered_set<std::string>;				   ///< @brief Type of error messages.
 
@@ -104,7 +113,7 @@ check_arguments(arguments_t const& args) {
 	messages_t const						   no_input_file_message		  = {msg::err::No_input_file};
 	messages_t const						   no_such_input_file_message	  = {msg::err::No_such_input_file};
 	std::unordered_set<std::string_view> const usage_options				  = {"-h", "--help", "-v", "--version"};
-	std::unordered_set<std::string_view> const valid_options				  = {"-h", "--help", "-v", "--version", "-D", "-l", "-I", "-L"};
+	std::unordered_set<std::string_view> const valid_options				  = {"-h", "--help", "-v", "--version", "--trace", "-j", "--token-cache", "--scan-deps", "--time-report", "--trace-out", "-D", "-l", "-I", "-L"};
 
 	// -----------------------------------
 	// This program does not support standard input pipe.
@@ -114,9 +123,10 @@ check_arguments(arguments_t const& args) {
 	// -----------------------------------
 	// Collects options.
 	auto const parse_option = [](std::string_view const& a) -> options_t::value_type {
-		// Format: --opt, -opt, --opt=value, -opt=value, --opt:value, -opt:value
-		std::regex const re{R"(^(--?[A-Za-z0-9_-]+)(?:[=:](.+))?$)"};
-		if (std::match_results<std::string_view::const_iterator> match; std::regex_match(std::ranges::cbegin(a), std::ranges::cend(a), match, re)) {
+		// Format: --opt, --opt=value, --opt:value, -o, -ovalue, -o=value, -o:value
+		std::regex const long_re{R"(^(--[A-Za-z0-9_-]+)(?:[=:](.+))?$)"};
+		std::regex const short_re{R"(^(-[A-Za-z])[=:]?(.*)$)"};
+		if (std::match_results<std::string_view::const_iterator> match; std::regex_match(std::ranges::cbegin(a), std::ranges::cend(a), match, long_re) || std::regex_match(std::ranges::cbegin(a), std::ranges::cend(a), match, short_re)) {
 			return (2 < match.size()) //
 					 ? std::make_pair(std::string{match.str(1)}, std::string{match.str(2)})
 					 : std::make_pair(std::string{match.str(1)}, std::string{});
@@ -130,6 +140,10 @@ check_arguments(arguments_t const& args) {
 	auto const_ unknown_options		  = options | std::views::filter([&valid_options](auto const& a) { return ! valid_options.contains(a.first); }) | std::views::common;
 	auto const	invalid_option_errors = util::empty(invalid_options) ? success : util::to<messages_t>(invalid_options | std::views::transform([](auto const& a) { return msg::err::Invalid_option + a.second; }) | std::views::common);
 	auto const	unknown_option_errors = util::empty(unknown_options) ? success : util::to<messages_t>(unknown_options | std::views::transform([](auto const& a) { return msg::err::Invalid_option + a.first; }) | std::views::common);
+	auto const_ invalid_jobs		  = options | std::views::filter([](auto const& a) { return a.first == "-j" && ! a.second.empty() && ! std::regex_match(a.second, std::regex{"^[1-9][0-9]{0,3}$"}); }) | std::views::common;
+	auto const	invalid_job_errors	  = util::empty(invalid_jobs) ? success : util::to<messages_t>(invalid_jobs | std::views::transform([](auto const& a) { return msg::err::Invalid_option + a.first + a.second; }) | std::views::common);
+	auto const_ invalid_caches		  = options | std::views::filter([](auto const& a) { return ((a.first == "--token-cache" || a.first == "--trace-out") && a.second.empty()) || (a.first == "--scan-deps" && ! a.second.empty() && a.second != "make" && a.second != "json") || (a.first == "--time-report" && ! a.second.empty() && a.second != "table" && a.second != "json"); }) | std::views::common;
+	auto const	invalid_cache_errors  = util::empty(invalid_caches) ? success : util::to<messages_t>(invalid_caches | std::views::transform([](auto const& a) { return msg::err::Invalid_option + a.first + a.second; }) | std::views::common);
 	auto const	show_only			  = ! util::empty(options | std::views::filter([&usage_options](auto const& a) { return usage_options.contains(a.first); }) | std::views::common);
 	// TODO: option_errors
 
@@ -145,7 +159,7 @@ check_arguments(arguments_t const& args) {
 
 	// -----------------------------------
 	// Collects errors.
-	auto const nested_errors = std::vector{pipe_errors, invalid_option_errors, unknown_option_errors, source_errors};
+	auto const nested_errors = std::vector{pipe_errors, invalid_option_errors, unknown_option_errors, invalid_job_errors, invalid_cache_errors, source_errors};
 	auto const errors		 = nested_errors | std::views::join | std::views::common;
 	auto const result		 = show_only //
 								 ? 1
@@ -156,6 +170,118 @@ check_arguments(arguments_t const& args) {
 	return std::make_tuple(result, util::to<options_t>(options), util::to<paths_t>(sources), util::to<messages_t>(errors));
 }
 
+/// @brief	Gets number of concurrent jobs.
+/// @param[in]	options		Checked options.
+/// @return		Number of concurrent jobs.
+std::size_t
+get_jobs(options_t const& options) {
+	auto const jobs = options.find("-j");
+	return (jobs == options.end() || jobs->second.empty()) ? util::default_jobs() : std::stoul(jobs->second);
+}
+
+/// @brief	Scans the files in parallel.
+///		Logs and errors of each file are buffered, and then they are output in order of the files.
+/// @param[in]	paths	Paths of the files.
+/// @param[in]	jobs	Number of concurrent jobs.
+/// @return		Whether all the files are scanned successfully or not.
+bool
+scan_files(paths_t const& paths, std::size_t jobs) {
+	std::vector<std::string> outputs(paths.size());
+	std::atomic<bool>		 succeeded{true};
+	util::parallel_for(paths.size(), jobs, [&paths, &outputs, &succeeded](std::size_t i) {
+		std::ostringstream oss;
+		try {
+			log::scoped_output_t const output{oss}; // Logs are written to the stream at the end of the scope.
+			auto const				   tokens = xcp::lex::token_store().scan(paths[i]);
+			// TODO:
+		} catch (std::exception const& e) {
+			oss << paths[i].string() << ": " << e.what() << std::endl;
+			succeeded = false;
+		}
+		outputs[i] = std::move(oss).str();
+	});
+	std::ranges::for_each(outputs, [](auto const& a) { std::clog << a; });
+	return succeeded;
+}
+
+/// @brief	Converts the options of this program to the options of the preprocessor.
+/// @param[in]	options		Checked options.
+/// @return		Options of the preprocessor, e.g., -I and -D.
+opt::options_t
+get_preprocessor_options(options_t const& options) {
+	opt::options_t converted;
+	for (auto const& [key, value] : options) {
+		if (key == "-I" || key == "-D") converted[key.substr(1u)].push_back(value);
+	}
+	return converted;
+}
+
+/// @brief	Escapes the path as a target or a prerequisite of make.
+/// @param[in]	path	Path.
+/// @return		Escaped path.
+std::string
+escape_make(std::filesystem::path const& path) {
+	std::string escaped;
+	for (auto const ch : path.string()) {
+		if (ch == '$') {
+			escaped += '$';
+		} else if (ch == ' ' || ch == '#') {
+			escaped += '\\';
+		}
+		escaped += ch;
+	}
+	return escaped;
+}
+
+/// @brief	Scans dependencies of the files in parallel, and outputs them in order of the files.
+///		Only directives are scanned, so that it is much faster than preprocessing.
+/// @param[in]	paths	Paths of the files.
+/// @param[in]	jobs	Number of concurrent jobs.
+/// @param[in]	options	Checked options.
+/// @param[in]	json	Whether the dependencies are output as JSON or make rules.
+/// @return		Whether all the files are scanned successfully or not.
+bool
+scan_dependencies(paths_t const& paths, std::size_t jobs, options_t const& options, bool json) {
+	std::vector<std::string> outputs(paths.size()), logs(paths.size());
+	std::atomic<bool>		 succeeded{true};
+	auto const				 preprocessor_options = get_preprocessor_options(options);
+	util::parallel_for(paths.size(), jobs, [&](std::size_t i) {
+		std::ostringstream oss;
+		try {
+			log::scoped_output_t const output{oss}; // Logs are written to the stream at the end of the scope.
+			xcp::cpp::context_t		   context{preprocessor_options};
+			auto const			dependencies = xcp::cpp::scan_dependencies(paths[i], context);
+			auto const			target		 = std::filesystem::path{paths[i]}.filename().replace_extension(".o");
+
+			std::ostringstream rule;
+			if (json) {
+				rule << "{\"source\":" << util::quote_json(paths[i].string()) << ",\"target\":" << util::quote_json(target.string()) << ",\"dependencies\":[";
+				for (auto const& dependency : dependencies) rule << (&dependency == &dependencies.front() ? "" : ",") << util::quote_json(dependency.string());
+				rule << "]}";
+			} else {
+				rule << escape_make(target) << ":";
+				for (auto const& dependency : dependencies) rule << " \\\n  " << escape_make(dependency);
+				rule << "\n";
+			}
+			outputs[i] = std::move(rule).str();
+		} catch (std::exception const& e) {
+			oss << paths[i].string() << ": " << e.what() << std::endl;
+			succeeded = false;
+		}
+		logs[i] = std::move(oss).str();
+	});
+	std::ranges::for_each(logs, [](auto const& a) { std::clog << a; });
+
+	if (json) std::cout << "[";
+	for (std::size_t i{}, n{}; i < outputs.size(); ++i) {
+		if (outputs[i].empty()) continue;
+		std::cout << (json && 0u < n++ ? ",\n" : "") << outputs[i];
+	}
+	if (json) std::cout << "]\n";
+	std::cout << std::flush;
+	return succeeded;
+}
+
 } // namespace impl
 } // namespace xxx
 
@@ -196,7 +322,8 @@ main(int ac, char* av[]) {
 		initialize_primitives();
 
 		// -----------------------------------
-		// Initializes logger.
+		// Initializes logger, whose messages are written asynchronously until the end of processing.
+		xxx::log::backend().open();
 		xxx::log::logger_t logger;
 		xxx::log::tracer_t tracer{logger};
 
@@ -217,17 +344,33 @@ main(int ac, char* av[]) {
 			}
 			return result;
 		}
+		if (options.contains("--trace")) xxx::log::threshold() = 0u;
+		if (auto const cache = options.find("--token-cache"); cache != options.end()) xxx::xcp::lex::token_store().directory(cache->second);
+		if (auto const trace = options.find("--trace-out"); trace != options.end()) xxx::log::trace_writer().open(trace->second);
 
 		// -----------------------------------
 		{
 			auto const started = std::chrono::steady_clock::now();
 
-			// TODO:
-			std::ranges::for_each(paths, [](auto const& a) { auto const tokens = xxx::xcp::lex::scan(a); });
-			// TODO:
+			auto const scan_deps = options.find("--scan-deps");
+			auto const succeeded = scan_deps != options.end()
+									 ? xxx::impl::scan_dependencies(paths, xxx::impl::get_jobs(options), options, scan_deps->second == "json")
+									 : xxx::impl::scan_files(paths, xxx::impl::get_jobs(options));
 
 			auto const ended = std::chrono::steady_clock::now();
+			xxx::log::trace_writer().close();
+			xxx::log::backend().close();
+			// Workers have exited, so that their counters have been merged.
+			if (auto const report = options.find("--time-report"); report != options.end()) {
+				auto const profile = xxx::prof::collect();
+				if (report->second == "json") {
+					xxx::prof::write_json(std::clog, profile);
+				} else {
+					xxx::prof::write_table(std::clog, profile);
+				}
+			}
 			std::clog << xxx::msg::Completed << ":" << std::chrono::duration_cast<std::chrono::milliseconds>(ended - started).count() << "ms." << std::endl;
+			if (! succeeded) return -1;
 		}
 		return 0;
 
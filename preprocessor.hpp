@@ -14,13 +14,31 @@
 
 #include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <charconv>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
 #include <ranges>
 #include <regex>
+#include <shared_mutex>
+#include <span>
 #include <sstream>
 #include <stack>
 #include <string>
+#include <system_error>
 #include <tuple>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -48,284 +66,1690 @@ parse_options(std::vector<std::string_view> const& options) {
 // ================================================================================
 namespace xxx::xcp::cpp {
 
-class context_t {
+///	@brief	State of a conditional group, i.e., from #if, #ifdef, or #ifndef to #endif.
+struct condition_t {
+	bool enclosing; ///< @brief	Whether the enclosing group is active or not.
+	bool active;	///< @brief	Whether the current group is active or not.
+	bool taken;		///< @brief	Whether any group has been taken or not.
+	bool closed;	///< @brief	Whether #else has appeared or not.
+};
+
+///	@brief	Table of macros, which is copied in constant time.
+///		The macros are partitioned into shards, and each shard is shared among the copies of the table until it is modified.
+///		Therefore, a modification after copying the table copies only the shard of the macro.
+///	@tparam	Macro	Type of macro definition.
+template<typename Macro>
+class macro_table_t {
 public:
-	using macros_t = std::unordered_map<std::string, std::pair<lex::preprocessing_token_t, lex::preprocessing_token_t>>;
-	using file_t   = std::pair<std::filesystem::path, lex::tokens_t>;
+	using key_type	  = std::string; ///< @brief	Type of name of macro.
+	using mapped_type = Macro;		 ///< @brief	Type of macro definition.
+
+	///	@brief	Number of shards.
+	static constexpr std::size_t const shard_count = 64u;
+
+	///	@brief	Gets the number of macros.
+	///	@return		Number of macros.
+	std::size_t size() const noexcept { return size_; }
+	///	@brief	Determines whether the table is empty or not.
+	///	@return		It returns true if no macros are defined; otherwise, it returns false.
+	bool empty() const noexcept { return size_ == 0u; }
+	///	@brief	Determines whether the macro is defined or not.
+	///	@param[in]	name	Name of macro.
+	///	@return		It returns true if the macro is defined; otherwise, it returns false.
+	bool contains(std::string_view const& name) const { return find(name) != nullptr; }
+	///	@brief	Finds the macro.
+	///	@param[in]	name	Name of macro.
+	///	@return		Definition of the macro, or nullptr if not found.
+	mapped_type const* find(std::string_view const& name) const {
+		auto const& shard = shards_[shard_of(name)];
+		if (! shard) return nullptr;
+		auto const found = shard->find(name);
+		return found == shard->end() ? nullptr : &found->second;
+	}
+	///	@brief	Defines the macro, or redefines it if already defined.
+	///	@param[in]	name	Name of macro.
+	///	@param[in]	macro	Definition of the macro.
+	void insert_or_assign(std::string_view const& name, mapped_type macro) {
+		auto& shard = modifiable(shard_of(name));
+		if (auto const found = shard.find(name); found != shard.end()) {
+			found->second = std::move(macro);
+		} else {
+			shard.emplace(name, std::move(macro));
+			++size_;
+		}
+	}
+	///	@brief	Undefines the macro.
+	///	@param[in]	name	Name of macro.
+	///	@return		It returns true if the macro has been defined; otherwise, it returns false.
+	bool erase(std::string_view const& name) {
+		auto const index = shard_of(name);
+		if (! shards_[index] || ! shards_[index]->contains(name)) return false;
+		auto& shard = modifiable(index);
+		shard.erase(shard.find(name));
+		--size_;
+		return true;
+	}
+	///	@brief	Visits all the macros in unspecified order.
+	///	@param[in]	f	Function to receive the name and definition of each macro.
+	template<typename F>
+	void for_each(F&& f) const {
+		for (auto const& shard : shards_) {
+			if (! shard) continue;
+			for (auto const& [name, macro] : *shard) f(name, macro);
+		}
+	}
 
-	explicit context_t(opt::options_t const& options) : options_{options}, sources_{}, conditions_{}, includes_{}, macros_{} {
-		macros_["__cplusplus"] = std::make_pair(lex::preprocessing_token_t{}, lex::preprocessing_token_t{"201103L"});
-		macros_["_XCP_VER"]	   = std::make_pair(lex::preprocessing_token_t{}, lex::preprocessing_token_t{"0x00020000"});
+private:
+	///	@brief	Hash of name of macro, which supports heterogeneous lookup.
+	struct hash_t {
+		using is_transparent = void;
+		std::size_t operator()(std::string_view const& str) const noexcept { return std::hash<std::string_view>{}(str); }
+	};
+	using shard_t = std::unordered_map<key_type, mapped_type, hash_t, std::equal_to<>>; ///< @brief	Type of shard.
+
+	///	@brief	Gets index of the shard of the name.
+	static std::size_t shard_of(std::string_view const& name) noexcept { return hash_t{}(name) % shard_count; }
+	///	@brief	Gets the shard to modify, which is copied if it is shared with other tables.
+	shard_t& modifiable(std::size_t index) {
+		auto& shard = shards_[index];
+		if (! shard) {
+			shard = std::make_shared<shard_t>();
+		} else if (shard.use_count() != 1) {
+			shard = std::make_shared<shard_t>(*shard);
+		} else {
+			// The other tables may have released the shard on other threads.
+			std::atomic_thread_fence(std::memory_order_acquire);
+		}
+		return const_cast<shard_t&>(*shard);
+	}
+
+	std::array<std::shared_ptr<shard_t const>, shard_count> shards_; ///< @brief	Shards, which are immutable while shared.
+	std::size_t												 size_{};  ///< @brief	Number of macros.
+};
+
+///	@brief	Macro, whose replacement list has been parsed at its definition.
+///		Parameters in the replacement list have been resolved to their indices, so that substitution copies tokens only.
+struct macro_t {
+	///	@brief	Operation of element in the replacement list.
+	enum class op_t : std::uint8_t {
+		token,		   ///< @brief	Token as is.
+		parameter,	   ///< @brief	Parameter, which is replaced by the macro-expanded argument.
+		raw_parameter, ///< @brief	Parameter, which is replaced by the argument as is, i.e., an operand of ##.
+		stringize,	   ///< @brief	Parameter, which is replaced by the stringized argument, i.e., an operand of #.
+		paste,		   ///< @brief	Concatenation of the adjacent elements, i.e., ##.
+		va_opt,		   ///< @brief	__VA_OPT__, whose content is the following elements of the number of the index.
+	};
+	///	@brief	Element in the replacement list.
+	struct element_t {
+		op_t					   op;	  ///< @brief	Operation.
+		std::uint32_t			   index; ///< @brief	Index of the parameter, or number of elements in the __VA_OPT__.
+		lex::preprocessing_token_t token; ///< @brief	Token in the replacement list.
+	};
+	///	@brief	Replacement list.
+	using elements_t = std::pmr::vector<element_t>;
+
+	lex::preprocessing_token_t name;		  ///< @brief	Name of the macro.
+	bool					   function_like; ///< @brief	Whether the macro is function-like or object-like.
+	bool					   variadic;	  ///< @brief	Whether the last parameter is __VA_ARGS__ or not.
+	std::uint32_t			   parameters;	  ///< @brief	Number of the parameters including __VA_ARGS__.
+	elements_t				   replacement;	  ///< @brief	Replacement list.
+};
+
+///	@brief	Arena of macros, which is shared by copies of a context.
+///		Macros are never freed until the arena is destroyed, so that the macro table refers to them by pointers.
+///		The arena also keeps the sources which the macros refer into, even if their tokens have been evicted from the cache.
+class macro_arena_t {
+public:
+	///	@brief	Creates a macro in the arena.
+	///	@param[in]	name			Name of the macro.
+	///	@param[in]	function_like	Whether the macro is function-like or object-like.
+	///	@param[in]	variadic		Whether the last parameter is __VA_ARGS__ or not.
+	///	@param[in]	parameters		Number of the parameters including __VA_ARGS__.
+	///	@param[in]	replacement		Replacement list.
+	///	@return		Created macro, which lives as long as the arena.
+	macro_t const* make(lex::preprocessing_token_t const& name, bool function_like, bool variadic, std::uint32_t parameters, std::span<macro_t::element_t const> replacement) {
+		std::lock_guard							 lock{mutex_};
+		std::pmr::polymorphic_allocator<macro_t> allocator{&resource_};
+		if (auto const source = name.source(); source && (sources_.empty() || sources_.back().get() != source)) sources_.push_back(source->shared_from_this());
+		return allocator.new_object<macro_t>(macro_t{name, function_like, variadic, parameters, macro_t::elements_t(replacement.begin(), replacement.end(), &resource_)});
+	}
+
+	///	@brief	Constructor.
+	macro_arena_t() : mutex_{}, resource_{}, sources_{} {}
+
+private:
+	macro_arena_t(macro_arena_t const&) = delete;
+
+	std::mutex							mutex_;	   ///< @brief	Mutex, because contexts on other threads may share the arena.
+	std::pmr::monotonic_buffer_resource resource_; ///< @brief	Memory resource.
+	std::vector<lex::source_ptr_t>		sources_;  ///< @brief	Sources which the macros refer into.
+};
+
+class context_t {
+public:
+	using macros_t = macro_table_t<macro_t const*>;
+	using file_t   = std::pair<std::filesystem::path, lex::tokens_ptr_t>;
+
+	using once_t   = std::unordered_set<util::file_id_t, util::file_id_hash_t>;
+	using dependencies_t = std::vector<std::filesystem::path>;
+
+	explicit context_t(opt::options_t const& options) : options_{options}, sources_{}, conditions_{}, includes_{}, once_{}, arena_{std::make_shared<macro_arena_t>()}, macros_{}, directives_only_{}, dependencies_{}, entered_{} {
+		if (auto const found = options_.find("I"); found != options_.end()) includes_.assign(found->second.begin(), found->second.end());
+		predefine("__cplusplus", "201103L");
+		predefine("_XCP_VER", "0x00020000");
+		if (auto const found = options_.find("D"); found != options_.end()) {
+			for (auto const& definition : found->second) {
+				auto const equal = definition.find('=');
+				predefine(definition.substr(0u, equal), equal == std::string::npos ? "1" : definition.substr(equal + 1u));
+			}
+		}
 	}
 	context_t() : context_t(opt::options_t{}) {}
 	auto&		conditions() noexcept { return conditions_; }
 	auto const& conditions() const noexcept { return conditions_; }
+	auto&		sources() noexcept { return sources_; }
+	auto const& sources() const noexcept { return sources_; }
+	auto const& includes() const noexcept { return includes_; }
+	auto&		once() noexcept { return once_; }
+	auto const& once() const noexcept { return once_; }
+	auto&		arena() noexcept { return *arena_; }
 	auto&		macros() noexcept { return macros_; }
 	auto const& macros() const noexcept { return macros_; }
+	auto&		directives_only() noexcept { return directives_only_; }
+	auto		directives_only() const noexcept { return directives_only_; }
+	auto const& dependencies() const noexcept { return dependencies_; }
+
+	///	@brief	Records the file as a dependency unless it has been recorded.
+	///	@param[in]	path	Path of the file.
+	void depend(std::filesystem::path const& path) {
+		if (entered_.insert(path.lexically_normal().string()).second) dependencies_.push_back(path);
+	}
+
+private:
+	///	@brief	Predefines an object-like macro.
+	///	@param[in]	name	Name of the macro.
+	///	@param[in]	value	Replacement list of the macro.
+	///	@throw	std::invalid_argument	The @p name is not an identifier.
+	void predefine(std::string_view const& name, std::string_view const& value) {
+		auto const identifier = lex::source_manager().intern(name);
+		if (identifier.empty() || std::get<0>(lex::scan_preprocessing_token(identifier)) != identifier.size() || std::get<1>(lex::scan_preprocessing_token(identifier)) != lex::preprocessing_token_type_t::identifier) throw std::invalid_argument("invalid macro name:" + std::string{name});
+		auto const tokens = lex::tokenize(lex::source_manager().intern(std::string{value} + "\n"));
+
+		macro_t::elements_t replacement;
+		for (std::size_t i{}; i < tokens.size(); ++i) {
+			if (! tokens.is_whitespace(i)) replacement.push_back({macro_t::op_t::token, 0u, std::get<lex::preprocessing_token_t>(tokens[i])});
+		}
+		macros_.insert_or_assign(identifier, arena_->make(lex::preprocessing_token_t{identifier, lex::preprocessing_token_type_t::identifier}, false, false, 0u, replacement));
+	}
 
 private:
 	// TODO: tokens, current, consumed
 	opt::options_t					   options_;
 	std::stack<file_t>				   sources_;
-	std::stack<bool>				   conditions_;
+	std::stack<condition_t>			   conditions_;
 	std::vector<std::filesystem::path> includes_;
+	once_t							   once_; ///< @brief	Files which have been included with #pragma once.
+	std::shared_ptr<macro_arena_t>	   arena_;
 	macros_t						   macros_;
+	bool							   directives_only_; ///< @brief	Whether only directives are scanned, e.g., to find dependencies.
+	dependencies_t					   dependencies_;	 ///< @brief	Files which have been entered in order.
+	std::unordered_set<std::string>	   entered_;		 ///< @brief	Normalized paths of the dependencies.
 }; // namespace xcp::cpp
 
-inline auto
-next_preprocessing_token(lex::tokens_t const& tokens, lex::tokens_t::const_iterator const& current) {
-	if (current == tokens.cend()) return tokens.cend();
-	auto itr = current + 1;
-	for (auto const end = tokens.cend(); itr != end; ++itr) {
-		if (std::holds_alternative<lex::preprocessing_token_t>(*itr)) break;
-	}
-	return itr;
-}
-inline auto
-next_newline(lex::tokens_t const& tokens, lex::tokens_t::const_iterator const& current) {
-	if (current == tokens.cend()) return tokens.cend();
-	auto itr = current + 1;
-	for (auto const end = tokens.cend(); itr != end; ++itr) {
-		if (auto const ws = std::get_if<lex::whitespace_t>(&*itr); ws && 0u < ws->newlines()) {
-			break;
-		}
-	}
-	return itr;
+///	@brief	Kind of directive.
+enum class directive_kind_t : std::uint8_t {
+	non_directive, ///< @brief	Text line, which is not a directive.
+	null,		   ///< @brief	Null directive (#).
+	if_,		   ///< @brief	#if
+	ifdef,		   ///< @brief	#ifdef
+	ifndef,		   ///< @brief	#ifndef
+	elif,		   ///< @brief	#elif
+	else_,		   ///< @brief	#else
+	endif,		   ///< @brief	#endif
+	include,	   ///< @brief	#include
+	define,		   ///< @brief	#define
+	undef,		   ///< @brief	#undef
+	line,		   ///< @brief	#line
+	error,		   ///< @brief	#error
+	pragma,		   ///< @brief	#pragma
+	unknown,	   ///< @brief	Unknown directive.
+};
+
+///	@brief	Names of the directives.
+constexpr std::array<std::pair<std::string_view, directive_kind_t>, 12u> const directive_names{{
+	{"if", directive_kind_t::if_},
+	{"ifdef", directive_kind_t::ifdef},
+	{"ifndef", directive_kind_t::ifndef},
+	{"elif", directive_kind_t::elif},
+	{"else", directive_kind_t::else_},
+	{"endif", directive_kind_t::endif},
+	{"include", directive_kind_t::include},
+	{"define", directive_kind_t::define},
+	{"undef", directive_kind_t::undef},
+	{"line", directive_kind_t::line},
+	{"error", directive_kind_t::error},
+	{"pragma", directive_kind_t::pragma},
+}};
+
+///	@brief	Size of the hash table of the directive names.
+constexpr std::size_t const directive_table_size = 32u;
+
+///	@brief	Hashes name of directive.
+///	@param[in]	name	Name of directive, which shall not be empty.
+///	@param[in]	seed	Seed of the hash.
+///	@return		Hash of the @p name.
+constexpr inline std::size_t
+hash_directive_name(std::string_view const& name, std::size_t seed) noexcept {
+	return ((static_cast<unsigned char>(name.front()) + static_cast<unsigned char>(name.back()) * seed) ^ name.size()) % directive_table_size;
 }
 
-inline std::optional<bool>
-evaluate(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
-	return true; // TODO: not implemented yet.
+///	@brief	Seed of the perfect hash of the directive names, which is searched at compile time.
+constexpr std::size_t const directive_hash_seed = [] {
+	for (std::size_t seed = 1u; seed < 1000u; ++seed) {
+		std::array<bool, directive_table_size> used{};
+		auto const perfect = std::ranges::all_of(directive_names, [&used, seed](auto const& a) { return ! std::exchange(used[hash_directive_name(a.first, seed)], true); });
+		if (perfect) return seed;
+	}
+	return std::size_t{};
+}();
+static_assert(directive_hash_seed != 0u, "no perfect hash of the directive names");
+
+///	@brief	Hash table of the directive names.
+constexpr std::array<std::pair<std::string_view, directive_kind_t>, directive_table_size> const directive_table = [] {
+	std::array<std::pair<std::string_view, directive_kind_t>, directive_table_size> table{};
+	for (auto const& a : directive_names) table[hash_directive_name(a.first, directive_hash_seed)] = a;
+	return table;
+}();
+
+///	@brief	Finds kind of the directive by its name.
+///	@param[in]	name	Name of the directive.
+///	@return		Kind of the directive.
+constexpr inline directive_kind_t
+find_directive_kind(std::string_view const& name) noexcept {
+	if (name.empty()) return directive_kind_t::null;
+	auto const& [found, kind] = directive_table[hash_directive_name(name, directive_hash_seed)];
+	return found == name ? kind : directive_kind_t::unknown;
+}
+static_assert(std::ranges::all_of(directive_names, [](auto const& a) { return find_directive_kind(a.first) == a.second; }));
+
+///	@brief	Directive classified from a line.
+struct directive_t {
+	directive_kind_t			  kind;	 ///< @brief	Kind of the directive.
+	lex::tokens_t::const_iterator name;	 ///< @brief	Name of the directive, or the first token of the line.
+	lex::tokens_t::const_iterator first; ///< @brief	The first of the operands.
+	lex::tokens_t::const_iterator last;	 ///< @brief	The last of the operands, which is the newline of the line if exists.
+};
+
+///	@brief	Classifies the line as a directive.
+///		A text line is rejected by its first token only.
+///	@param[in]	tokens	Tokens.
+///	@param[in]	first	Index of the first token of the line.
+///	@param[in]	last	Index next to the last token of the line.
+///	@return		Classified directive.
+inline directive_t
+classify_directive(lex::tokens_t const& tokens, std::size_t first, std::size_t last) {
+	using enum directive_kind_t;
+	auto const begin = tokens.cbegin();
+	if (last <= first || tokens.is_whitespace(first) || (tokens.str(first) != "#" && tokens.str(first) != "%:")) return {non_directive, begin + first, begin + first, begin + last};
+
+	// Whitespaces in a line have been dropped, so that the name just follows the pound.
+	auto const end = tokens.is_whitespace(last - 1u) ? last - 1u : last;
+	if (end <= first + 1u) return {null, begin + first, begin + end, begin + end};
+	auto const kind = tokens.type(first + 1u) == lex::preprocessing_token_type_t::identifier ? find_directive_kind(tokens.str(first + 1u)) : unknown;
+	return {kind, begin + first + 1u, begin + first + 2u, begin + end};
 }
 
-inline std::tuple<bool, lex::tokens_t>
-parse_define_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
+///	@brief	Gets the operands as a string.
+///	@param[in]	directive	Directive.
+///	@return		Operands separated by a space.
+inline std::string
+operands_string(directive_t const& directive) {
+	std::string str;
+	for (auto i = directive.first; i != directive.last; ++i) {
+		if (auto const token = *i; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(str.empty() ? "" : " ").append(pp->str());
+	}
+	return str;
+}
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+///	@brief	Determines whether the tokens are adjacent without any whitespace or not.
+///	@param[in]	lhs		Preceding token.
+///	@param[in]	rhs		Following token.
+///	@return		It returns true if the @p rhs just follows the @p lhs in the same text; otherwise, it returns false.
+inline bool
+is_adjacent(lex::preprocessing_token_t const& lhs, lex::preprocessing_token_t const& rhs) noexcept {
+	return lhs.str().data() + lhs.str().size() == rhs.str().data();
+}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "define") return {false, tokens};
+///	@brief	Gets the only identifier of the operands.
+///	@param[in]	directive	Directive.
+///	@return		The identifier.
+///	@throw	std::invalid_argument	The operands are not an identifier.
+inline lex::preprocessing_token_t
+identifier_operand(directive_t const& directive) {
+	auto const token = directive.first == directive.last ? lex::token_t{} : *directive.first;
+	auto const pp	 = std::get_if<lex::preprocessing_token_t>(&token);
+	if (! pp || pp->type() != lex::preprocessing_token_type_t::identifier) throw std::invalid_argument("identifier is required:" + std::string{std::get<lex::preprocessing_token_t>(*directive.name).str()});
+	return *pp;
+}
 
-	// TODO:
+///	@brief	Expander of macros, which follows the hide-set algorithm by Dave Prosser.
+///		Hide sets and intermediate tokens are allocated in an arena, which lives as long as the expander.
+class expander_t {
+public:
+	///	@brief	Expands macros in the text lines, and appends the result.
+	///		Newlines in an invocation of macro are appended after the expansion, so that the following lines are not shifted.
+	///	@param[in]	tokens	Tokens.
+	///	@param[in]	first	Index of the first token of the text lines.
+	///	@param[in]	last	Index next to the last token of the text lines.
+	///	@param[out]	output	Tokens to append the result.
+	///	@throw	std::invalid_argument	An invocation of macro is invalid.
+	void expand(lex::tokens_t const& tokens, std::size_t first, std::size_t last, lex::tokens_t& output) {
+		input_t input{tokens_t{&resource_}, &tokens, first, last, 0u};
+		auto const emit = [&output](token_t const& token) { output.push_back(token.token); };
+		for (auto replaced = false;;) {
+			if (input.pending.empty()) {
+				// Nothing in the arena is alive between invocations, so that the arena is recycled for the next one.
+				if (std::exchange(replaced, false)) recycle(input);
+				if (0u < input.newlines) output.push_back(lex::whitespace_t{std::exchange(input.newlines, 0u)});
+				if (input.cursor == input.last) break;
+				// Tokens of the source are appended directly unless they are macros.
+				if (tokens.is_whitespace(input.cursor) || ! find(tokens.type(input.cursor), tokens.str(input.cursor))) {
+					output.append(tokens.cbegin() + input.cursor, tokens.cbegin() + input.cursor + 1);
+					++input.cursor;
+					continue;
+				}
+			}
+			replace(*next(input), input, emit);
+			replaced = true;
+		}
+	}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+	///	@brief	Determines whether the text lines include any macro or not.
+	///	@param[in]	tokens	Tokens.
+	///	@param[in]	first	Index of the first token of the text lines.
+	///	@param[in]	last	Index next to the last token of the text lines.
+	///	@return		It returns true if any identifier is a macro; otherwise, it returns false.
+	bool includes_macro(lex::tokens_t const& tokens, std::size_t first, std::size_t last) const {
+		for (auto i = first; i < last; ++i) {
+			if (! tokens.is_whitespace(i) && find(tokens.type(i), tokens.str(i))) return true;
+		}
+		return false;
+	}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
-}
-inline std::tuple<bool, lex::tokens_t>
-parse_undef_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
+	///	@brief	Constructor.
+	///	@param[in]	macros	Macros.
+	explicit expander_t(context_t::macros_t const& macros) : macros_{macros}, buffer_{}, resource_{buffer_.data(), buffer_.size()}, unions_{&resource_} {}
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+private:
+	expander_t(expander_t const&) = delete;
+
+	///	@brief	Hide set, which is a sorted array of macros allocated in the arena.
+	using hideset_t = std::span<macro_t const* const>;
+	///	@brief	Token with its hide set.
+	struct token_t {
+		lex::preprocessing_token_t token;	///< @brief	Token, which is a placemarker if its string is empty.
+		hideset_t				   hideset; ///< @brief	Hide set.
+	};
+	///	@brief	Tokens allocated in the arena.
+	using tokens_t = std::pmr::vector<token_t>;
+	///	@brief	Input of rescanning.
+	struct input_t {
+		tokens_t			 pending; ///< @brief	Tokens to rescan in reverse order, which precede the source.
+		lex::tokens_t const* source;  ///< @brief	Source, which follows the pending tokens if exists.
+		std::size_t			 cursor;  ///< @brief	Index of the next token of the source.
+		std::size_t			 last;	  ///< @brief	Index next to the last token of the source.
+		std::size_t			 newlines; ///< @brief	Newlines of the source in invocations of macros.
+	};
+
+	///	@brief	Finds the macro.
+	macro_t const* find(lex::preprocessing_token_type_t type, std::string_view const& str) const {
+		if (type != lex::preprocessing_token_type_t::identifier) return nullptr;
+		auto const found = macros_.find(str);
+		return found ? *found : nullptr;
+	}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "undef") return {false, tokens};
+	///	@brief	Gets the next token from the input.
+	std::optional<token_t> next(input_t& input) const {
+		if (! input.pending.empty()) {
+			auto const token = input.pending.back();
+			input.pending.pop_back();
+			return token;
+		}
+		for (; input.source && input.cursor < input.last; ++input.cursor) {
+			if (input.source->is_whitespace(input.cursor)) {
+				input.newlines += input.source->newlines(input.cursor);
+				continue;
+			}
+			return token_t{std::get<lex::preprocessing_token_t>((*input.source)[input.cursor++]), {}};
+		}
+		return std::nullopt;
+	}
+	///	@brief	Determines whether the next token of the input is the left parenthesis or not.
+	bool precedes_parenthesis(input_t const& input) const {
+		if (! input.pending.empty()) return input.pending.back().token.str() == "(";
+		if (! input.source) return false;
+		auto const index = input.source->next_preprocessing_token(input.cursor);
+		return index < input.last && input.source->str(index) == "(";
+	}
 
-	// TODO:
+	///	@brief	Replaces the token if it is a macro.
+	///	@param[in]		token	Token.
+	///	@param[in,out]	input	Input, which receives the replacement list to rescan.
+	///	@param[in]		emit	Function to receive the token if it is not replaced.
+	template<typename Emit>
+	void replace(token_t const& token, input_t& input, Emit const& emit) {
+		auto const macro = find(token.token.type(), token.token.str());
+		if (! macro || std::ranges::binary_search(token.hideset, macro, std::less<>{})) {
+			emit(token);
+		} else if (! macro->function_like) {
+			substitute(*macro, {}, add(token.hideset, macro), input.pending);
+		} else if (! precedes_parenthesis(input)) {
+			emit(token);
+		} else {
+			auto const [arguments, parenthesis] = collect(*macro, input);
+			substitute(*macro, arguments, add(intersect(token.hideset, parenthesis.hideset), macro), input.pending);
+		}
+	}
+	///	@brief	Collects the arguments of the invocation of function-like macro.
+	///	@return		Arguments, and the right parenthesis.
+	std::tuple<std::pmr::vector<tokens_t>, token_t> collect(macro_t const& macro, input_t& input) const {
+		auto const invalid = [&macro](std::string_view const& what) { return std::invalid_argument(std::string{what} + " for macro:" + std::string{macro.name.str()}); };
+
+		next(input); // (
+		std::pmr::vector<tokens_t> arguments(1u, tokens_t{&resource_}, &resource_);
+		for (std::size_t depth{};;) {
+			auto const token = next(input);
+			if (! token) throw invalid("unterminated argument list");
+			auto const str = token->token.str();
+			if (str == ")" && depth == 0u) {
+				if (macro.variadic && arguments.size() + 1u == macro.parameters) arguments.emplace_back();
+				if (arguments.size() != std::max(macro.parameters, std::uint32_t{1u}) || (macro.parameters == 0u && ! arguments.front().empty())) throw invalid("wrong number of arguments");
+				return {std::move(arguments), *token};
+			}
+			if (str == "," && depth == 0u && ! (macro.variadic && arguments.size() == macro.parameters)) {
+				arguments.emplace_back();
+				continue;
+			}
+			if (str == "(") ++depth;
+			if (str == ")") --depth;
+			arguments.back().push_back(*token);
+		}
+	}
+	///	@brief	Substitutes the arguments for the parameters in the replacement list.
+	///	@param[in]		macro		Macro.
+	///	@param[in]		arguments	Arguments.
+	///	@param[in]		hideset		Hide set, which is added to the resulting tokens.
+	///	@param[in,out]	pending		Pending tokens, which receive the resulting tokens in reverse order.
+	void substitute(macro_t const& macro, std::span<tokens_t const> arguments, hideset_t hideset, tokens_t& pending) {
+		using enum macro_t::op_t;
+		tokens_t							  output{&resource_};
+		std::pmr::vector<std::optional<tokens_t>> expanded(arguments.size(), &resource_);
+		auto const							  expanded_argument = [this, &arguments, &expanded](std::size_t index) -> tokens_t const& {
+			 if (! expanded[index]) expanded[index] = rescan(arguments[index]);
+			 return *expanded[index];
+		};
+
+		auto pasting = false;
+		for (std::size_t i = 0u; i < macro.replacement.size(); ++i) {
+			auto const& element = macro.replacement[i];
+			auto const	start	= output.size();
+			switch (element.op) {
+			case token: output.push_back({element.token, {}}); break;
+			case parameter: std::ranges::copy(expanded_argument(element.index), std::back_inserter(output)); break;
+			case raw_parameter:
+				if (arguments[element.index].empty()) {
+					output.push_back({});
+				} else {
+					std::ranges::copy(arguments[element.index], std::back_inserter(output));
+				}
+				break;
+			case stringize: output.push_back({stringize_tokens(arguments[element.index]), {}}); break;
+			case paste: pasting = true; continue;
+			case va_opt:
+				if (! expanded_argument(macro.parameters - 1u).empty()) continue;
+				i += element.index;
+				output.push_back({});
+				break;
+			}
+			if (pasting) {
+				output[start - 1u] = paste_tokens(output[start - 1u], output[start]);
+				output.erase(output.begin() + static_cast<std::ptrdiff_t>(start));
+				pasting = false;
+			}
+		}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+		// Placemarkers are removed before rescanning.
+		pending.reserve(pending.size() + output.size());
+		for (auto const& token : output | std::views::reverse) {
+			if (! token.token.str().empty()) pending.push_back({token.token, unite(token.hideset, hideset)});
+		}
+	}
+	///	@brief	Rescans the tokens in isolation, e.g., an argument.
+	tokens_t rescan(tokens_t const& tokens) {
+		input_t input{tokens_t(tokens.rbegin(), tokens.rend(), &resource_), nullptr, 0u, 0u, 0u};
+		tokens_t output{&resource_};
+		while (auto const token = next(input)) replace(*token, input, [&output](token_t const& token) { output.push_back(token); });
+		return output;
+	}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
-}
-inline std::tuple<bool, lex::tokens_t>
-parse_error_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
+	///	@brief	Stringizes the tokens, i.e., the # operator.
+	///		Tokens are separated by a space unless they are adjacent in the same text.
+	static lex::preprocessing_token_t stringize_tokens(tokens_t const& tokens) {
+		std::string str{"\""};
+		for (std::size_t i = 0u; i < tokens.size(); ++i) {
+			auto const& token = tokens[i].token;
+			if (0u < i && ! is_adjacent(tokens[i - 1u].token, token)) str += ' ';
+			if (token.type() == lex::preprocessing_token_type_t::string_literal || token.type() == lex::preprocessing_token_type_t::character_literal) {
+				for (auto const ch : token.str()) {
+					if (ch == '"' || ch == '\\') str += '\\';
+					str += ch;
+				}
+			} else {
+				str += token.str();
+			}
+		}
+		str += '"';
+		return lex::preprocessing_token_t{lex::source_manager().intern(str), lex::preprocessing_token_type_t::string_literal};
+	}
+	///	@brief	Pastes the tokens, i.e., the ## operator.
+	token_t paste_tokens(token_t const& lhs, token_t const& rhs) {
+		if (lhs.token.str().empty()) return rhs;
+		if (rhs.token.str().empty()) return lhs;
+		auto const str			  = std::string{lhs.token.str()} + std::string{rhs.token.str()};
+		auto const [length, type] = lex::scan_preprocessing_token(str);
+		if (length != str.size()) throw std::invalid_argument("pasting does not give a valid preprocessing token:" + str);
+		return {lex::preprocessing_token_t{lex::source_manager().intern(str), type}, intersect(lhs.hideset, rhs.hideset)};
+	}
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+	///	@brief	Releases everything in the arena, which shall have no alive tokens nor hide sets.
+	void recycle(input_t& input) {
+		tokens_t{&resource_}.swap(input.pending);
+		decltype(unions_){&resource_}.swap(unions_);
+		resource_.release();
+	}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "error") return {false, tokens};
+	///	@brief	Allocates a hide set in the arena.
+	template<typename F>
+	hideset_t allocate(std::size_t size, F const& fill) {
+		auto const data = std::pmr::polymorphic_allocator<macro_t const*>{&resource_}.allocate(size);
+		return hideset_t{data, static_cast<std::size_t>(fill(data) - data)};
+	}
+	///	@brief	Adds the macro to the hide set.
+	hideset_t add(hideset_t hideset, macro_t const* macro) {
+		if (std::ranges::binary_search(hideset, macro, std::less<>{})) return hideset;
+		return allocate(hideset.size() + 1u, [&](auto data) { return std::ranges::merge(hideset, std::span{&macro, 1u}, data, std::less<>{}).out; });
+	}
+	///	@brief	Gets the intersection of the hide sets.
+	hideset_t intersect(hideset_t lhs, hideset_t rhs) {
+		if (lhs.empty() || rhs.empty()) return {};
+		if (lhs.data() == rhs.data() && lhs.size() == rhs.size()) return lhs;
+		return allocate(std::min(lhs.size(), rhs.size()), [&](auto data) { return std::ranges::set_intersection(lhs, rhs, data, std::less<>{}).out; });
+	}
+	///	@brief	Gets the union of the hide sets, which is cached because most tokens of a replacement list share their hide sets.
+	hideset_t unite(hideset_t lhs, hideset_t rhs) {
+		if (lhs.empty()) return rhs;
+		if (rhs.empty() || (lhs.data() == rhs.data() && lhs.size() == rhs.size())) return lhs;
+		auto const key = std::make_pair(lhs.data(), rhs.data());
+		if (auto const found = unions_.find(key); found != unions_.end()) return found->second;
+		return unions_[key] = allocate(lhs.size() + rhs.size(), [&](auto data) { return std::ranges::set_union(lhs, rhs, data, std::less<>{}).out; });
+	}
 
-	// TODO:
+	///	@brief	Hash of pair of hide sets.
+	struct hash_t {
+		std::size_t operator()(std::pair<macro_t const* const*, macro_t const* const*> const& key) const noexcept {
+			return std::hash<void const*>{}(key.first) * 31u + std::hash<void const*>{}(key.second);
+		}
+	};
+
+	context_t::macros_t const&				   macros_;	  ///< @brief	Macros.
+	std::array<std::byte, 8192u>			   buffer_;	  ///< @brief	Initial buffer of the arena, which is reused after recycling.
+	mutable std::pmr::monotonic_buffer_resource resource_; ///< @brief	Arena of hide sets and intermediate tokens of an invocation.
+	std::pmr::unordered_map<std::pair<macro_t const* const*, macro_t const* const*>, hideset_t, hash_t> unions_; ///< @brief	Cache of unions.
+};
+
+///	@brief	Value of condition, which is either std::intmax_t or std::uintmax_t.
+struct value_t {
+	std::uintmax_t bits;		///< @brief	Bits of the value.
+	bool		   is_unsigned; ///< @brief	Whether the value is unsigned or not.
+};
+
+///	@brief	Parses integer literal.
+///	@param[in]	str		String of preprocessing number.
+///	@return		Value of the literal, which is unsigned if it has the suffix u or it overflows std::intmax_t.
+///	@throw	std::invalid_argument	The @p str is not an integer literal.
+inline value_t
+parse_integer_literal(std::string_view const& str) {
+	auto const invalid = [&str] { return std::invalid_argument("invalid integer literal:" + std::string{str}); };
+
+	auto const	 prefixed = 2u < str.size() && str[0] == '0';
+	auto const	 base	  = (prefixed && (str[1] == 'x' || str[1] == 'X')) ? 16u : (prefixed && (str[1] == 'b' || str[1] == 'B')) ? 2u : str.starts_with('0') ? 8u : 10u;
+	auto		 s		  = (base == 16u || base == 2u) ? str.substr(2u) : str;
+	std::uintmax_t bits{};
+	auto		 digits = 0u;
+	for (; ! s.empty(); s.remove_prefix(1u)) {
+		auto const ch = s.front();
+		if (ch == '\'' && 0u < digits) continue;
+		auto const digit = ('0' <= ch && ch <= '9') ? ch - '0' : ('a' <= ch && ch <= 'f') ? ch - 'a' + 10 : ('A' <= ch && ch <= 'F') ? ch - 'A' + 10 : 16;
+		if (base <= static_cast<unsigned>(digit)) break;
+		if ((std::numeric_limits<std::uintmax_t>::max() - digit) / base < bits) throw invalid();
+		bits = bits * base + digit;
+		++digits;
+	}
+	if (digits == 0u && base != 8u) throw invalid();
+
+	// Suffixes, which are u, l, ll, z, and their combinations.
+	auto	   is_unsigned	  = false;
+	auto const strip_unsigned = [&s, &is_unsigned] {
+		if (is_unsigned || s.empty() || (s.front() != 'u' && s.front() != 'U')) return;
+		is_unsigned = true;
+		s.remove_prefix(1u);
+	};
+	strip_unsigned();
+	for (std::string_view const size : {"ll", "LL", "l", "L", "z", "Z"}) {
+		if (! s.starts_with(size)) continue;
+		s.remove_prefix(size.size());
+		break;
+	}
+	strip_unsigned();
+	if (! s.empty()) throw invalid();
+	return {bits, is_unsigned || static_cast<std::uintmax_t>(std::numeric_limits<std::intmax_t>::max()) < bits};
+}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+///	@brief	Parses character literal.
+///	@param[in]	str		String of character literal.
+///	@return		Value of the literal.
+///	@throw	std::invalid_argument	The @p str is not a character literal.
+inline value_t
+parse_character_literal(std::string_view const& str) {
+	auto const invalid = [&str] { return std::invalid_argument("invalid character literal:" + std::string{str}); };
+
+	auto const quote = str.find('\'');
+	if (quote == std::string_view::npos || str.size() < quote + 3u || str.back() != '\'') throw invalid();
+	auto const prefix = str.substr(0u, quote);
+	auto	   s	  = str.substr(quote + 1u, str.size() - quote - 2u);
+
+	std::intmax_t value{};
+	for (auto count = 0u; ! s.empty(); ++count) {
+		std::intmax_t ch{};
+		if (s.front() != '\\') {
+			auto const [rest, u32] = prefix.empty() ? std::make_tuple(s.substr(1u), static_cast<char32_t>(static_cast<signed char>(s.front()))) : uc::get_head_ucs32(s);
+			ch					   = static_cast<std::intmax_t>(static_cast<std::int32_t>(u32));
+			s					   = rest;
+		} else if (s.size() < 2u) {
+			throw invalid();
+		} else if (auto const escaped = std::string_view{R"('"?\abfnrtv)"}.find(s[1]); escaped != std::string_view::npos) {
+			ch = std::string_view{"'\"?\\\a\b\f\n\r\t\v"}[escaped];
+			s.remove_prefix(2u);
+		} else {
+			auto const hex	 = s[1] == 'x';
+			auto const first = hex ? 2u : 1u;
+			auto	   last	 = first;
+			for (; last < s.size() && (hex ? std::isxdigit(static_cast<unsigned char>(s[last])) != 0 : ('0' <= s[last] && s[last] <= '7' && last < 4u)); ++last) ch = ch * (hex ? 16 : 8) + (std::isdigit(static_cast<unsigned char>(s[last])) ? s[last] - '0' : (std::tolower(static_cast<unsigned char>(s[last])) - 'a' + 10));
+			if (last == first) throw invalid();
+			if (prefix.empty()) ch = static_cast<signed char>(ch);
+			s.remove_prefix(last);
+		}
+		// Multicharacter literal is implementation-defined, which follows GCC.
+		value = (prefix.empty() && 0u < count) ? static_cast<std::int32_t>((static_cast<std::uint32_t>(value) << 8u) | (ch & 0xFF)) : ch;
+	}
+	return {static_cast<std::uintmax_t>(value), false};
+}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
+///	@brief	Compiled condition of #if or #elif, which is executed by a stack machine.
+///		Identifiers are looked up at execution, so that the program is reused for any set of macros.
+struct program_t {
+	///	@brief	Operation code.
+	enum class opcode_t : std::uint8_t {
+		push,		   ///< @brief	Pushes the constant of the operand.
+		identifier,	   ///< @brief	Pushes the value of the macro of the operand, or zero if not defined.
+		defined,	   ///< @brief	Pushes whether the macro of the operand is defined or not.
+		has_include,   ///< @brief	Pushes whether the header of the operand exists or not.
+		pop,		   ///< @brief	Pops the value, i.e., the comma operator.
+		jump,		   ///< @brief	Jumps to the operand.
+		jump_if_zero,  ///< @brief	Pops the value, and jumps to the operand if it is zero.
+		jump_unless_0, ///< @brief	Pops the value, and jumps to the operand unless it is zero.
+		to_bool,	   ///< @brief	Converts the value to zero or one.
+		plus,		   ///< @brief	Unary +.
+		negate,		   ///< @brief	Unary -.
+		logical_not,   ///< @brief	Unary !.
+		complement,	   ///< @brief	Unary ~.
+		multiply,	   ///< @brief	Binary *.
+		divide,		   ///< @brief	Binary /.
+		modulo,		   ///< @brief	Binary %.
+		add,		   ///< @brief	Binary +.
+		subtract,	   ///< @brief	Binary -.
+		shift_left,	   ///< @brief	Binary <<.
+		shift_right,   ///< @brief	Binary >>.
+		less,		   ///< @brief	Binary <.
+		greater,	   ///< @brief	Binary >.
+		less_equal,	   ///< @brief	Binary <=.
+		greater_equal, ///< @brief	Binary >=.
+		equal,		   ///< @brief	Binary ==.
+		not_equal,	   ///< @brief	Binary !=.
+		bit_and,	   ///< @brief	Binary &.
+		bit_xor,	   ///< @brief	Binary ^.
+		bit_or,		   ///< @brief	Binary |.
+	};
+	///	@brief	Instruction.
+	struct instruction_t {
+		opcode_t	  opcode;  ///< @brief	Operation code.
+		std::uint32_t operand; ///< @brief	Index of the constants, names, or instructions.
+	};
+
+	std::vector<instruction_t>						   code;	  ///< @brief	Instructions.
+	std::vector<value_t>							   constants; ///< @brief	Constants.
+	std::vector<std::string_view>					   names;	  ///< @brief	Names of macros, which refer into the source.
+	std::vector<std::tuple<std::filesystem::path, bool>> headers;	  ///< @brief	Headers of __has_include, and whether they are in angle brackets.
+	bool											   expands;	  ///< @brief	Whether the condition invokes function-like macros or not, which cannot be compiled before expansion.
+};
+
+///	@brief	Compiles the condition of #if or #elif.
+///	@param[in]	tokens		Preprocessing tokens of the condition.
+///	@param[in]	expanded	Whether macros in the @p tokens have been expanded or not.
+///		If true, remaining identifiers are replaced by zero; otherwise, they are looked up at execution.
+///	@return		Compiled program, which needs expansion if the @p tokens are invalid before expansion.
+///	@throw	std::invalid_argument	The condition is invalid after expansion.
+inline program_t
+compile_condition(std::span<lex::preprocessing_token_t const> tokens, bool expanded) {
+	using enum program_t::opcode_t;
+	using opcode_t = program_t::opcode_t;
+
+	struct expansion_t {}; // Thrown if the condition needs expansion.
+
+	program_t	program{};
+	std::size_t pos{};
+
+	auto const invalid = [&tokens, &pos](std::string_view const& what) {
+		std::string str{what};
+		for (auto const& token : tokens) str.append(" ").append(token.str());
+		return std::invalid_argument(str + (pos < tokens.size() ? " at " + std::string{tokens[pos].str()} : std::string{" at the end"}));
+	};
+	auto const peek = [&tokens, &pos]() -> std::string_view { return pos < tokens.size() ? tokens[pos].str() : std::string_view{}; };
+	auto const expect = [&](std::string_view const& str) {
+		if (peek() != str) throw invalid("'" + std::string{str} + "' is expected:");
+		++pos;
+	};
+	auto const emit = [&program](opcode_t opcode, std::size_t operand = 0u) {
+		program.code.push_back({opcode, static_cast<std::uint32_t>(operand)});
+		return program.code.size() - 1u;
+	};
+	auto const patch	= [&program](std::size_t jump) { program.code[jump].operand = static_cast<std::uint32_t>(program.code.size()); };
+	auto const constant = [&](value_t value) {
+		program.constants.push_back(value);
+		emit(opcode_t::push, program.constants.size() - 1u);
+	};
+
+	// Binary operators and their precedences, which include the alternative tokens.
+	auto const binary = [](std::string_view const& str) -> std::tuple<int, opcode_t> {
+		if (str == "*") return {10, multiply};
+		if (str == "/") return {10, divide};
+		if (str == "%") return {10, modulo};
+		if (str == "+") return {9, add};
+		if (str == "-") return {9, subtract};
+		if (str == "<<") return {8, shift_left};
+		if (str == ">>") return {8, shift_right};
+		if (str == "<") return {7, less};
+		if (str == ">") return {7, greater};
+		if (str == "<=") return {7, less_equal};
+		if (str == ">=") return {7, greater_equal};
+		if (str == "==") return {6, equal};
+		if (str == "!=" || str == "not_eq") return {6, not_equal};
+		if (str == "&" || str == "bitand") return {5, bit_and};
+		if (str == "^" || str == "xor") return {4, bit_xor};
+		if (str == "|" || str == "bitor") return {3, bit_or};
+		if (str == "&&" || str == "and") return {2, jump_if_zero};
+		if (str == "||" || str == "or") return {1, jump_unless_0};
+		return {0, push};
+	};
+
+	std::function<void()>	 expression;
+	std::function<void()>	 conditional;
+	std::function<void(int)> binary_expression;
+	std::function<void()>	 unary_expression;
+
+	auto const primary_expression = [&] {
+		if (tokens.size() <= pos) throw invalid("operand is expected:");
+		auto const& token = tokens[pos++];
+		auto const	str	  = token.str();
+		switch (token.type()) {
+		case lex::preprocessing_token_type_t::pp_number: constant(parse_integer_literal(str)); return;
+		case lex::preprocessing_token_type_t::character_literal: constant(parse_character_literal(str)); return;
+		case lex::preprocessing_token_type_t::identifier: break;
+		default:
+			if (str != "(") throw invalid("invalid token:");
+			expression();
+			expect(")");
+			return;
+		}
+		if (str == "defined") {
+			auto const parenthesized = peek() == "(";
+			if (parenthesized) ++pos;
+			if (tokens.size() <= pos || tokens[pos].type() != lex::preprocessing_token_type_t::identifier) throw invalid("identifier is expected:");
+			program.names.push_back(tokens[pos++].str());
+			emit(defined, program.names.size() - 1u);
+			if (parenthesized) expect(")");
+		} else if (str == "__has_include") {
+			expect("(");
+			std::string header;
+			auto const	quoted = pos < tokens.size() && (tokens[pos].type() == lex::preprocessing_token_type_t::header_name || (tokens[pos].type() == lex::preprocessing_token_type_t::string_literal && tokens[pos].str().starts_with('"')));
+			auto const	angled = peek().starts_with('<');
+			if (quoted) {
+				header = tokens[pos].str().substr(1u, tokens[pos].str().size() - 2u);
+			} else if (angled) {
+				// Header name in angle brackets may be split into tokens, e.g., after expansion of macros.
+				for (++pos; pos < tokens.size() && tokens[pos].str() != ">"; ++pos) header.append(tokens[pos].str());
+			}
+			if (header.empty()) throw invalid("header name is expected:");
+			++pos;
+			expect(")");
+			program.headers.emplace_back(header, angled);
+			emit(has_include, program.headers.size() - 1u);
+		} else if (str == "true" || str == "false") {
+			constant({str == "true" ? 1u : 0u, false});
+		} else if (expanded) {
+			constant({0u, false});
+		} else {
+			// Invocation of function-like macro needs expansion before compilation.
+			if (peek() == "(") throw expansion_t{};
+			program.names.push_back(str);
+			emit(identifier, program.names.size() - 1u);
+		}
+	};
+	unary_expression = [&] {
+		auto const str = peek();
+		if (str == "+" || str == "-" || str == "!" || str == "~" || str == "not" || str == "compl") {
+			++pos;
+			unary_expression();
+			emit(str == "+" ? plus : str == "-" ? negate : (str == "!" || str == "not") ? logical_not : complement);
+		} else {
+			primary_expression();
+		}
+	};
+	binary_expression = [&](int precedence) {
+		unary_expression();
+		while (true) {
+			auto const [p, opcode] = binary(peek());
+			if (p < precedence || p == 0) return;
+			++pos;
+			if (opcode == jump_if_zero || opcode == jump_unless_0) {
+				// Short-circuit evaluation.
+				auto const jump_to_constant = emit(opcode);
+				binary_expression(p + 1);
+				emit(to_bool);
+				auto const jump_to_end = emit(jump);
+				patch(jump_to_constant);
+				constant({opcode == jump_if_zero ? 0u : 1u, false});
+				patch(jump_to_end);
+			} else {
+				binary_expression(p + 1);
+				emit(opcode);
+			}
+		}
+	};
+	conditional = [&] {
+		binary_expression(1);
+		if (peek() != "?") return;
+		++pos;
+		auto const jump_to_false = emit(jump_if_zero);
+		expression();
+		expect(":");
+		auto const jump_to_end = emit(jump);
+		patch(jump_to_false);
+		conditional();
+		patch(jump_to_end);
+	};
+	expression = [&] {
+		conditional();
+		while (peek() == ",") {
+			++pos;
+			emit(pop);
+			conditional();
+		}
+	};
+
+	try {
+		expression();
+		if (pos < tokens.size()) throw invalid("unexpected token:");
+	} catch (expansion_t const&) {
+		program = program_t{};
+		program.expands = true;
+	} catch (std::invalid_argument const&) {
+		// Macros may expand to operators or parentheses, e.g., #define AND &&, so that syntax errors are reported only after expansion.
+		if (expanded) throw;
+		program = program_t{};
+		program.expands = true;
+	}
+	return program;
 }
-inline std::tuple<bool, lex::tokens_t>
-parse_line_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+///	@brief	Resolver of headers, which indexes the include directories of this process.
+///		Each directory is listed once at its first lookup, and then lookups are answered by the index without any system call.
+///		A header with directories, e.g., sys/types.h, is resolved by the indices of the subdirectories one by one.
+///		Missing headers and directories are also answered by the indices, so that negative lookups are cached as well.
+///		Names are compared ignoring case on Windows and macOS, whose file systems do so by default.
+///	@note	Files created after the listing are not found until the index is cleared.
+class include_resolver_t {
+public:
+	///	@brief	Number of shards.
+	static constexpr std::size_t const shard_count = 16u;
+#if defined(_WIN32) || defined(__APPLE__)
+	///	@brief	Whether names are compared ignoring case by default, as the file systems of the platform do.
+	static constexpr bool const default_fold_case = true;
+#else
+	static constexpr bool const default_fold_case = false;
+#endif
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "line") return {false, tokens};
+	///	@brief	Determines whether the directory contains the header or not.
+	///	@param[in]	directory	Directory, or empty for the current directory.
+	///	@param[in]	header		Relative path of the header.
+	///	@return		It returns true if the header is a regular file in the directory; otherwise, it returns false.
+	bool contains(std::filesystem::path const& directory, std::filesystem::path const& header) {
+		auto const relative = header.lexically_normal();
+		if (relative.empty() || relative.has_root_path() || *relative.begin() == "..") {
+			std::error_code error;
+			return std::filesystem::is_regular_file(directory / header, error); // It is out of the directory.
+		}
+		auto		current = directory;
+		auto		listing = list(current);
+		auto const	last	= std::prev(relative.end());
+		for (auto i = relative.begin(); i != last; ++i) {
+			auto const found = listing->directories.find(fold(i->string()));
+			if (found == listing->directories.end()) return false;
+			current /= found->second;
+			listing = list(current);
+		}
+		return listing->files.contains(fold(last->string()));
+	}
 
-	// TODO:
+	///	@brief	Clears the indices, e.g., after headers are generated.
+	void clear() {
+		for (auto& shard : shards_) {
+			std::unique_lock lock{shard.mutex};
+			shard.directories.clear();
+		}
+	}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+	///	@brief	Constructor.
+	///	@param[in]	fold_case	Whether names are compared ignoring case of ASCII letters or not.
+	explicit include_resolver_t(bool fold_case = default_fold_case) : fold_case_{fold_case}, shards_{} {}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
-}
-inline std::tuple<bool, lex::tokens_t>
-parse_include_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
+private:
+	include_resolver_t(include_resolver_t const&) = delete;
+
+	///	@brief	Folds case of the name if names are compared ignoring case.
+	///	@param[in]	name	Name of a file or a directory.
+	///	@return		Folded name.
+	std::string fold(std::string name) const {
+		if (fold_case_) std::ranges::transform(name, name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+		return name;
+	}
+
+	///	@brief	Index of a directory, which is immutable once listed.
+	struct listing_t {
+		std::unordered_set<std::string>				 files;		  ///< @brief	Folded names of the regular files.
+		std::unordered_map<std::string, std::string> directories; ///< @brief	Names of the subdirectories by their folded names.
+	};
+	///	@brief	Shard of the indices.
+	struct shard_t {
+		std::shared_mutex														 mutex;		  ///< @brief	Mutex.
+		std::unordered_map<std::string, std::shared_ptr<listing_t const>> directories; ///< @brief	Indices by the directories.
+	};
+
+	///	@brief	Lists the directory, or gets its index.
+	///	@param[in]	directory	Directory.
+	///	@return		Index of the directory, which is empty if the directory does not exist.
+	std::shared_ptr<listing_t const> list(std::filesystem::path const& directory) {
+		auto const key	 = directory.empty() ? std::string{"."} : directory.lexically_normal().string();
+		auto&	   shard = shards_[std::hash<std::string>{}(key) % shard_count];
+		{
+			std::shared_lock lock{shard.mutex};
+			if (auto const found = shard.directories.find(key); found != shard.directories.end()) return found->second;
+		}
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+		// Lists the directory without the lock, so that other directories are not blocked.
+		auto			listing = std::make_shared<listing_t>();
+		std::error_code error;
+		for (std::filesystem::directory_iterator i{key, error}, end; ! error && i != end; i.increment(error)) {
+			std::error_code ignored;
+			if (i->is_regular_file(ignored)) {
+				listing->files.insert(fold(i->path().filename().string()));
+			} else if (i->is_directory(ignored)) {
+				listing->directories.emplace(fold(i->path().filename().string()), i->path().filename().string());
+			}
+		}
+		std::unique_lock lock{shard.mutex};
+		return shard.directories.try_emplace(key, std::move(listing)).first->second;
+	}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "include") return {false, tokens};
+	bool const						 fold_case_; ///< @brief	Whether names are compared ignoring case or not.
+	std::array<shard_t, shard_count> shards_;	 ///< @brief	Shards.
+};
 
-	// TODO:
+///	@brief	Gets the include resolver of this process.
+///	@return	The include resolver.
+inline include_resolver_t&
+include_resolver() {
+	static include_resolver_t resolver;
+	return resolver;
+}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+///	@brief	Finds the header.
+///		A header in quotes is found in the directory of the current file at first, and then in the include directories.
+///		The directories are looked up by the include resolver.
+///	@param[in]	header	Header name.
+///	@param[in]	angled	Whether the @p header is in angle brackets or not.
+///	@param[in]	context	Context.
+///	@return		Path of the found header, or std::nullopt if not found.
+inline std::optional<std::filesystem::path>
+find_header(std::filesystem::path const& header, bool angled, context_t const& context) {
+	prof::scope_t scope{prof::phase_t::include};
+	if (header.is_absolute()) {
+		std::error_code error;
+		return std::filesystem::is_regular_file(header, error) ? std::optional{header} : std::nullopt;
+	}
+	auto& resolver = include_resolver();
+	if (! angled) {
+		auto const directory = context.sources().empty() ? std::filesystem::path{} : context.sources().top().first.parent_path();
+		scope.add(1u);
+		if (resolver.contains(directory, header)) return directory / header;
+	}
+	for (auto const& directory : context.includes()) {
+		scope.add(1u);
+		if (resolver.contains(directory, header)) return directory / header;
+	}
+	return std::nullopt;
+}
+///	@brief	Determines whether the header exists or not, i.e., __has_include.
+///	@param[in]	header	Header name.
+///	@param[in]	angled	Whether the @p header is in angle brackets or not.
+///	@param[in]	context	Context.
+///	@return		It returns true if the header exists; otherwise, it returns false.
+inline bool
+has_include(std::filesystem::path const& header, bool angled, context_t const& context) {
+	return find_header(header, angled, context).has_value();
+}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
+///	@brief	Gets value of the macro if it is replaced by a constant.
+///	@param[in]	name	Name of the macro.
+///	@param[in]	macros	Macros.
+///	@return		Value of the macro, zero if not defined, or std::nullopt if the replacement list needs expansion.
+inline std::optional<value_t>
+macro_value(std::string_view name, context_t::macros_t const& macros) {
+	for (std::size_t depth{}; depth < macros.size() + 1u; ++depth) {
+		auto const found = macros.find(name);
+		if (! found || (*found)->function_like) return value_t{0u, false};
+		auto const& replacement = (*found)->replacement;
+		if (replacement.size() != 1u || replacement.front().op != macro_t::op_t::token) return std::nullopt;
+		auto const& token = replacement.front().token;
+		if (token.type() == lex::preprocessing_token_type_t::pp_number) return parse_integer_literal(token.str());
+		if (token.type() != lex::preprocessing_token_type_t::identifier || token.str() == "defined" || token.str() == "__has_include") return std::nullopt;
+		if (token.str() == "true" || token.str() == "false") return value_t{token.str() == "true" ? 1u : 0u, false};
+		if (token.str() == name) return value_t{0u, false}; // Self-referential macro is not replaced.
+		name = token.str();
+	}
+	return std::nullopt;
 }
-inline std::tuple<bool, lex::tokens_t>
-parse_pragma_directive(lex::tokens_t const& tokens, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return {false, tokens};
+///	@brief	Executes the compiled condition.
+///	@param[in]	program	Compiled program.
+///	@param[in]	context	Context.
+///	@return		Value of the condition, or std::nullopt if any macro needs expansion.
+///	@throw	std::invalid_argument	Division by zero.
+inline std::optional<value_t>
+execute(program_t const& program, context_t const& context) {
+	using enum program_t::opcode_t;
+
+	std::vector<value_t> stack;
+	stack.reserve(program.code.size());
+	auto const pop_value = [&stack] {
+		auto const value = stack.back();
+		stack.pop_back();
+		return value;
+	};
+	auto const signed_value = [](value_t const& value) { return static_cast<std::intmax_t>(value.bits); };
+	auto const boolean		= [](bool value) { return value_t{value ? 1u : 0u, false}; };
+
+	for (std::size_t pc{}; pc < program.code.size(); ++pc) {
+		auto const [opcode, operand] = program.code[pc];
+		switch (opcode) {
+		case push: stack.push_back(program.constants[operand]); continue;
+		case identifier:
+			if (auto const value = macro_value(program.names[operand], context.macros())) {
+				stack.push_back(*value);
+				continue;
+			}
+			return std::nullopt;
+		case defined: stack.push_back(boolean(context.macros().contains(program.names[operand]))); continue;
+		case has_include: stack.push_back(boolean(std::apply([&context](auto const& header, auto angled) { return cpp::has_include(header, angled, context); }, program.headers[operand]))); continue;
+		case pop: stack.pop_back(); continue;
+		case jump: pc = operand - 1u; continue;
+		case jump_if_zero:
+			if (pop_value().bits == 0u) pc = operand - 1u;
+			continue;
+		case jump_unless_0:
+			if (pop_value().bits != 0u) pc = operand - 1u;
+			continue;
+		case to_bool: stack.back() = boolean(stack.back().bits != 0u); continue;
+		case plus: continue;
+		case negate: stack.back().bits = std::uintmax_t{} - stack.back().bits; continue;
+		case logical_not: stack.back() = boolean(stack.back().bits == 0u); continue;
+		case complement: stack.back().bits = ~stack.back().bits; continue;
+		default: break;
+		}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || (std::get<lex::preprocessing_token_t>(*directive).str() != "pragma" && std::get<lex::preprocessing_token_t>(*directive).str() != "_Pragma")) return {false, tokens};
+		// Binary operators, which follow the usual arithmetic conversions.
+		auto const rhs		   = pop_value();
+		auto const lhs		   = pop_value();
+		auto const is_unsigned = lhs.is_unsigned || rhs.is_unsigned;
+		auto const compare	   = [&](auto const& op) { return boolean(is_unsigned ? op(lhs.bits, rhs.bits) : op(signed_value(lhs), signed_value(rhs))); };
+		auto const arithmetic  = [&](std::uintmax_t bits) { return value_t{bits, is_unsigned}; };
+		switch (opcode) {
+		case multiply: stack.push_back(arithmetic(lhs.bits * rhs.bits)); break;
+		case divide:
+		case modulo: {
+			if (rhs.bits == 0u) throw std::invalid_argument("division by zero in condition");
+			if (is_unsigned) {
+				stack.push_back(arithmetic(opcode == divide ? lhs.bits / rhs.bits : lhs.bits % rhs.bits));
+			} else if (signed_value(rhs) == -1) {
+				stack.push_back(arithmetic(opcode == divide ? std::uintmax_t{} - lhs.bits : 0u)); // It wraps around instead of overflow.
+			} else {
+				stack.push_back(arithmetic(static_cast<std::uintmax_t>(opcode == divide ? signed_value(lhs) / signed_value(rhs) : signed_value(lhs) % signed_value(rhs))));
+			}
+		} break;
+		case add: stack.push_back(arithmetic(lhs.bits + rhs.bits)); break;
+		case subtract: stack.push_back(arithmetic(lhs.bits - rhs.bits)); break;
+		case shift_left:
+		case shift_right: {
+			// The type is of the left operand, and negative count shifts to the opposite direction.
+			auto const negative = ! rhs.is_unsigned && signed_value(rhs) < 0;
+			auto const count	= negative ? std::uintmax_t{} - rhs.bits : rhs.bits;
+			auto const left		= (opcode == shift_left) != negative;
+			auto const width	= std::uintmax_t{std::numeric_limits<std::uintmax_t>::digits};
+			auto const bits		= left ? (count < width ? lhs.bits << count : 0u)
+									   : lhs.is_unsigned ? (count < width ? lhs.bits >> count : 0u)
+														 : static_cast<std::uintmax_t>(signed_value(lhs) >> std::min(count, width - 1u));
+			stack.push_back(value_t{bits, lhs.is_unsigned});
+		} break;
+		case less: stack.push_back(compare(std::less<>{})); break;
+		case greater: stack.push_back(compare(std::greater<>{})); break;
+		case less_equal: stack.push_back(compare(std::less_equal<>{})); break;
+		case greater_equal: stack.push_back(compare(std::greater_equal<>{})); break;
+		case equal: stack.push_back(boolean(lhs.bits == rhs.bits)); break;
+		case not_equal: stack.push_back(boolean(lhs.bits != rhs.bits)); break;
+		case bit_and: stack.push_back(arithmetic(lhs.bits & rhs.bits)); break;
+		case bit_xor: stack.push_back(arithmetic(lhs.bits ^ rhs.bits)); break;
+		case bit_or: stack.push_back(arithmetic(lhs.bits | rhs.bits)); break;
+		default: break;
+		}
+	}
+	return stack.back();
+}
 
-	// TODO:
+///	@brief	Cache of compiled conditions, which is keyed by their location in the source.
+///		Sources are keyed by their serial numbers, which are never reused, so that a program of a freed source is never found.
+///		Programs of the freed sources are purged as the cache grows.
+class program_cache_t {
+public:
+	///	@brief	Key, which is the serial number of the source and offset of the condition.
+	using key_t = std::tuple<std::uint64_t, std::size_t>;
+	///	@brief	Shared pointer of program.
+	using program_ptr_t = std::shared_ptr<program_t const>;
+
+	///	@brief	Finds the program.
+	///	@param[in]	key		Key of the condition.
+	///	@return		Found program, or null if not cached.
+	program_ptr_t find(key_t const& key) const {
+		std::shared_lock lock{mutex_};
+		auto const		 found = programs_.find(key);
+		return found == programs_.end() ? program_ptr_t{} : found->second.program;
+	}
+	///	@brief	Caches the program.
+	///	@param[in]	key		Key of the condition.
+	///	@param[in]	source	Source of the condition, whose names the program refers into.
+	///	@param[in]	program	Program to cache.
+	///	@return		Cached program, which is the former one if another thread has cached.
+	program_ptr_t add(key_t const& key, lex::source_t const& source, program_ptr_t const& program) {
+		std::unique_lock lock{mutex_};
+		if (purge_ <= programs_.size()) {
+			std::erase_if(programs_, [](auto const& a) { return a.second.source.expired(); });
+			purge_ = std::max(min_purge, programs_.size() * 2u);
+		}
+		return programs_.emplace(key, entry_t{source.weak_from_this(), program}).first->second.program;
+	}
+	///	@brief	Gets the number of cached programs.
+	///	@return		Number of cached programs.
+	std::size_t size() const {
+		std::shared_lock lock{mutex_};
+		return programs_.size();
+	}
 
-	auto const newline = next_newline(tokens, directive);
-	if (newline == tokens.cend() || std::get<lex::whitespace_t>(*newline).newlines() == 0u) return {false, tokens};
+	///	@brief	Constructor.
+	program_cache_t() : mutex_{}, programs_{}, purge_{min_purge} {}
 
-	tracer.set_result("true");
-	return {true, lex::tokens_t(newline + 1, tokens.cend())};
+private:
+	program_cache_t(program_cache_t const&) = delete;
+
+	///	@brief	Minimum number of programs to purge the freed ones.
+	static constexpr std::size_t const min_purge = 4096u;
+
+	///	@brief	Entry of the cache.
+	struct entry_t {
+		std::weak_ptr<lex::source_t const> source;	///< @brief	Source of the condition.
+		program_ptr_t					   program; ///< @brief	Program.
+	};
+
+	///	@brief	Hash of key.
+	struct hash_t {
+		std::size_t operator()(key_t const& key) const noexcept { return std::hash<std::uint64_t>{}(std::get<0>(key)) ^ (std::get<1>(key) * 0x9E3779B97F4A7C15ull); }
+	};
+
+	mutable std::shared_mutex					mutex_;	   ///< @brief	Mutex.
+	std::unordered_map<key_t, entry_t, hash_t> programs_; ///< @brief	Programs.
+	std::size_t									purge_;	   ///< @brief	Number of programs to purge the freed ones.
+};
+
+///	@brief	Gets the cache of compiled conditions of this process.
+///	@return	The cache.
+inline program_cache_t&
+program_cache() {
+	static program_cache_t cache;
+	return cache;
 }
-inline std::optional<std::tuple<bool, lex::whitespace_t>>
-parse_ifdef_directive(lex::tokens_t const& tokens, context_t const& context) {
+
+///	@brief	Evaluates the condition of #if or #elif.
+///		The condition is compiled once per its location, and the program is executed with the current macros.
+///		Only if any macro is not replaced by a constant, the condition is expanded and compiled again.
+///	@param[in]	directive	Directive.
+///	@param[in]	context		Context.
+///	@return		Result of the condition.
+///	@throw	std::invalid_argument	The condition is invalid.
+inline bool
+evaluate(directive_t const& directive, context_t const& context) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return std::nullopt;
-
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || (std::get<lex::preprocessing_token_t>(*directive).str() != "ifdef" && std::get<lex::preprocessing_token_t>(*directive).str() != "ifndef")) return std::nullopt;
-	auto const affamative = std::get<lex::preprocessing_token_t>(*directive).str() != "ifdef";
-
-	auto const macro_itr = next_preprocessing_token(tokens, directive);
-	if (macro_itr == tokens.cend()) return std::nullopt;
-
-	auto const macro   = std::get<lex::preprocessing_token_t>(*macro_itr);
-	auto const defined = context.macros().contains(macro.str());
+	std::vector<lex::preprocessing_token_t> tokens;
+	for (auto i = directive.first; i != directive.last; ++i) {
+		if (auto const token = *i; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) tokens.push_back(*pp);
+	}
+	if (tokens.empty()) throw std::invalid_argument("no condition");
+
+	auto const source  = tokens.front().source();
+	auto const key	   = source ? program_cache_t::key_t{source->serial(), static_cast<std::size_t>(tokens.front().str().data() - source->text().data())} : program_cache_t::key_t{};
+	auto	   program = source ? program_cache().find(key) : program_cache_t::program_ptr_t{};
+	if (! program) {
+		program = std::make_shared<program_t const>(compile_condition(tokens, false));
+		if (source) program = program_cache().add(key, *source, program);
+	}
+	if (! program->expands) {
+		if (auto const value = execute(*program, context)) {
+			tracer.set_result(value->bits != 0u);
+			return value->bits != 0u;
+		}
+	}
 
-	auto const newline_itr = next_newline(tokens, macro_itr);
-	if (newline_itr == tokens.cend()) return std::nullopt;
+	// Operators, i.e., defined and __has_include, are replaced before expansion of macros.
+	lex::tokens_t replaced;
+	for (std::size_t i = 0u; i < tokens.size(); ++i) {
+		auto const str = tokens[i].str();
+		if (str != "defined" && str != "__has_include") {
+			replaced.push_back(tokens[i]);
+			continue;
+		}
+		auto const first = i;
+		auto	   depth = 0u;
+		for (; i < tokens.size(); ++i) {
+			if (tokens[i].str() == "(") ++depth;
+			if (tokens[i].str() == ")" && --depth == 0u) break;
+			if (depth == 0u && first < i && tokens[i].type() == lex::preprocessing_token_type_t::identifier) break;
+		}
+		auto const operators = compile_condition(std::span{tokens}.subspan(first, std::min(i + 1u, tokens.size()) - first), true);
+		replaced.push_back(lex::preprocessing_token_t{execute(operators, context)->bits != 0u ? "1" : "0", lex::preprocessing_token_type_t::pp_number});
+	}
+	lex::tokens_t expanded;
+	expander_t{context.macros()}.expand(replaced, 0u, replaced.size(), expanded);
 
-	auto const newline = std::get<lex::whitespace_t>(*newline_itr);
+	tokens.clear();
+	for (auto const& token : expanded) {
+		if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) tokens.push_back(*pp);
+	}
+	auto const value = execute(compile_condition(tokens, true), context);
+	tracer.set_result(value->bits != 0u);
+	return value->bits != 0u;
+}
 
-	auto const result = affamative == defined;
+///	@brief	Parses #if or #elif directive.
+///	@param[in]	directive	Directive.
+///	@param[in]	context		Context.
+///	@return		Result of the condition.
+///	@throw	std::invalid_argument	The condition is invalid.
+inline bool
+parse_if_directive(directive_t const& directive, context_t const& context) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger};
 
+	auto const result = evaluate(directive, context);
 	tracer.set_result(result);
-	return std::make_tuple(result, newline);
+	return result;
 }
-inline std::optional<std::tuple<bool, lex::whitespace_t>>
-parse_if_directive(lex::tokens_t const& tokens, context_t const& context) {
+///	@brief	Parses #ifdef or #ifndef directive.
+///	@param[in]	directive	Directive.
+///	@param[in]	context		Context.
+///	@return		Result of the condition.
+///	@throw	std::invalid_argument	The operand is not an identifier.
+inline bool
+parse_ifdef_directive(directive_t const& directive, context_t const& context) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return std::nullopt;
-
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "if") return std::nullopt;
+	auto const macro   = identifier_operand(directive);
+	auto const defined = context.macros().contains(macro.str());
+	auto const result  = defined != (directive.kind == directive_kind_t::ifndef);
+	tracer.set_result(result);
+	return result;
+}
+///	@brief	Parses #define directive.
+///	@param[in]		directive	Directive.
+///	@param[in,out]	context		Context.
+inline void
+parse_define_directive(directive_t const& directive, context_t& context) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger};
+	using enum macro_t::op_t;
 
-	auto const begin	= next_preprocessing_token(tokens, directive);
-	auto const end_ritr = tokens.crbegin() + 1; // It is always valid because at least above tokens eixst.
-	auto const end		= end_ritr.base();
-	if (begin == tokens.cend()) return std::nullopt;
+	std::vector<lex::preprocessing_token_t> operands;
+	for (auto i = directive.first; i != directive.last; ++i) {
+		if (auto const token = *i; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) operands.push_back(*pp);
+	}
+	auto const name = identifier_operand(directive);
+	if (name.str() == "defined" || name.str() == "__VA_ARGS__" || name.str() == "__VA_OPT__") throw std::invalid_argument("invalid macro name:" + std::string{name.str()});
+
+	// Parameters, which are distinguished from a replacement list by no whitespace between the name and the parenthesis.
+	std::vector<std::string_view> parameters;
+	auto const					  function_like = 1u < operands.size() && operands[1].str() == "(" && is_adjacent(operands[0], operands[1]);
+	auto						  variadic		= false;
+	std::size_t					  i				= 1u;
+	if (function_like) {
+		auto const invalid = [&name] { return std::invalid_argument("invalid macro parameters:" + std::string{name.str()}); };
+		for (++i; i < operands.size() && operands[i].str() != ")"; ++i) {
+			if (! parameters.empty() && (operands[i++].str() != "," || operands.size() <= i)) throw invalid();
+			auto const parameter = operands[i].str();
+			if (parameter == "...") {
+				variadic = true;
+				parameters.push_back("__VA_ARGS__");
+			} else if (operands[i].type() != lex::preprocessing_token_type_t::identifier || parameter == "__VA_ARGS__" || std::ranges::find(parameters, parameter) != parameters.end()) {
+				throw invalid();
+			} else {
+				parameters.push_back(parameter);
+			}
+			if (variadic && i + 1u < operands.size() && operands[i + 1u].str() != ")") throw invalid();
+		}
+		if (operands.size() <= i) throw invalid();
+		++i;
+	}
 
-	auto const newline = std::get<lex::whitespace_t>(*end);
+	// Replacement list.
+	auto const find_parameter = [&parameters](lex::preprocessing_token_t const& token) {
+		return token.type() == lex::preprocessing_token_type_t::identifier ? static_cast<std::size_t>(std::ranges::find(parameters, token.str()) - parameters.begin()) : parameters.size();
+	};
+	auto const invalid = [&name](std::string_view const& what) { return std::invalid_argument(std::string{what} + " in macro:" + std::string{name.str()}); };
+
+	std::vector<macro_t::element_t> replacement;
+	std::optional<std::size_t>		opening; // Index of the __VA_OPT__ element.
+	std::size_t						depth{};  // Depth of parentheses in the __VA_OPT__.
+	for (; i < operands.size(); ++i) {
+		auto const& token = operands[i];
+		auto const	str	  = token.str();
+		if (opening && str == ")" && --depth == 0u) {
+			if (! replacement.empty() && replacement.back().op == paste) throw invalid("'##' at the end of __VA_OPT__");
+			replacement[*opening].index = static_cast<std::uint32_t>(replacement.size() - *opening - 1u);
+			opening.reset();
+		} else if (str == "##" || str == "%:%:") {
+			if (replacement.empty() || replacement.back().op == va_opt || i + 1u == operands.size()) throw invalid("'##' at either end");
+			replacement.push_back({paste, 0u, token});
+		} else if (function_like && (str == "#" || str == "%:")) {
+			if (operands.size() <= i + 1u || parameters.size() <= find_parameter(operands[i + 1u])) throw invalid("'#' without parameter");
+			replacement.push_back({stringize, static_cast<std::uint32_t>(find_parameter(operands[++i])), token});
+		} else if (str == "__VA_OPT__") {
+			if (! variadic || opening || operands.size() <= i + 1u || operands[i + 1u].str() != "(") throw invalid("invalid __VA_OPT__");
+			opening = replacement.size();
+			depth  = 1u;
+			replacement.push_back({macro_t::op_t::va_opt, 0u, token});
+			++i;
+		} else if (auto const index = find_parameter(token); index < parameters.size()) {
+			replacement.push_back({parameter, static_cast<std::uint32_t>(index), token});
+		} else if (str == "__VA_ARGS__") {
+			throw invalid("__VA_ARGS__ without variadic parameter");
+		} else {
+			if (opening && str == "(") ++depth;
+			replacement.push_back({macro_t::op_t::token, 0u, token});
+		}
+	}
+	if (opening) throw invalid("unterminated __VA_OPT__");
+
+	// Operands of ## are replaced by the arguments as is.
+	for (std::size_t k = 0u; k < replacement.size(); ++k) {
+		if (replacement[k].op != parameter) continue;
+		auto prev = k;
+		while (0u < prev && replacement[prev - 1u].op == macro_t::op_t::va_opt) --prev;
+		if ((0u < prev && replacement[prev - 1u].op == paste) || (k + 1u < replacement.size() && replacement[k + 1u].op == paste)) replacement[k].op = raw_parameter;
+	}
 
-	// TODO: apply macros between begin and end.
-	auto const result = evaluate(lex::tokens_t(begin, end), context);
-	if (! result) return std::nullopt;
-	tracer.set_result(*result);
-	return std::make_tuple(*result, newline);
+	auto const macro = context.arena().make(name, function_like, variadic, static_cast<std::uint32_t>(parameters.size()), replacement);
+	context.macros().insert_or_assign(name.str(), macro);
+	tracer.set_result(name.str(), function_like ? "()" : "", "=", replacement.size());
 }
-inline std::optional<std::tuple<bool, lex::whitespace_t>>
-parse_elif_directive(lex::tokens_t const& tokens, context_t const& context) {
+///	@brief	Parses #undef directive.
+///	@param[in]		directive	Directive.
+///	@param[in,out]	context		Context.
+inline void
+parse_undef_directive(directive_t const& directive, context_t& context) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return std::nullopt;
-
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "elif") return std::nullopt;
-	if (context.conditions().empty()) return std::nullopt;
+	auto const macro = identifier_operand(directive);
+	context.macros().erase(macro.str());
+	tracer.set_result(macro.str());
+}
+///	@brief	Table of headers which are guarded against multiple inclusion, which is keyed by identity of the files.
+///		Once a header has been preprocessed, including it again costs a lookup of the table if it is guarded.
+class include_guards_t {
+public:
+	///	@brief	Guard of header.
+	struct guard_t {
+		std::string macro; ///< @brief	Macro of the include guard, or empty if the header has no include guard.
+		bool		once;  ///< @brief	Whether the header has #pragma once or not.
+	};
+
+	///	@brief	Finds the guard of header.
+	///	@param[in]	id	Identity of the header.
+	///	@return		Guard of the header, or std::nullopt if the header has never been preprocessed.
+	std::optional<guard_t> find(util::file_id_t const& id) const {
+		std::shared_lock lock{mutex_};
+		auto const		 found = guards_.find(id);
+		return found == guards_.end() ? std::nullopt : std::optional{found->second};
+	}
+	///	@brief	Records the include guard of header.
+	///	@param[in]	id		Identity of the header.
+	///	@param[in]	macro	Macro of the include guard, or empty if the header has no include guard.
+	void add(util::file_id_t const& id, std::string_view const& macro) {
+		std::unique_lock lock{mutex_};
+		guards_[id].macro = macro;
+	}
+	///	@brief	Records #pragma once of header.
+	///	@param[in]	id		Identity of the header.
+	void add_once(util::file_id_t const& id) {
+		std::unique_lock lock{mutex_};
+		guards_[id].once = true;
+	}
 
-	auto const begin	= next_preprocessing_token(tokens, directive);
-	auto const end_ritr = tokens.crbegin() + 1; // It is always valid because at least above tokens eixst.
-	auto const end		= end_ritr.base();
-	if (begin == tokens.cend()) return std::nullopt;
+	///	@brief	Constructor.
+	include_guards_t() : mutex_{}, guards_{} {}
 
-	auto const newline = std::get<lex::whitespace_t>(*end);
+private:
+	include_guards_t(include_guards_t const&) = delete;
+
+	mutable std::shared_mutex												mutex_;	 ///< @brief	Mutex.
+	std::unordered_map<util::file_id_t, guard_t, util::file_id_hash_t> guards_; ///< @brief	Guards.
+};
+
+///	@brief	Gets the table of include guards of this process.
+///	@return	The table.
+inline include_guards_t&
+include_guards() {
+	static include_guards_t guards;
+	return guards;
+}
 
-	// TODO: apply macros between begin and end.
-	auto const result = evaluate(lex::tokens_t(begin, end), context);
-	if (! result) return std::nullopt;
-	tracer.set_result(*result);
-	return std::make_tuple(*result, newline);
+///	@brief	Detects the include guard, i.e., a conditional group of #ifndef or #if !defined encloses the whole file.
+///	@param[in]	tokens	Tokens of the file.
+///	@return		Macro of the include guard, or std::nullopt if the file is not guarded.
+inline std::optional<std::string_view>
+detect_include_guard(lex::tokens_t const& tokens) {
+	auto const first = tokens.next_preprocessing_token(0u);
+	if (first == tokens.size()) return std::nullopt;
+
+	std::optional<std::string_view> guard;
+	std::size_t						depth{};
+	for (auto i = first; i < tokens.size();) {
+		auto const last = std::min(tokens.next_newline(i) + 1u, tokens.size());
+		if (tokens.is_whitespace(i)) {
+			i = last;
+			continue;
+		}
+		// Nothing can precede nor follow the group.
+		if (depth == 0u && i != first) return std::nullopt;
+
+		using enum directive_kind_t;
+		auto const directive = classify_directive(tokens, i, last);
+		switch (directive.kind) {
+		case if_:
+		case ifdef:
+		case ifndef:
+			if (depth++ != 0u) break;
+			if (directive.kind == ifndef) {
+				guard = identifier_operand(directive).str();
+			} else if (directive.kind == if_) {
+				// #if !defined X, or #if !defined(X)
+				std::vector<lex::preprocessing_token_t> operands;
+				std::for_each(directive.first, directive.last, [&operands](lex::token_t const& token) { operands.push_back(std::get<lex::preprocessing_token_t>(token)); });
+				auto const parenthesized = operands.size() == 5u && operands[2].str() == "(" && operands[4].str() == ")";
+				if ((operands.size() != 3u && ! parenthesized) || operands[0].str() != "!" || operands[1].str() != "defined") return std::nullopt;
+				guard = operands[parenthesized ? 3u : 2u].str();
+			}
+			if (! guard) return std::nullopt;
+			break;
+		case elif:
+		case else_:
+			if (depth == 1u) return std::nullopt;
+			break;
+		case endif:
+			if (depth == 0u) return std::nullopt;
+			--depth;
+			break;
+		default: break;
+		}
+		i = last;
+	}
+	return depth == 0u ? guard : std::nullopt;
 }
-inline std::optional<lex::whitespace_t>
-parse_else_directive(lex::tokens_t const& tokens, context_t const& context) {
+
+///	@brief	Parses #include directive.
+///	@param[in]		directive	Directive.
+///	@param[in,out]	context		Context.
+///	@return		Path of the header.
+///	@throw	std::invalid_argument	The header name is invalid, or the header is not found.
+inline std::filesystem::path
+parse_include_directive(directive_t const& directive, context_t& context) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return std::nullopt;
-
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "else") return std::nullopt;
+	if (directive.first == directive.last) throw std::invalid_argument("no header name");
+	std::vector<lex::preprocessing_token_t> operands;
+	auto const								append = [&operands](lex::token_t const& token) {
+		 if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) operands.push_back(*pp);
+	};
+	if (auto const first = *directive.first; std::holds_alternative<lex::preprocessing_token_t>(first) && std::get<lex::preprocessing_token_t>(first).type() == lex::preprocessing_token_type_t::header_name) {
+		std::for_each(directive.first, directive.last, append);
+	} else {
+		// Operands other than a header name are replaced by macros.
+		lex::tokens_t const operand(directive.first, directive.last);
+		lex::tokens_t		expanded;
+		expander_t{context.macros()}.expand(operand, 0u, operand.size(), expanded);
+		std::ranges::for_each(expanded, append);
+	}
 
-	auto const newline_itr = next_newline(tokens, directive);
-	if (newline_itr == tokens.cend()) return std::nullopt;
-	auto const newline = std::get<lex::whitespace_t>(*newline_itr);
+	std::string header;
+	auto const	angled = ! operands.empty() && operands.front().str().starts_with('<');
+	if (operands.size() == 1u && (operands.front().type() == lex::preprocessing_token_type_t::header_name || operands.front().str().starts_with('"'))) {
+		header = operands.front().str().substr(1u, operands.front().str().size() - 2u);
+	} else if (angled && operands.back().str() == ">") {
+		for (auto const& operand : std::span{operands}.subspan(1u, operands.size() - 2u)) header.append(operand.str());
+	}
+	if (header.empty()) throw std::invalid_argument("invalid header name:" + operands_string(directive));
 
-	tracer.set_result(newline.newlines());
-	return newline;
+	auto const path = find_header(header, angled, context);
+	if (! path) throw std::invalid_argument("header not found:" + header);
+	tracer.set_result(*path);
+	return *path;
 }
-inline std::optional<lex::whitespace_t>
-parse_endif_directive(lex::tokens_t const& tokens, context_t const& context) {
+///	@brief	Parses #line directive.
+///		The operands are only validated, because no presumed line or file name is provided, e.g., as __LINE__.
+///	@param[in]	directive	Directive.
+///	@param[in]	context		Context.
+///	@throw	std::invalid_argument	The operands are not a line number and an optional file name.
+inline void
+parse_line_directive(directive_t const& directive, context_t const& context) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
 
-	auto const pound = next_preprocessing_token(tokens, tokens.cbegin());
-	if (pound == tokens.cend() || std::get<lex::preprocessing_token_t>(*pound).str() != "#") return std::nullopt;
+	if (directive.first == directive.last) throw std::invalid_argument("no line number");
+	// Operands are replaced by macros.
+	lex::tokens_t const						operand(directive.first, directive.last);
+	lex::tokens_t							expanded;
+	std::vector<lex::preprocessing_token_t> operands;
+	expander_t{context.macros()}.expand(operand, 0u, operand.size(), expanded);
+	for (auto const& token : expanded) {
+		if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) operands.push_back(*pp);
+	}
 
-	auto const directive = next_preprocessing_token(tokens, pound);
-	if (directive == tokens.cend() || std::get<lex::preprocessing_token_t>(*directive).str() != "endif") return std::nullopt;
+	constexpr auto const max_line = 2147483647u;
+	auto const			 digits	  = [](std::string_view const& str) { return ! str.empty() && std::ranges::all_of(str, [](auto c) { return '0' <= c && c <= '9'; }); };
+	std::uint_least32_t	 number{};
+	if (operands.empty() || operands.size() > 2u || ! digits(operands.front().str())
+		|| std::from_chars(operands.front().str().data(), operands.front().str().data() + operands.front().str().size(), number, 10).ec != std::errc{}
+		|| number == 0u || max_line < number) {
+		throw std::invalid_argument("invalid line number:" + operands_string(directive));
+	}
+	if (operands.size() == 2u && ! (operands.back().type() == lex::preprocessing_token_type_t::string_literal && operands.back().str().starts_with('"'))) {
+		throw std::invalid_argument("invalid file name:" + operands_string(directive));
+	}
+	tracer.set_result(number);
+}
+///	@brief	Parses #error directive.
+///	@param[in]	directive	Directive.
+///	@throw	std::invalid_argument	It always throws the message.
+[[noreturn]] inline void
+parse_error_directive(directive_t const& directive) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger};
 
-	auto const newline_itr = next_newline(tokens, directive);
-	if (newline_itr == tokens.cend()) return std::nullopt;
-	auto const newline = std::get<lex::whitespace_t>(*newline_itr);
+	throw std::invalid_argument("#error " + operands_string(directive));
+}
+///	@brief	Parses #pragma directive.
+///	@param[in]		directive	Directive.
+///	@param[in,out]	context		Context.
+inline void
+parse_pragma_directive(directive_t const& directive, context_t& context) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger};
 
-	tracer.set_result(newline.newlines());
-	return newline;
+	// Unknown pragmas are ignored.
+	if (operands_string(directive) != "once" || context.sources().empty()) return;
+	if (auto const id = util::file_id(context.sources().top().first)) {
+		context.once().insert(*id);
+		include_guards().add_once(*id);
+	}
 }
 
 using line_t  = lex::tokens_t;
@@ -334,91 +1758,274 @@ inline lines_t
 split_lines(lex::tokens_t const& tokens) {
 	log::logger_t logger;
 	log::tracer_t tracer{logger};
-
-	auto const lines = std::accumulate(tokens.cbegin(), tokens.cend(), lines_t{{}}, [](auto&& lines, auto const& a) {
-		auto const newline = std::holds_alternative<lex::whitespace_t>(a) ? std::get<lex::whitespace_t>(a).newlines() : 0u;
-		lines.back().emplace_back(std::move(a));
-		if (0u < newline) {
-			lines.emplace_back(std::move(lex::tokens_t{}));
+	prof::scope_t scope{prof::phase_t::split};
+
+	// Each line shares the spans of the tokens.
+	lines_t lines;
+	for (auto first = tokens.cbegin();;) {
+		auto const newline = tokens.next_newline(first.index());
+		if (newline == tokens.size()) {
+			lines.emplace_back(first, tokens.cend());
+			break;
 		}
-		return std::move(lines);
-	});
+		auto const last = tokens.cbegin() + newline + 1;
+		lines.emplace_back(first, last);
+		first = last;
+	}
+	scope.add(lines.size());
 	tracer.set_result(lines.size());
 	return lines;
 }
 
-inline std::tuple<lines_t, std::optional<context_t>>
-parse_line(lines_t const& lines, context_t const& context) {
-	log::logger_t logger;
-	log::tracer_t tracer{logger};
+///	@brief	Skips an excluded group up to the directive which may end it.
+///		Only lines beginning with a pound are classified, and nested conditional directives are just counted without evaluation,
+///		so that dead code such as branches for other platforms costs a search of the newlines only.
+///		Deferred text lines are skipped by counting newlines in their raw text, so that they are never tokenized.
+///	@param[in]	tokens	Tokens.
+///	@param[in]	first	Index of the first token of the group.
+///	@return		Result of skipping.
+///		The first of tuple is index of the line of #elif, #else, or #endif which ends or switches the group, or size of the tokens if not found.
+///		The second of tuple is number of the skipped newlines.
+inline std::tuple<std::size_t, std::size_t>
+skip_group(lex::tokens_t const& tokens, std::size_t first) {
+	using enum directive_kind_t;
+	std::size_t nesting{}, newlines{};
+	for (auto pos = first; pos < tokens.size();) {
+		auto const newline = tokens.next_newline(pos);
+		auto const last	   = std::min(newline + 1u, tokens.size());
+		if (pos < newline && ! tokens.is_whitespace(pos) && tokens.type(pos) == lex::preprocessing_token_type_t::preprocessing_op_or_punc) {
+			switch (classify_directive(tokens, pos, last).kind) {
+			case if_:
+			case ifdef:
+			case ifndef: ++nesting; break;
+			case elif:
+			case else_:
+				if (nesting == 0u) return {pos, newlines};
+				break;
+			case endif:
+				if (nesting == 0u) return {pos, newlines};
+				--nesting;
+				break;
+			default: break;
+			}
+		}
+		newlines += tokens.newlines(std::min(newline, tokens.size() - 1u));
+		pos = last;
+	}
+	return {tokens.size(), newlines};
+}
 
-	if (lines.empty()) return {};
-
-	auto const& line			= lines.at(0);
-	auto const	ifdef_directive = parse_ifdef_directive(line, context);
-	auto const	if_directive	= parse_if_directive(line, context);
-	auto const	elif_directive	= parse_elif_directive(line, context);
-	auto const	else_directive	= parse_else_directive(line, context);
-	auto const	endif_directive = parse_endif_directive(line, context);
-
-	std::optional<context_t> _context;
-	lines_t					 unavailables;
-
-	auto const& conditions = context.conditions();
-
-	if (! conditions.empty() && ! conditions.top()) {
-		// here is unavailable.
-		if (endif_directive) {
-			_context = context;
-			_context->conditions().pop();
-		} else if (else_directive || elif_directive) {
-			_context = context;
-			_context->conditions().pop();
-			_context->conditions().push(elif_directive ? std::get<0>(*elif_directive) : true);
+///	@brief	Token sink, which receives the accepted lines in order.
+template<typename T>
+concept token_sink = requires(T& sink, lex::tokens_t const& tokens) { sink(tokens.cbegin(), tokens.cend()); };
+
+///	@brief	Maximum depth of nested #include.
+constexpr std::size_t const max_include_depth = 200u;
+
+template<token_sink Sink>
+void preprocess_file(std::filesystem::path const& path, context_t& context, Sink&& sink);
+
+///	@brief	Preprocesses lines of the tokens (phase 4).
+///		It is a single forward pass with the explicit condition stack in the @p context,
+///		so that its memory is proportional to depth of the nesting instead of length of the tokens.
+///		Accepted lines are emitted to the @p sink as they are, and the other lines are emitted as their newlines only.
+///	@tparam		Sink	Type of @p sink.
+///	@param[in]		tokens	Tokens of a file.
+///	@param[in,out]	context	Context.
+///	@param[in]		sink	Sink of the accepted tokens.
+///	@throw	std::invalid_argument	Conditional directives are not balanced in the file, or a condition is invalid.
+template<token_sink Sink>
+inline void
+preprocess_lines(lex::tokens_t const& tokens, context_t& context, Sink&& sink) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger, tokens.size()};
+	prof::scope_t scope{prof::phase_t::directive}; // Text lines are measured as their own phases.
+
+	auto&	   conditions = context.conditions();
+	auto const depth	  = conditions.size(); // Conditions of the including file are not closed in this file.
+	auto const condition  = [&conditions, depth](std::string_view const& name) -> condition_t& {
+		 if (conditions.size() <= depth) throw std::invalid_argument("#" + std::string{name} + " without #if");
+		 return conditions.top();
+	};
+
+	auto const emit = [&context, &sink](lex::tokens_t const& text, std::size_t first, std::size_t last) {
+		if (expander_t expander{context.macros()}; expander.includes_macro(text, first, last)) {
+			prof::scope_t const expand{prof::phase_t::expand, last - first};
+			lex::tokens_t		expanded;
+			expander.expand(text, first, last, expanded);
+			sink(expanded.cbegin(), expanded.cend());
 		} else {
-			// skips unavailable lines.
-			auto _unavailables = lines | std::views::drop(1) | std::views::drop_while([&context](auto const& a) {
-									 if (a.empty()) return false;
-									 return parse_if_directive(a, context) || parse_else_directive(a, context) || parse_endif_directive(a, context);
-								 })
-							   | std::views::common;
-			unavailables.assign(_unavailables.begin(), _unavailables.end());
+			sink(text.cbegin() + first, text.cbegin() + last);
 		}
-	} else {
-		if (conditions.empty() && (elif_directive || else_directive || endif_directive)) throw std::invalid_argument(std::to_string(__LINE__));
-		if (endif_directive) {
-			_context = context;
-			_context->conditions().pop();
-		} else if (else_directive || elif_directive) {
-			_context = context;
-			_context->conditions().pop();
-			_context->conditions().push(elif_directive ? std::get<0>(*elif_directive) : false);
-		} else if (if_directive || ifdef_directive) {
-			_context = context;
-			_context->conditions().push(if_directive ? std::get<0>(*if_directive) : std::get<0>(*ifdef_directive));
-		} else {
-			// here is other directives or nondirectives.
+	};
+
+	std::size_t emitted{};
+	for (std::size_t first{}; first < tokens.size();) {
+		using enum directive_kind_t;
+		if (depth < conditions.size() && ! conditions.top().active) {
+			// The excluded group is replaced by its newlines at once.
+			auto const [end, newlines] = skip_group(tokens, first);
+			if (0u < newlines) {
+				lex::tokens_t const skipped{lex::whitespace_t{newlines}};
+				sink(skipped.cbegin(), skipped.cend());
+			}
+			if (end == tokens.size()) break;
+			first = end;
 		}
+		auto const newline	 = tokens.next_newline(first);
+		auto const last		 = std::min(newline + 1u, tokens.size());
+		auto const active	 = conditions.size() <= depth || conditions.top().active;
+		auto const directive = classify_directive(tokens, first, last);
+		if (active && directive.kind != non_directive) {
+			// Unmatched quotes are tokens of themselves in directives, which are valid only if the directives are excluded.
+			for (auto i = first; i < last; ++i) {
+				if (tokens.type(i) == lex::preprocessing_token_type_t::unknown) throw std::invalid_argument("invalid preprocessing token:" + std::string{tokens.str(i)});
+			}
+		}
+
+		switch (directive.kind) {
+		case non_directive: {
+			if (tokens.is_deferred(first)) {
+				// Deferred text lines are tokenized at their first use, and they end at the next directive.
+				auto const text = lex::tokenize_deferred(tokens, first);
+				emitted += tokens.newlines(first);
+				emit(*text, 0u, text->size());
+				first = last;
+				continue;
+			}
+			// Text lines up to the next directive are expanded together, because an invocation of macro may span lines.
+			auto end = last;
+			{
+				prof::scope_t split{prof::phase_t::split, 1u};
+				for (++emitted; end < tokens.size(); ++emitted) {
+					auto const following = std::min(tokens.next_newline(end) + 1u, tokens.size());
+					if (classify_directive(tokens, end, following).kind != non_directive) break;
+					end = following;
+					split.add(1u);
+				}
+			}
+			emit(tokens, first, end);
+			first = end;
+			continue;
+		}
+		// -----------------------------------
+		case if_:
+		case ifdef:
+		case ifndef: {
+			auto const result = active && (directive.kind == if_ ? parse_if_directive(directive, context) : parse_ifdef_directive(directive, context));
+			conditions.push({active, result, result, false});
+		} break;
+		case elif: {
+			auto& c = condition("elif");
+			if (c.closed) throw std::invalid_argument("#elif after #else");
+			c.active = c.enclosing && ! c.taken && parse_if_directive(directive, context);
+			c.taken	 = c.taken || c.active;
+		} break;
+		case else_: {
+			auto& c = condition("else");
+			if (c.closed) throw std::invalid_argument("#else after #else");
+			c.active = c.enclosing && ! c.taken;
+			c.taken	 = true;
+			c.closed = true;
+		} break;
+		case endif:
+			condition("endif");
+			conditions.pop();
+			break;
+		// -----------------------------------
+		default:
+			if (! active) break;
+			switch (directive.kind) {
+			case include: preprocess_file(parse_include_directive(directive, context), context, sink); break;
+			case define: parse_define_directive(directive, context); break;
+			case undef: parse_undef_directive(directive, context); break;
+			case line: parse_line_directive(directive, context); break;
+			case error: parse_error_directive(directive);
+			case pragma: parse_pragma_directive(directive, context); break;
+			case unknown: // Extensions such as #warning and #ident are ignored.
+				logger(log::warning_level, "unknown directive is ignored:" + std::string{std::get<lex::preprocessing_token_t>(*directive.name).str()});
+				break;
+			default: break; // null directive
+			}
+			break;
+		}
+		// The directive itself is replaced by its newline.
+		scope.add(1u);
+		if (newline < last) sink(tokens.cbegin() + newline, tokens.cbegin() + last);
+		first = last;
 	}
-	auto const _dropped = lines | std::views::drop(1) | std::views::common;
-	auto const trails	= ! unavailables.empty() ? unavailables : lines_t(_dropped.begin(), _dropped.end());
-	return parse_line(trails, context);
+	if (depth < conditions.size()) throw std::invalid_argument("unterminated conditional directive");
+	tracer.set_result(emitted);
 }
 
-inline std::tuple<lex::tokens_t, std::optional<context_t>>
-preprocess(std::filesystem::path const& path, context_t const& context) {
+///	@brief	Preprocesses the file, which is skipped if it is guarded and has been included.
+///		The include guard of the file is detected at its first preprocessing in this process.
+///	@tparam		Sink	Type of @p sink.
+///	@param[in]		path	Path of the file.
+///	@param[in,out]	context	Context.
+///	@param[in]		sink	Sink of the accepted tokens.
+///	@throw	std::invalid_argument	The file cannot be preprocessed.
+template<token_sink Sink>
+inline void
+preprocess_file(std::filesystem::path const& path, context_t& context, Sink&& sink) {
 	log::logger_t logger;
-	log::tracer_t tracer{logger, path.string()};
+	log::tracer_t tracer{logger, path};
+
+	if (max_include_depth <= context.sources().size()) throw std::invalid_argument("#include nested too deeply:" + path.string());
+	context.depend(path); // A skipped file is still a dependency.
+	auto const id	 = util::file_id(path);
+	auto const guard = id ? include_guards().find(*id) : std::nullopt;
+	if (guard && ((guard->once && context.once().contains(*id)) || (! guard->macro.empty() && context.macros().contains(guard->macro)))) {
+		tracer.set_result("skipped");
+		return;
+	}
 
-	auto const tokens = lex::scan(path);
-	auto const lines  = split_lines(tokens);
-	if (lines.empty()) return {lex::tokens_t{}, std::nullopt};
+	// Tokens of the file are shared by all the translation units.
+	log::span_t const		 span{context.sources().empty() ? "Source" : "Header", path};
+	prof::file_scope_t const profiled{path};
+	auto const				 tokens = (context.directives_only() ? lex::directive_cache() : lex::token_cache()).scan(path);
+	// The file is the current source while preprocessing, e.g., for __has_include.
+	context.sources().emplace(path, tokens);
+	struct pop_t {
+		context_t& context;
+		~pop_t() { context.sources().pop(); }
+	} const pop{context};
+	preprocess_lines(*tokens, context, sink);
+	// Tokens of directives only lose the text outside the guard, so that they cannot tell the guard.
+	if (id && ! guard && ! context.directives_only()) include_guards().add(*id, detect_include_guard(*tokens).value_or(std::string_view{}));
+}
+
+///	@brief	Preprocesses the file.
+///	@param[in]		path	Path of the file.
+///	@param[in,out]	context	Context.
+///	@return		Preprocessed tokens.
+///	@throw	std::invalid_argument	The file cannot be preprocessed.
+inline lex::tokens_t
+preprocess(std::filesystem::path const& path, context_t& context) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger, path};
 
-	auto const [_lines, _context] = parse_line(lines, context);
-	if (_lines.empty()) return {lex::tokens_t{}, std::nullopt};
+	lex::tokens_t preprocessed;
+	preprocess_file(path, context, [&preprocessed](auto first, auto last) { preprocessed.append(first, last); });
+	tracer.set_result(preprocessed.size());
+	return preprocessed;
+}
+
+///	@brief	Scans dependencies of the file, which are the file itself and the included headers.
+///		Only directives of the files are scanned, so that conditions are evaluated and includes are resolved without the text lines.
+///	@param[in]		path	Path of the file.
+///	@param[in,out]	context	Context.
+///	@return		Dependencies in order of their first inclusion.
+///	@throw	std::invalid_argument	The file cannot be preprocessed.
+inline context_t::dependencies_t
+scan_dependencies(std::filesystem::path const& path, context_t& context) {
+	log::logger_t logger;
+	log::tracer_t tracer{logger, path};
 
-	auto const joint = _lines | std::views::join | std::views::common;
-	return {lex::tokens_t(joint.begin(), joint.end()), std::move(_context)};
+	context.directives_only() = true;
+	preprocess_file(path, context, [](auto, auto) {});
+	tracer.set_result(context.dependencies().size());
+	return context.dependencies();
 }
 
 } // namespace xxx::xcp::cpp
@@ -1,3 +1,625 @@
+// ===========================================================================
+/// @file
+/// @brief		Unit tests of the lexical parser.
+/// @author		Mura.
+/// @copyright	(c) 2023-, Mura.
+// ===========================================================================
 
+#include "lexer.hpp"
 
 #include <gtest/gtest.h>
+
+#include <string_view>
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <random>
+#include <ranges>
+#include <regex>
+#include <string>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <malloc.h>
+#endif
+
+// ===========================================================================
+namespace {
+
+/// @brief	Number of allocations by the global operator new.
+std::atomic<std::size_t> allocations{};
+
+/// @brief	Allocates memory by the global operator new, which counts the allocations.
+///		Every allocation is aligned, so that all the forms of operator delete release it in the same way.
+/// @param[in]	size		Size in bytes.
+/// @param[in]	alignment	Alignment.
+/// @return		Allocated memory.
+void*
+allocate(std::size_t size, std::align_val_t alignment = std::align_val_t{alignof(std::max_align_t)}) {
+	allocations.fetch_add(1u, std::memory_order_relaxed);
+	auto const a = std::max(static_cast<std::size_t>(alignment), alignof(std::max_align_t));
+	auto const n = (std::max(size, std::size_t{1u}) + a - 1u) / a * a;
+#if defined(_MSC_VER)
+	if (auto const p = ::_aligned_malloc(n, a)) return p;
+#else
+	if (auto const p = std::aligned_alloc(a, n)) return p;
+#endif
+	throw std::bad_alloc{};
+}
+/// @brief	Deallocates memory by the global operator delete.
+/// @param[in]	p	Memory allocated by @ref allocate.
+void
+deallocate(void* p) noexcept {
+#if defined(_MSC_VER)
+	::_aligned_free(p);
+#else
+	std::free(p);
+#endif
+}
+
+} // namespace
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+void* operator new(std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void* operator new[](std::size_t size, std::align_val_t alignment) { return allocate(size, alignment); }
+void  operator delete(void* p) noexcept { deallocate(p); }
+void  operator delete[](void* p) noexcept { deallocate(p); }
+void  operator delete(void* p, std::size_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::size_t) noexcept { deallocate(p); }
+void  operator delete(void* p, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete(void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+void  operator delete[](void* p, std::size_t, std::align_val_t) noexcept { deallocate(p); }
+
+// ===========================================================================
+namespace {
+
+using xxx::xcp::lex::preprocessing_token_type_t;
+
+// -----------------------------------
+// reference rules, which are the former regex rules of the lexer.
+
+std::regex const string_literal_re{R"(^((?:u8?|[UL])?"(?:[^'\r\n]|\\['"?\abfnrtv]|\\u[0-9a-fA-f]{4}|\\U[0-9a-fA-f]{8})*"\w*).*)"};
+std::regex const character_literal_re{R"(^((?:u8?|[UL])?'(?:[^'\r\n]|\\['"?\abfnrtv]|\\u[0-9a-fA-f]{4}|\\U[0-9a-fA-f]{8})+'\w*).*)"};
+std::regex const header_name_re{R"(^(<[^>\r\n]+>).*)"};
+std::regex const pp_number_re{R"(^([.]?\d+(?:'\w*|[eEpP][-+]|[.])?).*)"};
+std::regex const identifier_re{R"(^([a-zA-Z_]\w*).*)"};
+std::regex const preprocessing_op_or_punc_re{
+	"^("
+	R"([.]{3}|(?:%:){1,2})"
+	R"(|\[|\]|(?:[.]|->)[*]?)"
+	R"(|&&?|-[-=]?|\+[+=]?|##?|::?|\|\|?)"
+	R"(|<[:%]|[:%]>)"
+	R"(|>>?=?|<<?=?)"
+	R"(|[*/%^&|~!=]=?)"
+	R"(|[{}();?,])"
+	").*"};
+
+/// @brief	Scans a preprocessing token using the reference rules.
+std::tuple<std::size_t, preprocessing_token_type_t>
+reference_scan(std::string_view const& str) {
+	using enum preprocessing_token_type_t;
+	std::vector<std::tuple<std::regex const*, preprocessing_token_type_t>> const rules{
+		{&string_literal_re, string_literal},
+		{&character_literal_re, character_literal},
+		{&header_name_re, header_name},
+		{&pp_number_re, pp_number},
+		{&identifier_re, identifier},
+		{&preprocessing_op_or_punc_re, preprocessing_op_or_punc},
+	};
+	for (auto const& [re, type] : rules) {
+		if (xxx::svmatch r; std::regex_match(str.cbegin(), str.cend(), r, *re)) return {r.str(1).size(), type};
+	}
+	return {0u, unknown};
+}
+
+} // namespace
+
+// ===========================================================================
+
+TEST(lexer, scan_preprocessing_token_agrees_with_reference_rules) {
+	std::vector<std::string_view> const corpus{
+		// string literals
+		R"("")",
+		R"("abc" + x)",
+		R"(u8"abc";)",
+		R"(u"abc")",
+		R"(U"abc")",
+		R"(L"abc")",
+		R"("a\"b")",
+		R"("abc"_udl)",
+		// character literals
+		R"('a')",
+		R"('\n',)",
+		R"(u8'a')",
+		R"(L'a')",
+		R"('é')",
+		// header names
+		R"(<vector>)",
+		R"(<sys/types.h> x)",
+		// pp-numbers
+		R"(0)",
+		R"(42;)",
+		R"(.5)",
+		R"(1e+)",
+		// identifiers
+		R"(a)",
+		R"(_abc123 = 0)",
+		R"(u8)",
+		R"(L)",
+		R"(include)",
+		// preprocessing operators and punctuators
+		R"(...)",
+		R"(%:%:)",
+		R"(%:)",
+		R"([)",
+		R"(])",
+		R"(.*)",
+		R"(->*)",
+		R"(->)",
+		R"(.)",
+		R"(&&)",
+		R"(--)",
+		R"(-=)",
+		R"(++)",
+		R"(+=)",
+		R"(##)",
+		R"(#)",
+		R"(::)",
+		R"(||)",
+		R"(<:)",
+		R"(<%)",
+		R"(%>)",
+		R"(>>=)",
+		R"(<<=)",
+		R"(>>)",
+		R"(<<)",
+		R"(>=)",
+		R"(<=)",
+		R"(*=)",
+		R"(/=)",
+		R"(%=)",
+		R"(^=)",
+		R"(!=)",
+		R"(==)",
+		R"(=)",
+		R"(!)",
+		R"({)",
+		R"(})",
+		R"(()",
+		R"())",
+		R"(;)",
+		R"(?)",
+		R"(,)",
+		// invalid
+		R"(@)",
+		R"($)",
+		R"("abc)",
+	};
+	for (auto const& s : corpus) {
+		auto const accepts_header_name = s.starts_with('<') && s.find('>') != std::string_view::npos;
+		EXPECT_EQ(reference_scan(s), xxx::xcp::lex::scan_preprocessing_token(s, accepts_header_name)) << s;
+	}
+}
+
+TEST(lexer, scan_preprocessing_token_follows_standard) {
+	using enum preprocessing_token_type_t;
+	using xxx::xcp::lex::scan_preprocessing_token;
+	using result_t = std::tuple<std::size_t, preprocessing_token_type_t>;
+
+	// The reference rules differ from the standard in the following cases.
+	EXPECT_EQ((result_t{3u, string_literal}), scan_preprocessing_token(R"("a" + "b")"));
+	EXPECT_EQ((result_t{6u, string_literal}), scan_preprocessing_token(R"("it's")"));
+	EXPECT_EQ((result_t{11u, string_literal}), scan_preprocessing_token(R"--(R"x(a)"b)x")--"));
+	EXPECT_EQ((result_t{8u, pp_number}), scan_preprocessing_token("1.5e+10f;"));
+	EXPECT_EQ((result_t{6u, pp_number}), scan_preprocessing_token("0x1p-3;"));
+	EXPECT_EQ((result_t{9u, pp_number}), scan_preprocessing_token("1'000'000"));
+	EXPECT_EQ((result_t{13u, identifier}), scan_preprocessing_token(R"(caf\U000000E9 )"));
+	EXPECT_EQ((result_t{2u, preprocessing_op_or_punc}), scan_preprocessing_token("&="));
+	EXPECT_EQ((result_t{2u, preprocessing_op_or_punc}), scan_preprocessing_token("|="));
+	EXPECT_EQ((result_t{2u, preprocessing_op_or_punc}), scan_preprocessing_token(":>"));
+	EXPECT_EQ((result_t{3u, preprocessing_op_or_punc}), scan_preprocessing_token("<=>"));
+	EXPECT_EQ((result_t{1u, preprocessing_op_or_punc}), scan_preprocessing_token("<::x"));
+	EXPECT_EQ((result_t{2u, preprocessing_op_or_punc}), scan_preprocessing_token("<:::"));
+	EXPECT_EQ((result_t{1u, preprocessing_op_or_punc}), scan_preprocessing_token("~="));
+	// The header name is recognized only if it is acceptable.
+	EXPECT_EQ((result_t{1u, preprocessing_op_or_punc}), scan_preprocessing_token("<vector>"));
+	EXPECT_EQ(header_name, std::get<xxx::xcp::lex::preprocessing_token_t>(xxx::xcp::lex::tokenize("%:include <a b.h>\n").at(2u)).type());
+	EXPECT_EQ((result_t{0u, unknown}), scan_preprocessing_token("''"));
+}
+
+TEST(lexer, tokenize_splits_tokens_and_newlines) {
+	using namespace xxx::xcp::lex;
+	auto const tokens = tokenize("#include <vector>\r\nint a = b<c>d; // comment\n/* multiple\nlines */ char c = 'x';\n");
+
+	std::vector<std::string_view> strs;
+	std::vector<std::size_t>	  newlines;
+	for (auto const& token : tokens) {
+		if (auto const pp = std::get_if<preprocessing_token_t>(&token)) {
+			strs.push_back(pp->str());
+		} else {
+			newlines.push_back(std::get<whitespace_t>(token).newlines());
+		}
+	}
+	std::vector<std::string_view> const expected{"#", "include", "<vector>", "int", "a", "=", "b", "<", "c", ">", "d", ";", "char", "c", "=", "'x'", ";"};
+	EXPECT_EQ(expected, strs);
+	EXPECT_EQ((std::vector<std::size_t>{1u, 2u, 1u}), newlines);
+	EXPECT_EQ(preprocessing_token_type_t::header_name, std::get<preprocessing_token_t>(tokens.at(2)).type());
+	EXPECT_EQ(preprocessing_token_type_t::character_literal, std::get<preprocessing_token_t>(tokens.at(tokens.size() - 3u)).type());
+
+	EXPECT_THROW(tokenize("a\rb\n"), std::invalid_argument);
+	EXPECT_THROW(tokenize("/* unterminated\n"), std::invalid_argument);
+}
+
+TEST(lexer, tokenize_allocates_constant_times_per_file) {
+	auto const generate = [](std::size_t lines) {
+		std::string source;
+		for (std::size_t i = 0; i < lines; ++i) source += "int a = b + 1; // c\n";
+		return source;
+	};
+	auto const count = [](std::string const& source) {
+		auto const before = allocations.load();
+		auto const tokens = xxx::xcp::lex::tokenize(source);
+		return std::tuple{allocations.load() - before, tokens.size()};
+	};
+	auto const small = generate(100u);
+	auto const large = generate(100'000u);
+
+	auto const [small_allocations, small_tokens] = count(small);
+	auto const [large_allocations, large_tokens] = count(large);
+	EXPECT_EQ(small_tokens * 1000u, large_tokens);
+	// Only the geometric growth of the four columns depends on the size of the file.
+	EXPECT_LE(large_allocations, small_allocations + 4u * 16u);
+}
+
+TEST(lexer, tokens_refer_into_shared_source) {
+	using namespace xxx::xcp::lex;
+	auto const source = source_manager().add("test.cpp", "auto const a_very_long_identifier_name = another_very_long_identifier_name;\n");
+	auto const tokens = tokenize(source->text());
+
+	auto const			  before = allocations.load();
+	tokens_t const		  copied = tokens;
+	preprocessing_token_t token	 = std::get<preprocessing_token_t>(copied.at(2));
+	EXPECT_EQ(4u, allocations.load() - before); // Only the columns are allocated.
+
+	auto const text = source->text();
+	for (auto const& t : copied) {
+		if (auto const pp = std::get_if<preprocessing_token_t>(&t)) {
+			EXPECT_TRUE(text.data() <= pp->str().data() && pp->str().data() + pp->str().size() <= text.data() + text.size());
+		}
+	}
+	EXPECT_EQ("a_very_long_identifier_name", token.str());
+	EXPECT_EQ("a_very_long_identifier_name", source_manager().intern(std::string{token.str()}));
+}
+
+TEST(lexer, tokens_are_stored_as_columns) {
+	using namespace xxx::xcp::lex;
+	static_assert(std::random_access_iterator<tokens_t::const_iterator>);
+
+	auto const tokens = tokenize("#if A\n\n  x y\n#endif\n");
+	ASSERT_EQ(10u, tokens.size());
+	EXPECT_EQ(3u, tokens.next_newline(0u));
+	EXPECT_EQ(2u, tokens.newlines(3u));
+	EXPECT_EQ(4u, tokens.next_preprocessing_token(3u));
+	EXPECT_EQ("x", tokens.str(4u));
+	EXPECT_EQ(tokens.size(), tokens.next_newline(10u));
+
+	// A sub-range shares the spans with the original tokens.
+	tokens_t const line(tokens.cbegin() + 4, tokens.cbegin() + 7);
+	ASSERT_EQ(3u, line.size());
+	EXPECT_EQ(tokens.str(5u).data(), line.str(1u).data());
+	EXPECT_EQ(1u, std::get<whitespace_t>(line.back()).newlines());
+
+	// Tokens referring into other strings are also acceptable.
+	tokens_t joint{preprocessing_token_t{"__cplusplus", preprocessing_token_type_t::identifier}, whitespace_t{1u}};
+	joint.append(line.cbegin(), line.cend());
+	ASSERT_EQ(5u, joint.size());
+	EXPECT_EQ("__cplusplus", joint.str(0u));
+	EXPECT_EQ("y", std::get<preprocessing_token_t>(joint[3u]).str());
+	EXPECT_EQ(preprocessing_token_type_t::identifier, joint.type(3u));
+	EXPECT_EQ(0u, joint.newlines(2u));
+}
+
+TEST(lexer, scan_whitespaces_skips_blocks) {
+	using xxx::xcp::lex::scan_whitespaces;
+	using result_t = std::tuple<std::size_t, std::size_t>;
+
+	// The constant evaluation does not use the SIMD kernels, so both must agree.
+	constexpr std::string_view text{"    \t\t  // a line comment which is longer than a block\r\n  /* a block\n comment * / *\n*/\n\n\t x"};
+	constexpr auto			   expected = scan_whitespaces(text);
+	static_assert(std::get<1>(expected) == 5u);
+	EXPECT_EQ(expected, scan_whitespaces(text));
+	EXPECT_EQ((result_t{text.size() - 1u, 5u}), scan_whitespaces(text));
+
+	std::string const blanks(100u, ' ');
+	EXPECT_EQ((result_t{100u, 0u}), scan_whitespaces(blanks + "x"));
+	EXPECT_EQ((result_t{105u, 0u}), scan_whitespaces("/*" + blanks + "**/x"));
+	EXPECT_EQ((result_t{102u, 0u}), scan_whitespaces("//" + blanks));
+	EXPECT_THROW(scan_whitespaces("/*" + blanks + "*"), std::invalid_argument);
+}
+
+TEST(lexer, escape_non_basic_source_character_set_streams_utf8) {
+	using xxx::xcp::lex::escape_non_basic_source_character_set;
+	EXPECT_EQ(R"(a\U000000E9\U00000024 \U0001F600)", escape_non_basic_source_character_set(std::string_view{"a\xC3\xA9$ \xF0\x9F\x98\x80"}));
+	EXPECT_THROW(escape_non_basic_source_character_set(std::string_view{"abc\xC3"}), std::invalid_argument);
+
+	// The streaming pass agrees with the round trip through UTF-32 string.
+	std::vector<std::string_view> const pieces{"int", " ", "\n", "\t", "$", "@", "`", "\x7F", "\x01", "\xC3\xA9", "\xE3\x81\x82", "\xF0\x9F\x98\x80", "/* comment */"};
+	std::mt19937								random{42u};
+	std::uniform_int_distribution<std::size_t>	piece{0u, pieces.size() - 1u}, length{0u, 200u};
+	for (int i = 0; i < 1000; ++i) {
+		std::string str;
+		for (auto n = length(random); 0u < n; --n) str += pieces[piece(random)];
+		EXPECT_EQ(escape_non_basic_source_character_set(xxx::uc::to_32string(str)), escape_non_basic_source_character_set(std::string_view{str})) << str;
+	}
+}
+
+TEST(lexer, scan_refers_into_file_if_phases_change_nothing) {
+	using namespace xxx::xcp::lex;
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_scan.cpp";
+	auto const scan_file = [&path](std::string_view const& contents) {
+		std::ofstream{path, std::ios::binary} << contents;
+		return scan(path);
+	};
+
+	auto const logical = scan_file("int a = 1;\n");
+	ASSERT_EQ(6u, logical.size());
+	EXPECT_EQ("a", logical.str(1u));
+	auto const physical = scan_file("\xEF\xBB\xBFint \\\na = \xC3\xA9;");
+	ASSERT_EQ(6u, physical.size());
+	EXPECT_EQ("a", physical.str(1u));
+	EXPECT_EQ(R"(\U000000E9)", physical.str(3u));
+	std::filesystem::remove(path);
+}
+
+TEST(lexer, splice_lines_records_physical_positions) {
+	using namespace xxx::xcp::lex;
+	EXPECT_EQ(std::string_view::npos, find_splice("a \\ b\n"));
+	EXPECT_EQ(2u, find_splice("a \\\r\nb\n"));
+
+	auto [text, splices] = splice_lines("#define A \\\n  1 + \\\r\n  2\nint a = A;\\\n");
+	EXPECT_EQ("#define A   1 +   2\nint a = A;\n", text);
+	ASSERT_EQ(3u, splices.size());
+	EXPECT_EQ(10u, splices[0].logical);
+	EXPECT_EQ(1u, splices[0].line);
+	EXPECT_EQ(16u, splices[1].logical);
+	EXPECT_EQ(2u, splices[1].line);
+	EXPECT_EQ(4u, splices[2].line);
+
+	auto const source = source_manager().add("splice.cpp", std::move(text), std::move(splices));
+	using position_t  = std::tuple<std::size_t, std::size_t>;
+	EXPECT_EQ((position_t{1u, 1u}), source->position(0u));
+	EXPECT_EQ((position_t{2u, 3u}), source->position(source->text().find('1')));
+	EXPECT_EQ((position_t{3u, 3u}), source->position(source->text().find('2')));
+	EXPECT_EQ((position_t{4u, 5u}), source->position(source->text().substr(source->text().find("a ="), 1u)));
+
+	// Nothing is spliced, so that no splice is recorded.
+	auto const [plain, none] = splice_lines("int a;");
+	EXPECT_EQ("int a;\n", plain);
+	EXPECT_TRUE(none.empty());
+}
+
+TEST(lexer, token_cache_shares_tokens_until_file_changes) {
+	using namespace xxx::xcp::lex;
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_token_cache.h";
+	std::ofstream{path} << "int a;\n";
+
+	token_cache_t cache;
+	auto const first = cache.scan(path);
+	EXPECT_EQ(first, cache.scan(path));
+	EXPECT_EQ(1u, cache.hits());
+	EXPECT_EQ(1u, cache.misses());
+
+	// Modified file is scanned again.
+	std::ofstream{path} << "int a, b;\n";
+	auto const second = cache.scan(path);
+	EXPECT_NE(first, second);
+	EXPECT_EQ(6u, second->size());
+	EXPECT_EQ(1u, cache.size());
+
+	// Parallel lookups share the entry.
+	std::vector<tokens_ptr_t> found(64u);
+	xxx::util::parallel_for(found.size(), 8u, [&](std::size_t i) { found[i] = cache.scan(path); });
+	EXPECT_TRUE(std::ranges::all_of(found, [&second](auto const& tokens) { return tokens == second; }));
+	std::filesystem::remove(path);
+}
+
+TEST(lexer, token_cache_evicts_least_recently_used) {
+	using namespace xxx::xcp::lex;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_token_cache";
+	std::filesystem::create_directories(directory);
+
+	// Budget fits a file per shard, so that the older entry in the same shard is evicted.
+	token_cache_t					   cache{token_cache_t::shard_count * 200u};
+	std::vector<std::filesystem::path> paths;
+	for (auto i = 0; i < 64; ++i) {
+		paths.push_back(directory / (std::to_string(i) + ".h"));
+		std::ofstream{paths.back()} << "int a" << i << ";\n";
+		cache.scan(paths.back());
+	}
+	EXPECT_GT(64u, cache.size());
+	EXPECT_LE(1u, cache.size());
+	std::filesystem::remove_all(directory);
+}
+
+TEST(lexer, token_cache_frees_sources_of_evicted_entries) {
+	using namespace xxx::xcp::lex;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_token_cache_sources";
+	std::filesystem::create_directories(directory);
+	auto const source_of = [](tokens_ptr_t const& tokens) { return std::get<preprocessing_token_t>(tokens->at(0)).source()->weak_from_this(); };
+
+	// Budget fits no file, so that only the last entry of each shard is kept.
+	token_cache_t				  cache{token_cache_t::shard_count};
+	std::weak_ptr<source_t const> evicted;
+	tokens_ptr_t				  held;
+	for (auto i = 0; i < 256; ++i) {
+		auto const path = directory / (std::to_string(i) + ".h");
+		std::ofstream{path} << "int a" << i << ";\n";
+		auto const tokens = cache.scan(path);
+		if (i == 0) evicted = source_of(tokens);
+		if (i == 1) held = tokens;
+	}
+	auto const kept = source_of(held);
+	EXPECT_GE(token_cache_t::shard_count, cache.size());
+	EXPECT_TRUE(evicted.expired());
+	EXPECT_FALSE(kept.expired()); // Tokens in use keep their source.
+	held.reset();
+	EXPECT_TRUE(kept.expired());
+	std::filesystem::remove_all(directory);
+}
+
+TEST(lexer, token_cache_charges_deferred_text_lines) {
+	using namespace xxx::xcp::lex;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_token_cache_deferred";
+	std::filesystem::create_directories(directory);
+	auto const shard_of = [](std::filesystem::path const& path) { return xxx::util::file_id_hash_t{}(xxx::util::file_stamp(path)->id) % token_cache_t::shard_count; };
+
+	// Two files in the same shard, whose budget fits both until the text lines of the larger are tokenized.
+	auto const large = directory / "large.h";
+	std::ofstream{large} << [] {
+		std::string text;
+		for (auto i = 0; i < 1000; ++i) text.append("a ");
+		return text + "\n";
+	}();
+	std::filesystem::path small;
+	for (auto i = 0; small.empty(); ++i) {
+		auto const path = directory / (std::to_string(i) + ".h");
+		std::ofstream{path} << "int a;\n";
+		if (shard_of(path) == shard_of(large)) small = path;
+	}
+	auto const scanner = [](std::filesystem::path const& path) { return scan(path, true); };
+
+	token_cache_t kept{token_cache_t::shard_count * 8000u, scanner};
+	kept.scan(large);
+	kept.scan(small);
+	EXPECT_EQ(2u, kept.size());
+
+	token_cache_t evicted{token_cache_t::shard_count * 8000u, scanner};
+	tokenize_deferred(*evicted.scan(large), 0u);
+	evicted.scan(small);
+	EXPECT_EQ(1u, evicted.size());
+	std::filesystem::remove_all(directory);
+}
+
+TEST(lexer, token_store_loads_entry_instead_of_scanning) {
+	using namespace xxx::xcp::lex;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_token_store";
+	auto const path		 = std::filesystem::temp_directory_path() / "xcp_ut_token_store.h";
+	std::filesystem::remove_all(directory);
+	std::ofstream{path} << "#define A \\\n  1\nint \xC3\xA9 = A;\n";
+
+	token_store_t const store{directory};
+	auto const			scanned = store.scan(path);
+	auto const			entries = std::distance(std::filesystem::directory_iterator{directory}, std::filesystem::directory_iterator{});
+	ASSERT_EQ(1, entries);
+
+	auto const loaded = store.scan(path);
+	ASSERT_EQ(scanned.size(), loaded.size());
+	for (std::size_t i{}; i < scanned.size(); ++i) {
+		EXPECT_EQ(scanned.str(i), loaded.str(i));
+		EXPECT_EQ(scanned.newlines(i), loaded.newlines(i));
+	}
+	// The loaded tokens refer into another source, which keeps the splices.
+	auto const token = std::get<preprocessing_token_t>(loaded[loaded.size() - 3u]);
+	EXPECT_NE(std::get<preprocessing_token_t>(scanned[scanned.size() - 3u]).source(), token.source());
+	EXPECT_EQ((std::tuple<std::size_t, std::size_t>{3u, 18u}), token.source()->position(token.str()));
+
+	// A broken entry is ignored, and then it is saved again.
+	auto const entry = std::filesystem::directory_iterator{directory}->path();
+	std::ofstream{entry, std::ios::binary | std::ios::trunc} << "XCPT";
+	EXPECT_EQ(scanned.size(), store.scan(path).size());
+	EXPECT_LT(4u, std::filesystem::file_size(entry));
+
+	// Deferred text lines are stored apart, and they are tokenized after loading.
+	store.scan(path, true);
+	auto const lazily = store.scan(path, true);
+	EXPECT_EQ(2, std::distance(std::filesystem::directory_iterator{directory}, std::filesystem::directory_iterator{}));
+	ASSERT_TRUE(lazily.is_deferred(lazily.size() - 1u));
+	auto const text = tokenize_deferred(lazily, lazily.size() - 1u);
+	ASSERT_GT(scanned.size(), text->size());
+	for (std::size_t i{}, offset = scanned.size() - text->size(); i < text->size(); ++i) {
+		EXPECT_EQ(scanned.str(offset + i), text->str(i));
+		EXPECT_EQ(scanned.newlines(offset + i), text->newlines(i));
+	}
+
+	std::filesystem::remove_all(directory);
+	std::filesystem::remove(path);
+}
+
+TEST(lexer, minimize_directives_keeps_directive_lines_only) {
+	using namespace xxx::xcp::lex;
+	EXPECT_EQ("#include <a>\n\n  # define A \\\n  1\n", minimize_directives("#include <a>\nint a;\n  # define A \\\n  1\n"));
+	// Directives in comments and literals are not directives.
+	EXPECT_EQ("\n\n\n#if B\n", minimize_directives("/*\n#include <b> */ a\n\"\\\"#x\" \n#if B\n"));
+	EXPECT_EQ("\n\n\n%:endif\n", minimize_directives("R\"x(\n#endif\n)x\";\n%:endif\n"));
+	EXPECT_EQ("\n\n#else\n", minimize_directives("// comment \\\n#error\n#else\n"));
+	// Comments before the pound are skipped as blanks.
+	EXPECT_EQ("/* c */ #include <a.h>\n/* d\n */ %:if D\n\n", minimize_directives("/* c */ #include <a.h>\n/* d\n */ %:if D\n/* e */ f\n"));
+	// A digit separator is not a character literal.
+	EXPECT_EQ("\n#define C '\\n'\n", minimize_directives("int c = 1'000'000;\n#define C '\\n'\n"));
+	// Splices in text lines keep their newlines.
+	EXPECT_EQ("\n\n#endif", minimize_directives("a \\\nb\n#endif"));
+}
+
+TEST(lexer, scan_directives_charges_minimization_by_bytes) {
+	using namespace xxx::xcp::lex;
+	auto const path		= std::filesystem::temp_directory_path() / "xcp_ut_minimize.cpp";
+	auto const contents = std::string{"#include <a>\nint a;\n#define A 1\n"};
+	std::ofstream{path, std::ios::binary} << contents;
+	scan_directives(path);
+	auto const profile = xxx::prof::collect();
+	ASSERT_TRUE(profile.files.contains(path.string()));
+	auto const& counters = profile.files.at(path.string());
+	EXPECT_EQ(1u, counters[xxx::prof::phase_t::minimize].calls);
+	EXPECT_EQ(contents.size(), counters[xxx::prof::phase_t::minimize].amount);
+	std::filesystem::remove(path);
+}
+
+TEST(lexer, tokenize_lazily_defers_text_lines) {
+	using namespace xxx::xcp::lex;
+	auto const render = [](tokens_t const& tokens) {
+		std::string str;
+		for (std::size_t i{}; i < tokens.size(); ++i) str.append(tokens.is_whitespace(i) ? std::to_string(tokens.newlines(i)) : tokens.str(i)).append(" ");
+		return str;
+	};
+	auto const expand = [&render](tokens_t const& tokens) {
+		std::string str;
+		for (std::size_t i{}; i < tokens.size(); ++i) str.append(tokens.is_deferred(i) ? render(*tokenize_deferred(tokens, i)) : render(tokens_t{tokens.cbegin() + i, tokens.cbegin() + i + 1}));
+		return str;
+	};
+	for (auto const& text : {
+			 "a\n",
+			 "\n  #include <a.h>\n\n  int a;\n\nb\n# define X 1\n",
+			 "#if 0 /* c\n */ x\nint b = '#';\n/* #endif\n*/ c /* \n */ #endif\n",
+			 "char const* s = R\"x(\n#endif\n)x\";\n%:endif\n// c\n#else\n",
+			 "a\n#include <a b.h>\nb\n%:include <c d.h>\n",
+		 }) {
+		auto const source = source_manager().add("xcp_ut_lazily.cpp", std::string{text});
+		auto const lazily = tokenize_lazily(source);
+		EXPECT_EQ(render(tokenize(source)), expand(lazily)) << text;
+		EXPECT_TRUE(std::ranges::any_of(std::views::iota(std::size_t{}, lazily.size()), [&lazily](auto i) { return lazily.is_deferred(i); })) << text;
+	}
+
+	// Text lines up to the next directive are a deferred token, which keeps their newlines.
+	auto const tokens = tokenize_lazily(source_manager().add("xcp_ut_lazily.cpp", "a\n\nb\n#if A\n`c\nd\n#endif\n"));
+	ASSERT_EQ(9u, tokens.size());
+	EXPECT_TRUE(tokens.is_deferred(0u));
+	EXPECT_EQ(3u, tokens.newlines(0u));
+	EXPECT_EQ(4u, tokens.next_newline(1u));
+	EXPECT_TRUE(tokens.is_deferred(5u));
+	EXPECT_EQ(0u, tokens.deferred_size());
+
+	// Deferred tokens are tokenized once, and shared by copies.
+	tokens_t const copied(tokens.cbegin(), tokens.cend());
+	EXPECT_EQ(tokenize_deferred(tokens, 0u), tokenize_deferred(copied, 0u));
+	EXPECT_EQ(4u * (sizeof(tokens_t::kind_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) * 2u), copied.deferred_size());
+	EXPECT_THROW(tokenize_deferred(tokens, 5u), std::invalid_argument);
+}
@@ -0,0 +1,566 @@
+// ===========================================================================
+/// @file
+/// @brief		Unit tests of the preprocessor.
+/// @author		Mura.
+/// @copyright	(c) 2023-, Mura.
+// ===========================================================================
+
+#include "preprocessor.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// ===========================================================================
+namespace {
+
+/// @brief	Preprocesses the text, and gets strings of the accepted preprocessing tokens.
+std::vector<std::string_view>
+preprocess_text(std::string_view const& text) {
+	using namespace xxx::xcp;
+	auto const					  tokens = lex::tokenize(text);
+	cpp::context_t				  context;
+	std::vector<std::string_view> strs;
+	cpp::preprocess_lines(tokens, context, [&strs](auto first, auto last) {
+		for (; first != last; ++first) {
+			if (auto const token = *first; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) strs.push_back(pp->str());
+		}
+	});
+	return strs;
+}
+
+/// @brief	Preprocesses the text, and gets the accepted preprocessing tokens separated by a space.
+std::string
+preprocess_joined(std::string_view const& text) {
+	std::string str;
+	for (auto const& s : preprocess_text(text)) str.append(str.empty() ? "" : " ").append(s);
+	return str;
+}
+
+/// @brief	Memory resource which counts the peak of the allocated bytes.
+class peak_resource_t : public std::pmr::memory_resource {
+public:
+	std::size_t peak{};	   ///< @brief	Peak of the allocated bytes.
+	std::size_t current{}; ///< @brief	Allocated bytes.
+
+private:
+	void* do_allocate(std::size_t bytes, std::size_t alignment) override {
+		peak = std::max(peak, current += bytes);
+		return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+	}
+	void do_deallocate(void* p, std::size_t bytes, std::size_t alignment) override {
+		current -= bytes;
+		std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+	}
+	bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override { return this == &other; }
+};
+
+} // namespace
+
+// ===========================================================================
+
+TEST(preprocessor, preprocess_lines_selects_groups) {
+	EXPECT_EQ((std::vector<std::string_view>{"a", "c", "f", "h"}), preprocess_text(R"(a
+#ifdef __cplusplus
+c
+#  ifndef __cplusplus
+d
+#  else
+f
+#  endif
+#else
+g
+#endif
+#ifdef UNDEFINED
+#elif 1
+h
+#else
+i
+#endif
+)"));
+	// Groups in a skipped group are never taken.
+	EXPECT_EQ((std::vector<std::string_view>{"z"}), preprocess_text("#ifdef UNDEFINED\n#if 1\na\n#else\nb\n#endif\n#else\nz\n#endif\n"));
+	// The null directive and the directives are replaced by their newlines.
+	EXPECT_EQ((std::vector<std::string_view>{"x"}), preprocess_text("#\n#ifdef _XCP_VER\nx\n#endif\n"));
+}
+
+TEST(preprocessor, preprocess_lines_rejects_unbalanced_conditions) {
+	EXPECT_THROW(preprocess_text("#ifdef A\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#endif\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#else\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#ifdef A\n#else\n#elif 1\n#endif\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#ifdef A\n#else\n#else\n#endif\n"), std::invalid_argument);
+}
+
+TEST(preprocessor, classify_directive_dispatches_by_name) {
+	using namespace xxx::xcp;
+	using enum cpp::directive_kind_t;
+	for (auto const& [name, kind] : cpp::directive_names) EXPECT_EQ(kind, cpp::find_directive_kind(name)) << name;
+	EXPECT_EQ(null, cpp::find_directive_kind(""));
+	EXPECT_EQ(unknown, cpp::find_directive_kind("iff"));
+	EXPECT_EQ(unknown, cpp::find_directive_kind("import"));
+
+	auto const classify = [](std::string_view const& line) {
+		auto const tokens	 = lex::tokenize(line);
+		auto const directive = cpp::classify_directive(tokens, 0u, tokens.size());
+		return std::make_tuple(directive.kind, directive.last - directive.first);
+	};
+	EXPECT_EQ(std::make_tuple(non_directive, 4), classify("a # define\n"));
+	EXPECT_EQ(std::make_tuple(null, 0), classify("#\n"));
+	EXPECT_EQ(std::make_tuple(define, 2), classify("#  define A 1\n"));
+	EXPECT_EQ(std::make_tuple(include, 1), classify("%:include \"a.h\""));
+	EXPECT_EQ(std::make_tuple(unknown, 0), classify("# 1\n"));
+}
+
+TEST(preprocessor, skip_group_counts_only_nesting) {
+	using namespace xxx::xcp;
+	auto const tokens = lex::tokenize("a\n\n#if X\n# elif \"#else\"\n#endif\n/* #endif */ b\n#define A\n%:else\nc\n");
+	auto const [end, newlines] = cpp::skip_group(tokens, 0u);
+	EXPECT_EQ(7u, newlines);
+	EXPECT_EQ("%:", tokens.str(end));
+	EXPECT_EQ("else", tokens.str(end + 1u));
+
+	// Any unterminated group is skipped to the end.
+	auto const unterminated = lex::tokenize("#if X\n#endif\na\n");
+	EXPECT_EQ((std::tuple<std::size_t, std::size_t>{unterminated.size(), 3u}), cpp::skip_group(unterminated, 0u));
+}
+
+TEST(preprocessor, excluded_groups_are_never_tokenized) {
+	using namespace xxx::xcp;
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_excluded.h";
+	std::ofstream{path} << "#ifdef _WIN32\n`windows\n#elif 1\nint a;\n#else\n`other\n#endif\n";
+
+	cpp::context_t context;
+	std::string	   str;
+	for (auto const& token : cpp::preprocess(path, context)) {
+		if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str()).append(" ");
+	}
+	// Invalid tokens in the excluded groups are not even scanned.
+	EXPECT_EQ("int a ; ", str);
+	auto const tokens = lex::token_cache().scan(path);
+	EXPECT_EQ(lex::tokenize("int a;\n").size() * (sizeof(lex::tokens_t::kind_t) + sizeof(std::uint8_t) + sizeof(std::uint32_t) * 2u), tokens->deferred_size());
+	std::filesystem::remove(path);
+
+	// Unmatched quotes are diagnosed only in the processed directives.
+	auto const quoted = std::filesystem::temp_directory_path() / "xcp_ut_excluded_quote.h";
+	std::ofstream{quoted} << "#if 0\n#error can't do this\ncan't\n#endif\nint b;\n";
+	str.clear();
+	for (auto const& token : cpp::preprocess(quoted, context)) {
+		if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str()).append(" ");
+	}
+	EXPECT_EQ("int b ; ", str);
+	std::ofstream{quoted} << "#define A 'a\n";
+	EXPECT_THROW(cpp::preprocess(quoted, context), std::invalid_argument);
+	std::filesystem::remove(quoted);
+}
+
+TEST(preprocessor, preprocess_lines_handles_directives) {
+	EXPECT_EQ((std::vector<std::string_view>{"a", "c"}), preprocess_text(R"(#define A 1
+#ifdef A
+a
+#endif
+#undef A
+#ifndef A
+c
+#endif
+#pragma unknown
+)"));
+	// Directives in skipped groups are not processed even if they are not known.
+	EXPECT_EQ((std::vector<std::string_view>{}), preprocess_text("#ifdef A\n#error A\n#unknown\n#endif\n"));
+	EXPECT_THROW(preprocess_text("#error message\n"), std::invalid_argument);
+	EXPECT_EQ((std::vector<std::string_view>{"a"}), preprocess_text("#warning message\n#ident \"v1\"\n#unknown\na\n"));
+	EXPECT_EQ((std::vector<std::string_view>{"a"}), preprocess_text("#line 10\n#line 2147483647 \"file.cpp\"\n#define L 20\n#line L\na\n"));
+	EXPECT_THROW(preprocess_text("#line\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#line 0\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#line 2147483648\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#line 0x10\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#line 10 file\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#line 10 \"file\" 1\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define 1\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#ifdef\n#endif\n"), std::invalid_argument);
+}
+
+TEST(preprocessor, macro_table_copies_only_modified_shards) {
+	using namespace xxx::xcp;
+	cpp::macro_table_t<int> base;
+	for (int i = 0; i < 10'000; ++i) base.insert_or_assign("M" + std::to_string(i), i);
+
+	auto copy = base;
+	copy.insert_or_assign("M1", -1);
+	copy.insert_or_assign("N", 1);
+	EXPECT_TRUE(copy.erase("M2"));
+	EXPECT_FALSE(copy.erase("M2"));
+
+	// The copy is isolated from the original.
+	EXPECT_EQ(10'000u, base.size());
+	EXPECT_EQ(1, *base.find("M1"));
+	EXPECT_TRUE(base.contains("M2"));
+	EXPECT_FALSE(base.contains("N"));
+	EXPECT_EQ(10'000u, copy.size());
+	EXPECT_EQ(-1, *copy.find("M1"));
+	EXPECT_FALSE(copy.contains("M2"));
+	EXPECT_EQ(nullptr, copy.find("M"));
+
+	std::size_t count{};
+	copy.for_each([&count](auto const&, auto const&) { ++count; });
+	EXPECT_EQ(copy.size(), count);
+}
+
+TEST(preprocessor, macros_are_replaced_with_hide_sets) {
+	// Examples of the standard, [cpp.scope].
+	EXPECT_EQ("f ( 2 * ( y + 1 ) ) + f ( 2 * ( f ( 2 * ( z [ 0 ] ) ) ) ) % f ( 2 * ( 0 ) ) + t ( 1 ) ; "
+			  "f ( 2 * ( 2 + ( 3 , 4 ) - 0 , 1 ) ) | f ( 2 * ( ~ 5 ) ) & f ( 2 * ( 0 , 1 ) ) ^ m ( 0 , 1 ) ; "
+			  "int i [ ] = { 1 , 23 , 4 , 5 , } ; "
+			  R"(char c [ 2 ] [ 6 ] = { "hello" , "" } ;)",
+			  preprocess_joined(R"(#define x 3
+#define f(a) f(x * (a))
+#undef x
+#define x 2
+#define g f
+#define z z[0]
+#define h g(~
+#define m(a) a(w)
+#define w 0,1
+#define t(a) a
+#define p() int
+#define q(x) x
+#define r(x,y) x ## y
+#define str(x) # x
+f(y+1) + f(f(z)) % t(t(g)(0) + t)(1);
+g(x+(3,4)-w) | h 5) & m
+(f)^m(m);
+p() i[q()] = { q(1), r(2,3), r(4,), r(,5), r(,) };
+char c[2][6] = { str(hello), str() };
+)"));
+	EXPECT_EQ(R"(char p [ ] = "x ## y" ;)", preprocess_joined(R"(#define hash_hash # ## #
+#define mkstr(a) # a
+#define in_between(a) mkstr(a)
+#define join(c, d) in_between(c hash_hash d)
+char p[] = join(x, y);
+)"));
+	// Function-like macro without arguments is not replaced.
+	EXPECT_EQ("f + f ( 1 )", preprocess_joined("#define f(x) x\nf + f(f)(1)\n"));
+	// Object-like macro is distinguished by whitespace before the parenthesis.
+	EXPECT_EQ("( x ) 1", preprocess_joined("#define o (x)\n#define f(x) x\no f(1)\n"));
+	EXPECT_EQ(R"("a+b" "a + \"b\\n\"")", preprocess_joined("#define s(x) #x\ns(a+b) s(a + \"b\\n\")\n"));
+}
+
+TEST(preprocessor, macros_are_replaced_with_variadic_arguments) {
+	// Examples of the standard, [cpp.subst].
+	EXPECT_EQ("f ( 0 , a , b , c ) f ( 0 ) f ( 0 ) f ( 0 , a , b , c ) f ( 0 , a ) f ( 0 , a ) S foo ; S bar = { 1 , 2 } ;", preprocess_joined(R"(#define F(...) f(0 __VA_OPT__(,) __VA_ARGS__)
+#define G(X, ...) f(0, X __VA_OPT__(,) __VA_ARGS__)
+#define SDEF(sname, ...) S sname __VA_OPT__(= { __VA_ARGS__ })
+#define EMP
+F(a,b,c) F() F(EMP)
+G(a,b,c) G(a,) G(a)
+SDEF(foo); SDEF(bar, 1, 2);
+)"));
+	EXPECT_EQ("a b ab", preprocess_joined("#define F(x, ...) x __VA_OPT__(b x ## __VA_ARGS__)\nF(a, b)\n"));
+}
+
+TEST(preprocessor, macro_invocation_keeps_lines) {
+	using namespace xxx::xcp;
+	auto const	   tokens = lex::tokenize("#define f(x, y) x y\nf(a,\nb) c\nd\n");
+	cpp::context_t context;
+	std::string	   str;
+	cpp::preprocess_lines(tokens, context, [&str](auto first, auto last) {
+		for (; first != last; ++first) {
+			auto const token = *first;
+			if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) {
+				str.append(pp->str());
+			} else {
+				str.append(std::get<lex::whitespace_t>(token).newlines(), '$');
+			}
+		}
+	});
+	EXPECT_EQ("$ab$c$d$", str);
+}
+
+TEST(preprocessor, expander_recycles_arena_between_invocations) {
+	using namespace xxx::xcp;
+	cpp::context_t context;
+	cpp::preprocess_lines(lex::tokenize("#define F(x) x + G(x)\n#define G(x) (x)\n"), context, [](auto, auto) {});
+
+	// The arena is released after each invocation, so that its peak does not depend on the number of the invocations.
+	auto const peak = [&context](std::size_t invocations) {
+		std::string text;
+		for (std::size_t i{}; i < invocations; ++i) text.append("F(F(1)) ");
+		auto const		tokens = lex::tokenize(text.append("\n"));
+		peak_resource_t resource;
+		auto const		previous = std::pmr::set_default_resource(&resource);
+		lex::tokens_t	output;
+		cpp::expander_t{context.macros()}.expand(tokens, 0u, tokens.size(), output);
+		std::pmr::set_default_resource(previous);
+		EXPECT_EQ(invocations * 13u, output.size() - 1u);
+		return resource.peak;
+	};
+	auto const few = peak(10u);
+	EXPECT_EQ(few, peak(1'000u));
+}
+
+TEST(preprocessor, invalid_macros_are_rejected) {
+	EXPECT_THROW(preprocess_text("#define f(x) #y\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x) ## x\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x, x) x\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x) __VA_ARGS__\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x) __VA_OPT__(x)\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define defined\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x) x\nf(1, 2)\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x) x\nf(1\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#define f(x, y) x ## y\nf(+, /)\n"), std::invalid_argument);
+}
+
+TEST(preprocessor, conditions_are_evaluated) {
+	auto const evaluate = [](std::string_view const& condition) {
+		return preprocess_joined("#define X 3\n#define Y X\n#define F(x) (x * 2)\n#if " + std::string{condition} + "\ntrue\n#else\nfalse\n#endif\n");
+	};
+	EXPECT_EQ("true", evaluate("1 + 2 * 3 == 7 && (1 + 2) * 3 == 9"));
+	EXPECT_EQ("true", evaluate("-1 < 0 && !(-1 < 0u) && -1 > 0u"));
+	EXPECT_EQ("true", evaluate("0x10 >> 4 == 1 && 1 << 3 == 010 && 0b101 == 5 && 1'000ull == 1000 && 18446744073709551615 == -1"));
+	EXPECT_EQ("true", evaluate("-7 / 2 == -3 && -7 % 2 == -1 && ~0 == -1 && (0, 2) == 2 && -1 >> 1 == -1"));
+	EXPECT_EQ("true", evaluate("'a' == 97 && '\\377' < 0 && '\\n' == 10 && 'ab' == 24930 && U'\\x1F600' == 0x1F600"));
+	EXPECT_EQ("true", evaluate("(2 || 1 / 0) && !(0 && 1 / 0) && (1 ? 2 : 1 / 0) == 2 && (0 ? 1 / 0 : 3) == 3"));
+	EXPECT_EQ("true", evaluate("defined X && defined(Y) && !defined Z && defined __cplusplus && true && !false"));
+	EXPECT_EQ("true", evaluate("X == 3 && Y == 3 && Z == 0 && F == 0 && F(Y) == 6 && F(defined X) == 2"));
+	EXPECT_EQ("true", evaluate("not 0 and (1 bitor 2) == 3 and compl 0 not_eq 0"));
+	EXPECT_EQ("false", evaluate("__has_include(\"no/such/header.h\") || __has_include(<no/such/header.h>)"));
+	EXPECT_EQ("true", preprocess_joined("#define AND &&\n#if 1 AND 1\ntrue\n#endif\n"));
+	EXPECT_EQ("true", preprocess_joined("#define P (\n#if P 1)\ntrue\n#endif\n"));
+
+	auto const header = std::filesystem::temp_directory_path() / "xcp_has_include.h";
+	std::ofstream{header} << "\n";
+	EXPECT_EQ("true", evaluate("__has_include(\"" + header.generic_string() + "\")"));
+	std::filesystem::remove(header);
+
+	EXPECT_THROW(evaluate("1 / 0"), std::invalid_argument);
+	EXPECT_THROW(evaluate(""), std::invalid_argument);
+	EXPECT_THROW(evaluate("1 +"), std::invalid_argument);
+	EXPECT_THROW(evaluate("1.0"), std::invalid_argument);
+	EXPECT_THROW(evaluate("(1"), std::invalid_argument);
+	EXPECT_THROW(evaluate("1 2"), std::invalid_argument);
+	EXPECT_THROW(evaluate("defined"), std::invalid_argument);
+}
+
+TEST(preprocessor, conditions_are_compiled_once_per_location) {
+	using namespace xxx::xcp;
+	auto const source = lex::source_manager().add("cached.h", "#if X == 1 || defined Y\na\n#else\nb\n#endif\n");
+	auto const tokens = lex::tokenize(source);
+	auto const cached = cpp::program_cache().size();
+
+	for (auto const& [definition, expected] : {std::pair{"", "b"}, std::pair{"#define X 1\n", "a"}, std::pair{"#define X 2\n", "b"}, std::pair{"#define Y\n", "a"}, std::pair{"#define X (1)\n", "a"}}) {
+		cpp::context_t context;
+		std::string	   str;
+		auto const	   sink = [&str](auto first, auto last) {
+			for (; first != last; ++first) {
+				if (auto const token = *first; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str());
+			}
+		};
+		cpp::preprocess_lines(lex::tokenize(definition), context, sink);
+		cpp::preprocess_lines(tokens, context, sink);
+		EXPECT_EQ(expected, str) << definition;
+	}
+	EXPECT_EQ(cached + 1u, cpp::program_cache().size());
+}
+
+TEST(preprocessor, macros_keep_their_sources) {
+	using namespace xxx::xcp;
+	auto		source = lex::source_manager().add("defined.h", "#define M 1\n");
+	auto		tokens = lex::tokenize(source);
+	auto const	freed  = std::weak_ptr<lex::source_t const>{source};
+	std::string str;
+	auto const	sink = [&str](auto first, auto last) {
+		 for (; first != last; ++first) {
+			 if (auto const token = *first; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str());
+		 }
+	};
+	{
+		cpp::context_t context;
+		cpp::preprocess_lines(tokens, context, sink);
+		tokens = {};
+		source.reset();
+		EXPECT_FALSE(freed.expired()); // The macro still refers into the source.
+		cpp::preprocess_lines(lex::tokenize("M\n"), context, sink);
+		EXPECT_EQ("1", str);
+	}
+	EXPECT_TRUE(freed.expired());
+}
+
+TEST(preprocessor, detect_include_guard_requires_whole_file_group) {
+	using namespace xxx::xcp;
+	auto const detect = [](std::string_view const& text) { return cpp::detect_include_guard(lex::tokenize(text)); };
+	EXPECT_EQ("G", detect("\n#ifndef G\n#define G\n#if A\n#else\n#endif\n#endif\n\n"));
+	EXPECT_EQ("G", detect("#if !defined(G)\n#endif\n"));
+	EXPECT_EQ("G", detect("#if ! defined G\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("a\n#ifndef G\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("#ifndef G\n#endif\na\n"));
+	EXPECT_EQ(std::nullopt, detect("#ifndef G\n#else\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("#ifndef G\n#endif\n#ifndef H\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("#ifdef G\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("#if !defined G && 1\n#endif\n"));
+	EXPECT_EQ(std::nullopt, detect("#pragma once\n"));
+}
+
+TEST(preprocessor, guarded_headers_are_included_once) {
+	using namespace xxx::xcp;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_include";
+	std::filesystem::create_directories(directory / "sub");
+	std::ofstream{directory / "guarded.h"} << "#ifndef GUARDED_H\n#define GUARDED_H\nint g;\n#endif\n";
+	std::ofstream{directory / "once.h"} << "#pragma once\nint o;\n";
+	std::ofstream{directory / "plain.h"} << "int p;\n";
+	std::ofstream{directory / "sub" / "angled.h"} << "#include \"guarded.h\"\nint a;\n";
+	std::ofstream{directory / "main.cpp"} << "#include \"guarded.h\"\n#include \"once.h\"\n#include \"plain.h\"\n#define H <angled.h>\n#include H\n"
+											 "#include \"guarded.h\"\n#include \"sub/../once.h\"\n#include \"plain.h\"\n";
+
+	auto const preprocess = [&directory](cpp::context_t& context) {
+		std::string str;
+		for (auto const& token : cpp::preprocess(directory / "main.cpp", context)) {
+			if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str()).append(" ");
+		}
+		return str;
+	};
+	xxx::opt::options_t const options{{"I", {(directory / "sub").string(), directory.string()}}};
+	cpp::context_t			  context{options};
+	EXPECT_EQ("int g ; int o ; int p ; int a ; int p ; ", preprocess(context));
+	EXPECT_TRUE(context.sources().empty());
+
+	auto const guarded = cpp::include_guards().find(*xxx::util::file_id(directory / "guarded.h"));
+	ASSERT_TRUE(guarded);
+	EXPECT_EQ("GUARDED_H", guarded->macro);
+	auto const once = cpp::include_guards().find(*xxx::util::file_id(directory / "once.h"));
+	ASSERT_TRUE(once);
+	EXPECT_TRUE(once->once);
+
+	// Another translation unit includes them again.
+	cpp::context_t other{options};
+	EXPECT_EQ("int g ; int o ; int p ; int a ; int p ; ", preprocess(other));
+
+	EXPECT_THROW(preprocess_text("#include \"no/such/header.h\"\n"), std::invalid_argument);
+	EXPECT_THROW(preprocess_text("#include\n"), std::invalid_argument);
+	std::filesystem::remove_all(directory);
+}
+
+TEST(preprocessor, include_resolver_indexes_directories_once) {
+	using namespace xxx::xcp;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_resolver";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory / "quoted" / "sys");
+	std::filesystem::create_directories(directory / "angled" / "sys");
+	std::ofstream{directory / "quoted" / "main.cpp"} << "\n";
+	std::ofstream{directory / "quoted" / "sys" / "a.h"} << "\n";
+	std::ofstream{directory / "angled" / "sys" / "a.h"} << "\n";
+
+	cpp::include_resolver_t resolver;
+	EXPECT_TRUE(resolver.contains(directory / "quoted", "sys/a.h"));
+	EXPECT_TRUE(resolver.contains(directory / "quoted", "./sys/../sys/a.h"));
+	EXPECT_FALSE(resolver.contains(directory / "quoted", "sys"));
+	EXPECT_FALSE(resolver.contains(directory / "quoted", "sys/b.h"));
+	EXPECT_FALSE(resolver.contains(directory / "none", "sys/a.h"));
+	EXPECT_TRUE(resolver.contains(directory / "quoted" / "sys", "../main.cpp"));
+
+	// The listing is kept, so that a new file is found after clearing only.
+	std::ofstream{directory / "quoted" / "sys" / "b.h"} << "\n";
+	EXPECT_FALSE(resolver.contains(directory / "quoted", "sys/b.h"));
+	resolver.clear();
+	EXPECT_TRUE(resolver.contains(directory / "quoted", "sys/b.h"));
+	EXPECT_EQ(! cpp::include_resolver_t::default_fold_case, ! resolver.contains(directory / "quoted", "SYS/B.h"));
+
+	// Names are compared ignoring case if the file system does so.
+	cpp::include_resolver_t folding{true};
+	EXPECT_TRUE(folding.contains(directory / "quoted", "Sys/A.H"));
+	EXPECT_FALSE(folding.contains(directory / "quoted", "Sys/C.H"));
+
+	// A header in quotes is found in the directory of the current file at first.
+	xxx::opt::options_t const options{{"I", {(directory / "angled").string()}}};
+	cpp::context_t			  context{options};
+	context.sources().emplace(directory / "quoted" / "main.cpp", nullptr);
+	EXPECT_EQ(directory / "quoted" / "sys/a.h", cpp::find_header("sys/a.h", false, context));
+	EXPECT_EQ(directory / "angled" / "sys/a.h", cpp::find_header("sys/a.h", true, context));
+	EXPECT_EQ(std::nullopt, cpp::find_header("sys/c.h", false, context));
+	std::filesystem::remove_all(directory);
+}
+
+TEST(preprocessor, scan_dependencies_follows_directives_only) {
+	using namespace xxx::xcp;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_dependencies";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory / "include");
+	std::ofstream{directory / "include" / "a.h"} << "#ifndef A_H\n#define A_H\n#include \"b.h\"\n#endif\n";
+	std::ofstream{directory / "include" / "b.h"} << "/*\n#include \"no.h\"\n*/\nint b;\n";
+	std::ofstream{directory / "include" / "c.h"} << "int c;\n";
+	std::ofstream{directory / "main.cpp"} << "#include <a.h>\n#if VARIANT == 2\n#include <c.h>\n#else\n#include <no.h>\n#endif\n#include <a.h>\nint main() {}\n";
+
+	xxx::opt::options_t const options{{"I", {(directory / "include").string()}}, {"D", {"VARIANT=2", "UNUSED"}}};
+	cpp::context_t			  context{options};
+	auto const				  dependencies = cpp::scan_dependencies(directory / "main.cpp", context);
+	EXPECT_EQ((cpp::context_t::dependencies_t{directory / "main.cpp", directory / "include" / "a.h", directory / "include" / "b.h", directory / "include" / "c.h"}), dependencies);
+	EXPECT_TRUE(context.macros().contains("UNUSED"));
+
+	xxx::opt::options_t const other{{"I", {(directory / "include").string()}}};
+	cpp::context_t			  missing{other};
+	EXPECT_THROW(cpp::scan_dependencies(directory / "main.cpp", missing), std::invalid_argument);
+	EXPECT_THROW((cpp::context_t{{{"D", {"1=2"}}}}), std::invalid_argument);
+	std::filesystem::remove_all(directory);
+}
+
+TEST(preprocessor, scan_dependencies_does_not_detect_include_guards) {
+	using namespace xxx::xcp;
+	auto const directory = std::filesystem::temp_directory_path() / "xcp_ut_scan_guards";
+	std::filesystem::remove_all(directory);
+	std::filesystem::create_directories(directory);
+	std::ofstream{directory / "g.h"} << "#ifndef G\n#define G\nint a;\n#endif\nint outside;\n";
+	std::ofstream{directory / "main.cpp"} << "#include \"g.h\"\n#include \"g.h\"\n";
+
+	// Both modes run in the same process, and share the table of include guards.
+	cpp::context_t scanned;
+	EXPECT_EQ((cpp::context_t::dependencies_t{directory / "main.cpp", directory / "g.h"}), cpp::scan_dependencies(directory / "main.cpp", scanned));
+	EXPECT_EQ(std::nullopt, cpp::include_guards().find(*xxx::util::file_id(directory / "g.h")));
+
+	cpp::context_t context;
+	std::string	   str;
+	for (auto const& token : cpp::preprocess(directory / "main.cpp", context)) {
+		if (auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) str.append(pp->str()).append(" ");
+	}
+	EXPECT_EQ("int a ; int outside ; int outside ; ", str);
+	std::filesystem::remove_all(directory);
+}
+
+TEST(preprocessor, preprocess_lines_streams_million_lines) {
+	using namespace xxx::xcp;
+	constexpr std::size_t blocks = 200'000u; // 5 lines per block
+	constexpr std::size_t depth	 = 100'000u; // 2 lines per depth
+
+	std::string text;
+	text.reserve(blocks * 40u + depth * 16u);
+	for (std::size_t i = 0; i < blocks; ++i) text += "#ifdef __cplusplus\na\n#else\nb\n#endif\n";
+	for (std::size_t i = 0; i < depth; ++i) text += "#ifndef A\n";
+	text += "c\n";
+	for (std::size_t i = 0; i < depth; ++i) text += "#endif\n";
+
+	auto const	   tokens = lex::tokenize(text);
+	cpp::context_t context;
+	std::size_t	   a{}, c{}, newlines{};
+	cpp::preprocess_lines(tokens, context, [&](auto first, auto last) {
+		for (; first != last; ++first) {
+			if (auto const token = *first; auto const pp = std::get_if<lex::preprocessing_token_t>(&token)) {
+				(pp->str() == "a" ? a : c) += 1u;
+			} else {
+				newlines += std::get<lex::whitespace_t>(token).newlines();
+			}
+		}
+	});
+	EXPECT_EQ(blocks, a);
+	EXPECT_EQ(1u, c);
+	// Every line keeps its newline, so that the lines are not shifted.
+	EXPECT_EQ(blocks * 5u + depth * 2u + 1u, newlines);
+	EXPECT_TRUE(context.conditions().empty());
+}
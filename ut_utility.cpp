@@ -0,0 +1,319 @@
+// ===========================================================================
+/// @file
+/// @brief		Unit tests of the utilities.
+/// @author		Mura.
+/// @copyright	(c) 2023-, Mura.
+// ===========================================================================
+
+#include "utility.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string_view>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ===========================================================================
+
+TEST(simd, kernels_agree_with_scalar_kernels) {
+	using namespace xxx::simd;
+	std::vector<isa_t> isas{isa_t::scalar};
+	if (isa_t::sse2 <= detect()) isas.push_back(isa_t::sse2);
+	if (isa_t::avx2 <= detect()) isas.push_back(isa_t::avx2);
+
+	std::mt19937					   random{42u};
+	std::string_view constexpr		   alphabet{" \t\v\f\r\n*/a$@`\x7F\x01\x80\xFF"};
+	std::uniform_int_distribution<int> length{0, 100};
+	// Runs of each character are long enough to cross the blocks.
+	std::uniform_int_distribution<std::size_t> character{0u, alphabet.size() - 1u}, run{1u, 40u};
+	auto const&								   expected = kernels(isa_t::scalar);
+	for (int i = 0; i < 1000; ++i) {
+		std::string str;
+		for (auto n = length(random); 0 < n; --n) str.append(run(random), alphabet[character(random)]);
+		for (auto const isa : isas) {
+			auto const& actual = kernels(isa);
+			EXPECT_EQ(expected.skip_blanks(str.data(), str.size()), actual.skip_blanks(str.data(), str.size())) << static_cast<int>(isa);
+			EXPECT_EQ(expected.count(str.data(), str.size(), '\n'), actual.count(str.data(), str.size(), '\n')) << static_cast<int>(isa);
+			EXPECT_EQ(expected.find_either(str.data(), str.size(), '\r', '\n'), actual.find_either(str.data(), str.size(), '\r', '\n')) << static_cast<int>(isa);
+			EXPECT_EQ(expected.find_either(str.data(), str.size(), '*', '*'), actual.find_either(str.data(), str.size(), '*', '*')) << static_cast<int>(isa);
+			EXPECT_EQ(expected.skip_basic(str.data(), str.size()), actual.skip_basic(str.data(), str.size())) << static_cast<int>(isa);
+		}
+	}
+	// The vertical tab and the form feed are blanks, but the carriage return is not.
+	EXPECT_EQ(40u, skip_blanks(std::string(10u, ' ') + std::string(10u, '\t') + std::string(10u, '\v') + std::string(10u, '\f') + "\r"));
+	EXPECT_EQ(0u, count("", '\n'));
+	EXPECT_EQ(33u, skip_basic(std::string(32u, 'a') + "\t\x80"));
+}
+
+TEST(uc, to_32string_decodes_utf8) {
+	using xxx::uc::to_32string;
+	EXPECT_EQ(U"a\u00E9\u3042\U0001F600", to_32string("a\xC3\xA9\xE3\x81\x82\xF0\x9F\x98\x80"));
+	EXPECT_THROW(to_32string("\xC3"), std::invalid_argument);
+	EXPECT_THROW(to_32string("\xE3\x81" "a"), std::invalid_argument);
+	EXPECT_THROW(to_32string("\x80"), std::invalid_argument);
+}
+
+TEST(util, open_file_strips_bom_by_offset) {
+	using namespace xxx::util;
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_open_file.txt";
+	for (auto const size : {std::size_t{10u}, mapping_threshold * 4u}) {
+		std::string const contents(size, 'x');
+		std::ofstream{path, std::ios::binary} << "\xEF\xBB\xBF" << contents;
+
+		auto const file = open_file(path);
+		EXPECT_EQ(size + 3u, file->bytes().size());
+		EXPECT_EQ(contents, file->view());
+		EXPECT_EQ(file->bytes().data() + 3u, file->view().data());
+		EXPECT_EQ(contents, load_file(path));
+	}
+	std::ofstream{path, std::ios::binary};
+	EXPECT_TRUE(open_file(path)->view().empty());
+	std::filesystem::remove(path);
+	EXPECT_THROW(open_file(path), std::invalid_argument);
+}
+
+namespace {
+
+/// @brief	Argument which counts how many times it is formatted.
+struct counted_t {
+	std::size_t* count;
+};
+[[maybe_unused]] std::ostream&
+operator<<(std::ostream& os, counted_t const& c) { return os << ++*c.count; }
+
+/// @brief	Function which traces the arguments.
+void
+traced_function(xxx::log::logger_t& logger, counted_t const& counted) {
+	xxx::log::tracer_t tracer{logger, counted, xxx::log::escaped{"a\nb"}};
+	tracer.trace("x=", counted);
+	tracer.set_result(true);
+}
+
+} // namespace
+
+TEST(log, site_is_computed_at_compile_time) {
+	constexpr xxx::log::site_t site;
+	static_assert(site.file == "ut_utility.cpp");
+	static_assert(site.function.ends_with("TestBody"));
+	static_assert(std::string_view{xxx::log::site_t{}.function}.find('(') == std::string_view::npos);
+}
+
+TEST(log, tracer_formats_arguments_only_if_enabled) {
+	using namespace xxx::log;
+	std::size_t		   count{};
+	std::ostringstream oss;
+	{
+		logger_t logger{trace_level, oss};
+		traced_function(logger, counted_t{&count});
+	}
+	EXPECT_EQ(0u, count);
+	EXPECT_TRUE(oss.str().empty());
+
+	if constexpr (tracer_t<>::compiled) {
+		logger_t logger{0u, oss};
+		traced_function(logger, counted_t{&count});
+		EXPECT_EQ(2u, count);
+		EXPECT_NE(std::string::npos, oss.str().find("traced_function(1, a$nb)")) << oss.str();
+		EXPECT_NE(std::string::npos, oss.str().find("--- x=2")) << oss.str();
+		EXPECT_NE(std::string::npos, oss.str().find("traced_function(true)")) << oss.str();
+	}
+}
+
+TEST(util, parallel_for_visits_each_index_once) {
+	using xxx::util::parallel_for;
+	for (auto const jobs : {std::size_t{1u}, std::size_t{4u}, std::size_t{100u}}) {
+		std::vector<std::atomic<int>> visited(5000u);
+		parallel_for(visited.size(), jobs, [&visited](std::size_t i) { ++visited[i]; });
+		EXPECT_TRUE(std::ranges::all_of(visited, [](auto const& v) { return v == 1; })) << jobs;
+	}
+	parallel_for(0u, 4u, [](std::size_t) { FAIL(); });
+
+	// The first exception is rethrown after the workers stop.
+	std::atomic<std::size_t> called{};
+	EXPECT_THROW(parallel_for(1000u, 4u, [&called](std::size_t i) { ++called; if (i == 10u) throw std::invalid_argument("10"); }), std::invalid_argument);
+	EXPECT_LT(called.load(), 1000u);
+}
+
+TEST(log, output_is_redirected_per_thread) {
+	using namespace xxx::log;
+	std::ostringstream main, worker;
+	{
+		scoped_output_t const output{main};
+		std::jthread{[&worker] {
+			scoped_output_t const output{worker};
+			logger_t{0u}(trace_level + 1u, "worker");
+		}};
+		logger_t{0u}(trace_level + 1u, "main");
+	}
+	EXPECT_EQ(&std::clog, output());
+	if constexpr (compiled_threshold < trace_level + 1u) {
+		EXPECT_NE(std::string::npos, main.str().find("main"));
+		EXPECT_EQ(std::string::npos, main.str().find("worker"));
+		EXPECT_NE(std::string::npos, worker.str().find("worker"));
+	}
+}
+
+TEST(util, hash64_agrees_with_xxh64) {
+	using xxx::util::hash64;
+	EXPECT_EQ(0xEF46DB3751D8E999ull, hash64(""));
+	EXPECT_EQ(0xD24EC4F1A98C6E5Bull, hash64("a"));
+	EXPECT_EQ(0x44BC2CF5AD770999ull, hash64("abc"));
+	// Long input goes through the four lanes.
+	std::string const str(1000u, 'x');
+	EXPECT_EQ(hash64(str), hash64(std::string{str}));
+	EXPECT_NE(hash64(str), hash64(str.substr(1u)));
+	EXPECT_NE(hash64(str), hash64(str, 1u));
+}
+
+TEST(util, save_file_replaces_file_atomically) {
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_save_file.txt";
+	xxx::util::save_file(path, "old");
+	xxx::util::save_file(path, "new contents");
+	EXPECT_EQ("new contents", xxx::util::load_file(path));
+	// No temporary file is left.
+	auto const siblings = std::ranges::count_if(std::filesystem::directory_iterator{path.parent_path()}, [&path](auto const& a) { return a.path().filename().string().starts_with(path.filename().string()); });
+	EXPECT_EQ(1, siblings);
+	std::filesystem::remove(path);
+}
+
+TEST(prof, scopes_are_exclusive_and_merged_per_file_and_thread) {
+	using namespace xxx::prof;
+	auto const before = collect().total();
+	std::jthread{[] {
+		file_scope_t const file{"xcp_ut_prof.cpp"};
+		scope_t			   outer{phase_t::tokenize, 10u};
+		{
+			scope_t const inner{phase_t::include, 1u};
+			std::this_thread::sleep_for(std::chrono::milliseconds{20});
+		}
+		outer.add(5u);
+	}};
+	auto const profile = collect();
+	ASSERT_TRUE(profile.files.contains("xcp_ut_prof.cpp"));
+	auto const& counters = profile.files.at("xcp_ut_prof.cpp");
+	EXPECT_EQ(1u, counters[phase_t::tokenize].calls);
+	EXPECT_EQ(15u, counters[phase_t::tokenize].amount);
+	EXPECT_EQ(1u, counters[phase_t::include].calls);
+	EXPECT_LE(20'000'000u, counters[phase_t::include].nanoseconds);
+	EXPECT_LT(counters[phase_t::tokenize].nanoseconds, counters[phase_t::include].nanoseconds);
+	EXPECT_EQ(before[phase_t::tokenize].calls + 1u, profile.total()[phase_t::tokenize].calls);
+
+	std::ostringstream table, json;
+	write_table(table, profile);
+	write_json(json, profile);
+	EXPECT_NE(std::string::npos, table.str().find("xcp_ut_prof.cpp")) << table.str();
+	EXPECT_NE(std::string::npos, json.str().find(R"("xcp_ut_prof.cpp":{"nanoseconds":)")) << json.str();
+}
+
+TEST(util, spsc_ring_keeps_order_between_threads) {
+	xxx::util::spsc_ring_t<std::size_t> ring{100u};
+	EXPECT_EQ(128u, ring.capacity());
+	EXPECT_FALSE(ring.try_pop());
+	for (std::size_t i{}; i < ring.capacity(); ++i) EXPECT_TRUE(ring.try_push(i));
+	EXPECT_FALSE(ring.try_push(std::size_t{}));
+	EXPECT_EQ(0u, ring.try_pop());
+
+	constexpr std::size_t const count = 10'000u;
+	std::size_t					expected{1u};
+	std::jthread const			producer{[&ring] {
+		 for (std::size_t i = ring.capacity(); i < count; ++i) {
+			 while (! ring.try_push(i)) std::this_thread::yield();
+		 }
+	}};
+	while (expected < count) {
+		if (auto const value = ring.try_pop()) {
+			ASSERT_EQ(expected, *value);
+			++expected;
+		} else {
+			std::this_thread::yield();
+		}
+	}
+}
+
+TEST(log, trace_writer_writes_spans_of_threads) {
+	using namespace xxx::log;
+	auto const path = std::filesystem::temp_directory_path() / "xcp_ut_trace.json";
+	trace_writer().open(path);
+	{
+		span_t const span{"Source", "main \"quoted\".cpp"};
+		std::jthread{[] { span_t const span{"Header", "worker.hpp"}; }};
+	}
+	trace_writer().close();
+	{ span_t const unrecorded{"Source", "unrecorded.cpp"}; }
+	trace_writer().close(); // Closing twice is harmless.
+
+	auto const json = xxx::util::load_file(path);
+	EXPECT_TRUE(json.starts_with(R"({"displayTimeUnit":"ms","traceEvents":[)")) << json;
+	EXPECT_TRUE(json.ends_with("]}\n")) << json;
+	EXPECT_NE(std::string::npos, json.find(R"({"name":"Source","ph":"X","pid":1,"tid":)")) << json;
+	EXPECT_NE(std::string::npos, json.find(R"("args":{"detail":"main \"quoted\".cpp"}})")) << json;
+	EXPECT_NE(std::string::npos, json.find(R"("args":{"detail":"worker.hpp"}})")) << json;
+	EXPECT_NE(std::string::npos, json.find(R"("name":"thread_name","ph":"M")")) << json;
+	EXPECT_EQ(std::string::npos, json.find("unrecorded")) << json;
+	std::filesystem::remove(path);
+}
+
+TEST(log, backend_writes_messages_asynchronously) {
+	using namespace xxx::log;
+	std::ostringstream oss;
+	auto const		   previous = std::clog.rdbuf(oss.rdbuf());
+	std::string const  long_message(1000u, 'x');
+	backend().open();
+	logger_t{0u}(trace_level + 1u, "main");
+	std::jthread{[&long_message] { logger_t{0u}(trace_level + 1u, long_message); }};
+	std::ostringstream redirected, explicit_stream;
+	{
+		// A redirected output is written when the redirection ends.
+		scoped_output_t const output{redirected};
+		logger_t{0u}(trace_level + 1u, "redirected");
+		// Another output stream is written synchronously.
+		logger_t{0u, explicit_stream}(trace_level + 1u, "explicit");
+		if constexpr (compiled_threshold < trace_level + 1u) {
+			EXPECT_NE(std::string::npos, explicit_stream.str().find("] explicit\n"));
+		}
+	}
+	if constexpr (compiled_threshold < trace_level + 1u) {
+		EXPECT_NE(std::string::npos, redirected.str().find("] redirected\n")) << redirected.str();
+	}
+	backend().close();
+	std::clog.rdbuf(previous);
+
+	if constexpr (compiled_threshold < trace_level + 1u) {
+		EXPECT_NE(std::string::npos, oss.str().find("[ut_utility.cpp:")) << oss.str();
+		EXPECT_NE(std::string::npos, oss.str().find("] main\n")) << oss.str();
+		EXPECT_NE(std::string::npos, oss.str().find("] " + long_message + "\n")) << oss.str();
+		EXPECT_EQ(std::string::npos, oss.str().find("redirected")) << oss.str();
+	}
+}
+
+#if defined(xxx_posix)
+TEST(log, backend_drains_messages_at_crash) {
+	using namespace xxx::log;
+	EXPECT_DEATH(
+		{
+			backend().open();
+			logger_t{0u}(trace_level + 1u, "before crash");
+			std::abort();
+		},
+		"before crash");
+	// Messages to a redirected output are written to the standard error at the crash.
+	EXPECT_DEATH(
+		{
+			backend().open();
+			std::ostringstream	  redirected;
+			scoped_output_t const output{redirected};
+			logger_t{0u}(trace_level + 1u, "redirected before crash");
+			std::abort();
+		},
+		"redirected before crash");
+}
+#endif
@@ -18,6 +18,10 @@ namespace xxx {
 namespace xxx::log {
 }
 
+///	@brief	Utilities to profile phases, which are cheap enough to be always enabled.
+namespace xxx::prof {
+}
+
 ///	@brief	Utilities of UNICODE.
 namespace xxx::uc {
 }
@@ -26,6 +30,10 @@ namespace xxx::uc {
 namespace xxx::util {
 }
 
+///	@brief	Utilities of SIMD, which are selected at runtime.
+namespace xxx::simd {
+}
+
 // ===========================================================================
 
 #include <source_location>
@@ -33,18 +41,34 @@ namespace xxx::util {
 #include <type_traits>
 #include <unordered_map>
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
 #include <cstddef>
+#include <cstring>
+#include <cstdint>
+#include <exception>
 #include <filesystem>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <numeric>
+#include <optional>
 #include <ranges>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <system_error>
+#include <thread>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #ifndef const_
@@ -52,6 +76,31 @@ namespace xxx::util {
 #define const_ /*const*/
 #endif
 
+#if defined(__x86_64__) || defined(_M_X64)
+///	@brief	SIMD kernels of x86-64 are available.
+#define xxx_simd_x86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(xxx_posix)
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+///	@brief	Enables AVX2 instructions in the function.
+#define xxx_target_avx2 __attribute__((target("avx2")))
+#else
+#define xxx_target_avx2
+#endif
+
 #if ! __has_include(<source_location>) && __has_include(<experimental/source_location>)
 #include <experimental/source_location>
 namespace std {
@@ -76,34 +125,228 @@ namespace xxx {
 // ===========================================================================
 namespace log {
 
+/// @brief	Logging level of tracing.
+constexpr std::size_t const trace_level = 10u;
+/// @brief	Logging level of warning.
+constexpr std::size_t const warning_level = 20u;
+
+#if ! defined(xxx_log_threshold)
+#if defined(NDEBUG)
+/// @brief	Logging threshold at build time, which removes logging of the level or lower.
+#define xxx_log_threshold 10u
+#else
+#define xxx_log_threshold 0u
+#endif
+#endif
+
+/// @brief	Logging threshold at build time.
+///		Logging of the level or lower is removed entirely at compilation.
+constexpr std::size_t const compiled_threshold = xxx_log_threshold;
+
+/// @brief	Gets logging threshold at runtime, which is applied to loggers constructed after changing it.
+///		Tracing is disabled by default.
+/// @return		Logging threshold.
+inline std::atomic<std::size_t>&
+threshold() noexcept {
+	static std::atomic<std::size_t> threshold{trace_level};
+	return threshold;
+}
+
+/// @brief	Gets output stream of logging of this thread.
+///		A worker thread can redirect it to buffer its logs.
+/// @return		Output stream of logging, which is std::clog by default.
+inline std::ostream*&
+output() noexcept {
+	thread_local std::ostream* os = &std::clog;
+	return os;
+}
+
+/// @brief	Writes the messages which have been recorded by the asynchronous backend, e.g., before reading a redirected output stream.
+inline void flush() noexcept;
+
+/// @brief	Redirects output stream of logging of this thread in the scope.
+///		The messages of the scope are written to the stream before the destructor returns, even if they are written asynchronously.
+class scoped_output_t {
+public:
+	/// @brief	Constructor.
+	/// @param[in]	os		Output stream to redirect to.
+	explicit scoped_output_t(std::ostream& os) noexcept : previous_{std::exchange(output(), &os)} {}
+	/// @brief	Destructor.
+	~scoped_output_t() {
+		flush();
+		output() = previous_;
+	}
+
+private:
+	scoped_output_t(scoped_output_t const&) = delete;
+
+private:
+	std::ostream* previous_; ///< @brief	Previous output stream.
+};
+
+/// @brief	Strips directory from the path.
+/// @param[in]	path	Path of the file.
+/// @return		Simple file name.
+constexpr std::string_view
+file_name(std::string_view const& path) noexcept {
+	auto const slash = path.find_last_of("/\\");
+	return slash == std::string_view::npos ? path : path.substr(slash + 1u);
+}
+
+/// @brief	Sink of messages, which receives a message to log instead of its output stream.
+///	@param[in]	os		Output stream to write the message to.
+///	@param[in]	file	Path of the source file of the call site, which shall live while the process runs.
+///	@param[in]	line	Line number of the call site.
+///	@param[in]	message	Message.
+using message_sink_t = void (*)(std::ostream& os, std::string_view file, std::uint_least32_t line, std::string_view message);
+
+/// @brief	Gets sink of messages, which is installed by an asynchronous backend.
+/// @return		Sink of messages, or nullptr if messages are written to their output streams directly.
+inline std::atomic<message_sink_t>&
+message_sink() noexcept {
+	static std::atomic<message_sink_t> sink;
+	return sink;
+}
+
+/// @brief	Sink of spans, which receives a span when its scope ends.
+///	@param[in]	name	Name of the span, which shall live while the process runs, e.g., a function name.
+///	@param[in]	detail	Detail of the span, e.g., a path.
+///	@param[in]	begin	Time when the span begins.
+///	@param[in]	end		Time when the span ends.
+using span_sink_t = void (*)(std::string_view name, std::string_view detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end);
+
+/// @brief	Gets sink of spans, which is installed by a trace writer.
+/// @return		Sink of spans, or nullptr if spans are not recorded.
+inline std::atomic<span_sink_t>&
+span_sink() noexcept {
+	static std::atomic<span_sink_t> sink;
+	return sink;
+}
+
+/// @brief	Call site of logging.
+///		Its names are computed once at compile time.
+struct site_t {
+	std::string_view	file;	  ///< @brief	File name without directory.
+	std::string_view	function; ///< @brief	Function name without return type and parameters.
+	std::uint_least32_t line;	  ///< @brief	Line number.
+
+	/// @brief	Constructor.
+	/// @param[in]	loc		Source location of the call site.
+	consteval site_t(std::source_location loc = std::source_location::current()) noexcept : file{file_name(loc.file_name())}, function{function_name(loc.function_name())}, line{loc.line()} {}
+
+private:
+	/// @brief	Strips return type and parameters from the function signature.
+	/// @param[in]	signature	Function signature.
+	/// @return		Simple function name.
+	static constexpr std::string_view function_name(std::string_view const& signature) noexcept {
+		auto paren = signature.find('(');
+		while (paren != std::string_view::npos && signature.substr(paren).starts_with("(anonymous namespace)")) paren = signature.find('(', paren + 1u);
+		auto const head = signature.substr(0u, paren);
+		// The return type is separated by a space out of template arguments.
+		std::size_t depth{};
+		for (auto i = head.size(); 0u < i; --i) {
+			switch (head[i - 1u]) {
+			case '>': ++depth; break;
+			case '<': depth -= 0u < depth ? 1u : 0u; break;
+			case ' ':
+				if (depth == 0u) return head.substr(i);
+				break;
+			default: break;
+			}
+		}
+		return head;
+	}
+};
+
+/// @brief	Argument, which is escaped lazily only if it is logged.
+struct escaped {
+	std::string_view str;		  ///< @brief	String to escape with white-space characters.
+	std::size_t		 limit = 16u; ///< @brief	Length to trancate.
+};
+
+/// @brief	Writes the escaped string.
+/// @param[in]	os	Output stream.
+/// @param[in]	e	Escaped string.
+/// @return		The @p os.
+inline std::ostream&
+operator<<(std::ostream& os, escaped const& e) {
+	for (auto const ch : e.str.substr(0u, e.limit)) {
+		switch (ch) {
+		case '\n': os << "$n"; break;
+		case '\r': os << "$r"; break;
+		case '\f': os << "$f"; break;
+		case '\v': os << "$v"; break;
+		case '\t': os << "$t"; break;
+		default: os << ch; break;
+		}
+	}
+	return os;
+}
+
+/// @brief	Writes the value.
+///		Ranges which cannot be written directly are written as comma-separated values.
+/// @tparam	T	Type of @p value.
+/// @param[in]	os		Output stream.
+/// @param[in]	value	Value to write.
+template<typename T>
+inline void
+write(std::ostream& os, T const& value) {
+	if constexpr (requires { os << value; }) {
+		os << value;
+	} else {
+		auto delimiter = "";
+		for (auto const& v : value) {
+			os << delimiter;
+			write(os, v);
+			delimiter = ", ";
+		}
+	}
+}
+
 /// @brief Logger.
 ///		This class logs message.
 /// @todo	It is just minimal implementation.
 class logger_t {
 public:
+	/// @brief	Checks if the level is logged.
+	/// @param[in]	level    Logging level.
+	/// @return		Whether the level is logged or not.
+	bool enabled(std::size_t level) const noexcept { return compiled_threshold < level && level_ < level; }
+
 	/// @brief Logs message.
 	/// @param[in]	level    Logging level.
 	/// @param[in]	msg      Message to log.
 	/// @param[in]	loc      Source location.
 	void operator()(std::size_t level, std::string_view const& msg, std::source_location const& loc = std::source_location::current()) const {
-		if (level <= level_) return;
-		os_ << "[" << file_name(loc) << ":" << std::setfill('_') << std::setw(5) << loc.line() << "] " << msg << std::endl;
+		if (! enabled(level)) return;
+		emit(loc.file_name(), loc.line(), msg);
+	}
+	/// @overload
+	/// @param[in]	level    Logging level.
+	/// @param[in]	site     Call site.
+	/// @param[in]	msg      Message to log.
+	void operator()(std::size_t level, site_t const& site, std::string_view const& msg) const {
+		if (! enabled(level)) return;
+		emit(site.file, site.line, msg);
 	}
 
 	/// @brief Constructor.
 	/// @param[in]	level    Logging level.
 	/// @param[in]	os       Output stream.
-	explicit logger_t(std::size_t level = 0u, std::ostream& os = std::clog) noexcept : os_(os), level_{level} {}
+	explicit logger_t(std::size_t level = threshold().load(std::memory_order_relaxed), std::ostream& os = *output()) noexcept : os_(os), level_{level} {}
 
 private:
 	logger_t(logger_t const&) = delete;
 
-	/// @brief	Strips file path name from source location.
-	/// @param[in]	loc		Source location.
-	/// @return		Simple file path.
-	static std::string file_name(std::source_location const& loc) {
-		std::filesystem::path const path{loc.file_name()};
-		return path.filename().string();
+	/// @brief	Writes the message.
+	///		It is passed to the @ref message_sink instead if the sink is installed and the output stream is std::clog or the @ref output of this thread,
+	///		which is flushed when its redirection ends; another output stream is written synchronously.
+	/// @param[in]	file	Path of the source file of the call site.
+	/// @param[in]	line	Line number of the call site.
+	/// @param[in]	msg		Message.
+	void emit(std::string_view const& file, std::uint_least32_t line, std::string_view const& msg) const {
+		if (auto const sink = message_sink().load(std::memory_order_relaxed); sink && (&os_ == &std::clog || &os_ == output())) return sink(os_, file, line, msg);
+		os_ << "[" << file_name(file) << ":" << std::setfill('_') << std::setw(5) << line << "] " << msg << std::endl;
 	}
 
 private:
@@ -113,131 +356,114 @@ private:
 
 /// @brief Trace logger.
 ///		This class logs at entering and leaving scope of source block.
+///		Arguments and results are formatted only if tracing is enabled,
+///		and tracing is removed entirely if the @ref compiled_threshold disables it.
+///		The scope is also recorded as a span if the @ref span_sink is installed.
+/// @tparam	Args	Types of arguments to log.
+template<typename... Args>
 class tracer_t {
 public:
+	/// @brief	Whether tracing is enabled at build time or not.
+	static constexpr bool const compiled = compiled_threshold < trace_level;
+
 	// -----------------------------------
 
 	/// @brief Constructor.
 	///	@param[in]	logger		Logger.
-	///	@param[in]	level		Logging level.
-	///	@param[in]	loc			Source location.
-	tracer_t(logger_t& logger, std::size_t level, std::source_location const& loc = std::source_location::current()) noexcept : logger_{logger}, loc_{loc}, result_{}, level_{level} {
-		std::ostringstream oss;
-		oss << ">>> " << function_name(loc_) << "()";
-		logger_(level_, oss.str(), loc_);
-	}
-	/// @overload
-	///	@param[in]	logger		Logger.
-	///	@param[in]	argument	Argument to log.
-	///	@param[in]	level		Logging level.
-	///	@param[in]	loc			Source location.
-	tracer_t(logger_t& logger, std::size_t level, std::string_view const& argument, std::source_location const& loc = std::source_location::current()) noexcept : logger_{logger}, loc_{loc}, result_{}, level_{level} {
-		std::ostringstream oss;
-		oss << ">>> " << function_name(loc_) << "(" << argument << ")";
-		logger_(level_, oss.str(), loc_);
-	}
-	/// @overload
-	///	@param[in]	logger		Logger.
-	///	@param[in]	arguments	Arguments to log.
-	///	@param[in]	level		Logging level.
-	///	@param[in]	loc			Source location.
-	tracer_t(logger_t& logger, std::size_t level, std::vector<std::string> const& arguments, std::source_location const& loc = std::source_location::current()) noexcept : logger_{logger}, loc_{loc}, result_{}, level_{level} {
-		std::ostringstream oss;
-		oss << ">>> " << function_name(loc_) << "(";
-		if (! arguments.empty()) {
-			oss << arguments.at(0);
-			auto const_ following = arguments | std::views::drop(1);
-			std::ranges::for_each(following, [&oss](auto const& a) { oss << ", " << a; });
+	///	@param[in]	arguments	Arguments to log, which are separated by comma.
+	///	@param[in]	site		Call site.
+	tracer_t(logger_t& logger, Args const&... arguments, site_t const& site = {}) noexcept : logger_{logger}, site_{site}, result_{}, begin_{} {
+		if constexpr (compiled) {
+			if (span_sink().load(std::memory_order_relaxed)) begin_ = std::chrono::steady_clock::now();
+			if (! logger_.enabled(trace_level)) return;
+			std::ostringstream oss;
+			oss << std::boolalpha << ">>> " << site_.function << "(";
+			auto delimiter = "";
+			((oss << delimiter, write(oss, arguments), delimiter = ", "), ...);
+			oss << ")";
+			logger_(trace_level, site_, oss.str());
 		}
-		oss << ")";
-		logger_(level_, oss.str(), loc_);
 	}
-	/// @overload
-	tracer_t(logger_t& logger, std::size_t level, std::vector<std::string_view> const& arguments, std::source_location const& loc = std::source_location::current()) noexcept : logger_{logger}, loc_{loc}, result_{}, level_{level} {
-		std::ostringstream oss;
-		oss << ">>> " << function_name(loc_) << "(";
-		if (! arguments.empty()) {
-			oss << arguments.at(0);
-			std::ranges::for_each(arguments | std::views::drop(1) | std::views::common, [&oss](auto const& a) { oss << ", " << a; });
-		}
-		oss << ")";
-		logger_(level_, oss.str(), loc_);
-	}
-
-	/// @overload
-	explicit tracer_t(logger_t& logger, std::source_location const& loc = std::source_location::current()) noexcept : tracer_t(logger, 10, loc) {}
-	/// @overload
-	tracer_t(logger_t& logger, std::string_view const& argument, std::source_location const& loc = std::source_location::current()) noexcept : tracer_t(logger, 10, argument, loc) {}
-	/// @overload
-	tracer_t(logger_t& logger, std::vector<std::string> const& arguments, std::source_location const& loc = std::source_location::current()) noexcept : tracer_t(logger, 10, arguments, loc) {}
-	/// @overload
-	tracer_t(logger_t& logger, std::vector<std::string_view> const& arguments, std::source_location const& loc = std::source_location::current()) noexcept : tracer_t(logger, 10, arguments, loc) {}
 
 	/// @brief	Destructor.
 	~tracer_t() {
-		std::ostringstream oss;
-		oss << "<<< " << function_name(loc_) << "(" << result_ << ")";
-		logger_(level_, oss.str(), loc_);
+		if constexpr (compiled) {
+			if (auto const sink = span_sink().load(std::memory_order_relaxed); sink && begin_ != std::chrono::steady_clock::time_point{}) sink(site_.function, site_.file, begin_, std::chrono::steady_clock::now());
+			if (! logger_.enabled(trace_level)) return;
+			std::ostringstream oss;
+			oss << "<<< " << site_.function << "(" << result_ << ")";
+			logger_(trace_level, site_, oss.str());
+		}
 	}
 
 	// -----------------------------------
 
 	/// @brief	Sets result.
-	/// @param[in]	result 	Result to log.
-	void set_result(std::string_view const& result) { result_ = result; }
-	/// @overload
-	void set_result(std::string const& result) { result_ = result; }
-	/// @overload
-	void set_result(bool result) { result_ = result ? "true" : "false"; }
-	/// @overload
-	///	@tparam	T	Type of @p result.
-	template<typename T>
-	void set_result(T const& result) {
-		std::ostringstream oss;
-		oss << result;
-		result_ = oss.str();
+	///	@tparam	T	Types of @p result.
+	/// @param[in]	result 	Result to log, which are concatenated.
+	template<typename... T>
+	void set_result(T const&... result) {
+		if constexpr (compiled) {
+			if (! logger_.enabled(trace_level)) return;
+			std::ostringstream oss;
+			oss << std::boolalpha;
+			(write(oss, result), ...);
+			result_ = oss.str();
+		}
 	}
 
-	// -----------------------------------
-
 	/// @brief	Trace the message.
-	/// @param[in]	level 		Logging level.
-	/// @param[in]	message		Message to log.
-	void trace(std::size_t level, std::string_view const& message) { logger_(level, "--- " + std::string{message}, loc_); }
-	/// @overload
-	void trace(std::size_t level, std::string const& message) { logger_(level, "--- " + message, loc_); }
-	/// @overload
-	///	@tparam	T	Type of @p message.
-	template<typename T>
-	void trace(std::size_t level, T const& message) {
-		std::ostringstream oss;
-		oss << "--- " << message;
-		logger_(level, oss.str(), loc_);
+	///	@tparam	T	Types of @p message.
+	/// @param[in]	message		Message to log, which are concatenated.
+	template<typename... T>
+	void trace(T const&... message) {
+		if constexpr (compiled) {
+			if (! logger_.enabled(trace_level)) return;
+			std::ostringstream oss;
+			oss << std::boolalpha << "--- ";
+			(write(oss, message), ...);
+			logger_(trace_level, site_, oss.str());
+		}
 	}
-	/// @overload
-	void trace(std::string_view const& message) { trace(level_, message); }
-	/// @overload
-	void trace(std::string const& message) { trace(level_, message); }
-	/// @overload
-	template<typename T>
-	void trace(T const& message) { trace(level_, message); }
 
 private:
-	/// @brief	Strips function name from source location.
-	/// @param[in]	loc		Source location.
-	/// @return		Simple function name.
-	static std::string function_name(std::source_location const& loc) {
-		std::regex const re{R"(^.* ((?:`?[A-Za-z_][-A-Za-z_0-9<>']*::)*~?[A-Za-z_][A-Za-z_0-9<>]*) ?\(.*$)"};
+	tracer_t(tracer_t const&) = delete;
+
+private:
+	logger_t&							  logger_; ///< @brief  Logger.
+	site_t								  site_;   ///< @brief  Call site.
+	std::string							  result_; ///< @brief  Result.
+	std::chrono::steady_clock::time_point begin_;  ///< @brief  Time when the span begins if it is recorded.
+};
+
+/// @brief	Deduction guide of tracer, whose call site is given by the default argument.
+template<typename... Args>
+tracer_t(logger_t&, Args const&...) -> tracer_t<Args...>;
 
-		std::cmatch match;
-		return std::regex_match(loc.function_name(), match, re) ? match.str(1) : loc.function_name();
+/// @brief	Span of processing a file, which is recorded only if the @ref span_sink is installed.
+///		Unlike the tracer, it is not removed at build time, so that the spans of files are always available.
+class span_t {
+public:
+	/// @brief	Constructor.
+	/// @param[in]	name	Name of the span, which shall live while the process runs.
+	/// @param[in]	path	Path of the file.
+	span_t(std::string_view const& name, std::filesystem::path const& path) : name_{name}, detail_{}, begin_{} {
+		if (! span_sink().load(std::memory_order_relaxed)) return;
+		detail_ = path.string();
+		begin_	= std::chrono::steady_clock::now();
+	}
+	/// @brief	Destructor.
+	~span_t() {
+		if (auto const sink = span_sink().load(std::memory_order_relaxed); sink && begin_ != std::chrono::steady_clock::time_point{}) sink(name_, detail_, begin_, std::chrono::steady_clock::now());
 	}
 
 private:
-	logger_t&			 logger_; ///< @brief  Logger.
-	std::source_location loc_;	  ///< @brief  Source location.
-	std::string			 result_; ///< @brief  Result.
-	std::size_t			 level_;  ///< @brief  Logging level.
+	span_t(span_t const&) = delete;
+
+private:
+	std::string_view					  name_;   ///< @brief  Name.
+	std::string							  detail_; ///< @brief  Path of the file if it is recorded.
+	std::chrono::steady_clock::time_point begin_;  ///< @brief  Time when the span begins if it is recorded.
 };
 
 } // namespace log
@@ -257,8 +483,344 @@ escape(std::string_view const& str, std::size_t limit = 16u) {
 	return std::accumulate(s.begin(), s.end(), std::ostringstream{}, [&ws_](auto&& oss, auto const ch) { if (ws_.contains(ch)) oss << ws_.at(ch); else oss << ch; return std::move(oss); }).str();
 }
 
+/// @brief	Quotes string as a JSON string.
+/// @param[in]	str		String to quote, which is UTF-8.
+/// @return	Quoted string.
+inline std::string
+quote_json(std::string_view const& str) {
+	std::string quoted{"\""};
+	quoted.reserve(str.size() + 2u);
+	for (auto const ch : str) {
+		switch (ch) {
+		case '"': quoted += "\\\""; break;
+		case '\\': quoted += "\\\\"; break;
+		case '\n': quoted += "\\n"; break;
+		case '\r': quoted += "\\r"; break;
+		case '\t': quoted += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(ch) < 0x20u) {
+				constexpr char const digits[] = "0123456789abcdef";
+				quoted.append("\\u00").append(1u, digits[ch >> 4]).append(1u, digits[ch & 0xF]);
+			} else {
+				quoted += ch;
+			}
+			break;
+		}
+	}
+	return quoted += '"';
+}
+
 } // namespace util
 
+// ===========================================================================
+namespace prof {
+
+/// @brief	Phases to profile.
+enum class phase_t : std::uint8_t {
+	load,	   ///< @brief	Loading files.
+	minimize,  ///< @brief	Dropping lines other than directives before the phase 1, e.g., to scan dependencies.
+	decode,	   ///< @brief	Finding non-basic characters in UTF-8.
+	ucn,	   ///< @brief	Escaping non-basic characters as universal character names (phase 1).
+	splice,	   ///< @brief	Splicing lines (phase 2).
+	tokenize,  ///< @brief	Tokenizing (phase 3).
+	split,	   ///< @brief	Splitting tokens into lines.
+	directive, ///< @brief	Handling directives (phase 4).
+	expand,	   ///< @brief	Expanding macros in text lines (phase 4).
+	include,   ///< @brief	Resolving headers of #include.
+};
+
+/// @brief	Number of the phases.
+constexpr std::size_t const phase_count = static_cast<std::size_t>(phase_t::include) + 1u;
+/// @brief	Names of the phases.
+constexpr std::array<std::string_view, phase_count> const phase_names{"load", "minimize", "decode", "ucn", "splice", "tokenize", "split", "directive", "expand", "include"};
+/// @brief	Units of amount of the phases.
+constexpr std::array<std::string_view, phase_count> const phase_units{"bytes", "bytes", "bytes", "bytes", "bytes", "bytes", "lines", "lines", "tokens", "lookups"};
+
+/// @brief	Counter of a phase.
+struct counter_t {
+	std::uint64_t nanoseconds; ///< @brief	Exclusive time, which excludes the nested phases.
+	std::uint64_t calls;	   ///< @brief	Number of the measured scopes.
+	std::uint64_t amount;	   ///< @brief	Amount of the work in the unit of the phase.
+
+	/// @brief	Accumulates the counter.
+	/// @param[in]	rhs		Counter to add.
+	/// @return		This counter.
+	counter_t& operator+=(counter_t const& rhs) noexcept {
+		nanoseconds += rhs.nanoseconds;
+		calls += rhs.calls;
+		amount += rhs.amount;
+		return *this;
+	}
+};
+
+/// @brief	Counters of all the phases.
+struct counters_t {
+	std::array<counter_t, phase_count> phases; ///< @brief	Counters in order of the phases.
+
+	/// @brief	Gets counter of the phase.
+	/// @param[in]	phase	Phase.
+	/// @return		Counter of the phase.
+	counter_t&		 operator[](phase_t phase) noexcept { return phases[static_cast<std::size_t>(phase)]; }
+	/// @overload
+	counter_t const& operator[](phase_t phase) const noexcept { return phases[static_cast<std::size_t>(phase)]; }
+
+	/// @brief	Gets the total time of the phases.
+	/// @return		Total time in nanoseconds.
+	std::uint64_t nanoseconds() const noexcept {
+		return std::accumulate(phases.begin(), phases.end(), std::uint64_t{}, [](auto sum, auto const& a) { return sum + a.nanoseconds; });
+	}
+	/// @brief	Determines whether any phase is measured or not.
+	/// @return		It returns true if no phase is measured; otherwise, it returns false.
+	bool empty() const noexcept {
+		return std::ranges::all_of(phases, [](auto const& a) { return a.calls == 0u; });
+	}
+
+	/// @brief	Accumulates the counters.
+	/// @param[in]	rhs		Counters to add.
+	/// @return		These counters.
+	counters_t& operator+=(counters_t const& rhs) noexcept {
+		for (std::size_t i{}; i < phase_count; ++i) phases[i] += rhs.phases[i];
+		return *this;
+	}
+};
+
+/// @brief	Profile, which is aggregated per file and per thread.
+struct profile_t {
+	std::unordered_map<std::string, counters_t> files;	 ///< @brief	Counters per file, where the empty path is out of any file.
+	std::map<std::size_t, counters_t>			threads; ///< @brief	Counters per thread, which is numbered in order of its first measurement.
+
+	/// @brief	Gets the total of all the threads.
+	/// @return		Total counters.
+	counters_t total() const {
+		return std::accumulate(threads.begin(), threads.end(), counters_t{}, [](auto&& sum, auto const& a) { return std::move(sum += a.second); });
+	}
+};
+
+class scope_t;
+class file_scope_t;
+
+/// @brief	Recorder of a thread, which accumulates counters without any lock.
+///		Its counters are merged into the profile of the process when the thread exits or the profile is collected.
+class recorder_t {
+public:
+	/// @brief	Merges the counters into the profile of the process, and then resets them.
+	void flush() {
+		auto& [mutex, profile] = shared();
+		std::lock_guard lock{mutex};
+		for (auto& [path, counters] : files_) {
+			if (counters.empty()) continue;
+			profile.files[path] += counters;
+			profile.threads[thread_] += counters;
+			counters = {}; // Entries are kept since scopes refer to them.
+		}
+	}
+
+	/// @brief	Gets the profile of the process, which includes the counters of this thread.
+	///		Counters of the other threads are included after they exit.
+	/// @return		Profile.
+	profile_t collect() {
+		flush();
+		auto& [mutex, profile] = shared();
+		std::lock_guard lock{mutex};
+		return profile;
+	}
+
+	/// @brief	Constructor.
+	recorder_t() : thread_{sequence()++}, files_{}, counters_{&files_[std::string{}]}, scope_{} {}
+	/// @brief	Destructor.
+	~recorder_t() { flush(); }
+
+private:
+	recorder_t(recorder_t const&) = delete;
+
+	friend class scope_t;
+	friend class file_scope_t;
+
+	/// @brief	Gets the profile of the process with its mutex.
+	static std::pair<std::mutex, profile_t>& shared() {
+		static std::pair<std::mutex, profile_t> shared;
+		return shared;
+	}
+	/// @brief	Gets the sequence to number the threads.
+	static std::atomic<std::size_t>& sequence() noexcept {
+		static std::atomic<std::size_t> sequence;
+		return sequence;
+	}
+
+private:
+	std::size_t									thread_;   ///< @brief	Number of this thread.
+	std::unordered_map<std::string, counters_t> files_;	   ///< @brief	Counters per file, which are stable while the thread lives.
+	counters_t*									counters_; ///< @brief	Counters of the current file.
+	scope_t*									scope_;	   ///< @brief	The innermost scope, which is paused by the nested one.
+};
+
+/// @brief	Gets the recorder of this thread.
+/// @return		Recorder of this thread.
+inline recorder_t&
+recorder() {
+	thread_local recorder_t recorder;
+	return recorder;
+}
+
+/// @brief	Gets the profile of the process, which includes the counters of this thread and the exited threads.
+/// @return		Profile.
+inline profile_t
+collect() { return recorder().collect(); }
+
+/// @brief	Scoped timer of a phase.
+///		Its time excludes the nested scopes, so that the phases sum up to the measured time.
+class scope_t {
+public:
+	/// @brief	Adds amount of the work.
+	/// @param[in]	amount	Amount of the work in the unit of the phase.
+	void add(std::size_t amount) noexcept { counter_.amount += amount; }
+
+	/// @brief	Constructor.
+	/// @param[in]	phase	Phase.
+	/// @param[in]	amount	Amount of the work in the unit of the phase.
+	explicit scope_t(phase_t phase, std::size_t amount = 0u) : recorder_{recorder()}, counter_{(*recorder_.counters_)[phase]}, parent_{std::exchange(recorder_.scope_, this)}, started_{now()} {
+		if (parent_) parent_->pause(started_);
+		++counter_.calls;
+		counter_.amount += amount;
+	}
+	/// @brief	Destructor.
+	~scope_t() {
+		auto const ended = now();
+		pause(ended);
+		recorder_.scope_ = parent_;
+		if (parent_) parent_->started_ = ended;
+	}
+
+private:
+	scope_t(scope_t const&) = delete;
+
+	/// @brief	Charges the elapsed time to the counter.
+	void pause(std::uint64_t now) noexcept { counter_.nanoseconds += now - started_; }
+	/// @brief	Gets the current time.
+	static std::uint64_t now() noexcept { return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count()); }
+
+private:
+	recorder_t&	  recorder_; ///< @brief	Recorder of this thread.
+	counter_t&	  counter_;	 ///< @brief	Counter of the phase of the current file.
+	scope_t*	  parent_;	 ///< @brief	Enclosing scope.
+	std::uint64_t started_;	 ///< @brief	Time when this scope is started or resumed.
+};
+
+/// @brief	Measures the function as the phase.
+/// @tparam	F	Type of @p f.
+/// @param[in]	phase	Phase.
+/// @param[in]	amount	Amount of the work in the unit of the phase.
+/// @param[in]	f		Function to measure.
+/// @return		Result of the @p f.
+template<typename F>
+inline decltype(auto)
+measure(phase_t phase, std::size_t amount, F&& f) {
+	scope_t const scope{phase, amount};
+	return f();
+}
+
+/// @brief	Attributes the phases in the scope to the file.
+class file_scope_t {
+public:
+	/// @brief	Constructor.
+	/// @param[in]	path	Path of the file.
+	explicit file_scope_t(std::filesystem::path const& path) : recorder_{recorder()}, previous_{std::exchange(recorder_.counters_, &recorder_.files_[path.string()])} {}
+	/// @brief	Destructor.
+	~file_scope_t() { recorder_.counters_ = previous_; }
+
+private:
+	file_scope_t(file_scope_t const&) = delete;
+
+private:
+	recorder_t& recorder_; ///< @brief	Recorder of this thread.
+	counters_t* previous_; ///< @brief	Counters of the previous file.
+};
+
+/// @brief	Writes the profile as tables sorted by cost, i.e., phases, files, and threads.
+/// @param[in]	os		Output stream.
+/// @param[in]	profile	Profile.
+/// @param[in]	limit	Maximum number of the files to write.
+inline void
+write_table(std::ostream& os, profile_t const& profile, std::size_t limit = 20u) {
+	auto const total = profile.total();
+	auto const whole = std::max<std::uint64_t>(total.nanoseconds(), 1u);
+
+	std::ostringstream oss;
+	oss << std::fixed << std::setprecision(3);
+	auto const time = [&oss, whole](std::uint64_t nanoseconds) {
+		oss << std::setw(12) << static_cast<double>(nanoseconds) / 1e6 << std::setw(8) << std::setprecision(1) << 100.0 * static_cast<double>(nanoseconds) / static_cast<double>(whole) << "%" << std::setprecision(3);
+	};
+
+	std::vector<std::size_t> phases(phase_count);
+	std::iota(phases.begin(), phases.end(), std::size_t{});
+	std::ranges::stable_sort(phases, std::ranges::greater{}, [&total](auto i) { return total.phases[i].nanoseconds; });
+	oss << "===== Time report =====\n"
+		<< std::left << std::setw(10) << "phase" << std::right << std::setw(12) << "time(ms)" << std::setw(9) << "ratio" << std::setw(10) << "calls" << std::setw(14) << "amount" << "\n";
+	for (auto const i : phases) {
+		auto const& counter = total.phases[i];
+		if (counter.calls == 0u) continue;
+		oss << std::left << std::setw(10) << phase_names[i] << std::right;
+		time(counter.nanoseconds);
+		oss << std::setw(10) << counter.calls << std::setw(14) << counter.amount << " " << phase_units[i] << "\n";
+	}
+	oss << std::left << std::setw(10) << "total" << std::right;
+	time(total.nanoseconds());
+	oss << "\n";
+
+	std::vector<std::pair<std::string_view, std::uint64_t>> files;
+	for (auto const& [path, counters] : profile.files) files.emplace_back(path.empty() ? std::string_view{"(others)"} : std::string_view{path}, counters.nanoseconds());
+	std::ranges::sort(files, std::ranges::greater{}, [](auto const& a) { return a.second; });
+	oss << "----- files (" << std::min(limit, files.size()) << " of " << files.size() << ") -----\n";
+	for (auto const& [path, nanoseconds] : files | std::views::take(limit)) {
+		time(nanoseconds);
+		oss << "  " << path << "\n";
+	}
+
+	oss << "----- threads -----\n";
+	for (auto const& [thread, counters] : profile.threads) {
+		time(counters.nanoseconds());
+		oss << "  #" << thread << "\n";
+	}
+	os << std::move(oss).str() << std::flush;
+}
+
+/// @brief	Writes the profile as JSON.
+/// @param[in]	os		Output stream.
+/// @param[in]	profile	Profile.
+inline void
+write_json(std::ostream& os, profile_t const& profile) {
+	std::ostringstream oss;
+	auto const		   phases = [&oss](counters_t const& counters) {
+		  oss << "{\"nanoseconds\":" << counters.nanoseconds() << ",\"phases\":{";
+		  for (std::size_t i{}; i < phase_count; ++i) {
+			  auto const& counter = counters.phases[i];
+			  oss << (i == 0u ? "" : ",") << "\"" << phase_names[i] << "\":{\"nanoseconds\":" << counter.nanoseconds << ",\"calls\":" << counter.calls << ",\"amount\":" << counter.amount << "}";
+		  }
+		  oss << "}}";
+	};
+
+	oss << "{\"units\":{";
+	for (std::size_t i{}; i < phase_count; ++i) oss << (i == 0u ? "" : ",") << "\"" << phase_names[i] << "\":\"" << phase_units[i] << "\"";
+	oss << "},\"total\":";
+	phases(profile.total());
+	oss << ",\"files\":{";
+	auto delimiter = "";
+	for (auto const& [path, counters] : profile.files) {
+		oss << std::exchange(delimiter, ",") << util::quote_json(path) << ":";
+		phases(counters);
+	}
+	oss << "},\"threads\":{";
+	delimiter = "";
+	for (auto const& [thread, counters] : profile.threads) {
+		oss << std::exchange(delimiter, ",") << "\"" << thread << "\":";
+		phases(counters);
+	}
+	oss << "}}\n";
+	os << std::move(oss).str() << std::flush;
+}
+
+} // namespace prof
+
 // ===========================================================================
 namespace uc {
 
@@ -326,27 +888,27 @@ get_type(char ch) noexcept {
 /// @param[in]	ch 	Character.
 /// @return 	Head of the single character, or invalid character.
 constexpr inline char32_t
-get_head1(char ch) noexcept { return is_head1(ch) ? ch : static_cast<char32_t>(~0uL); }
+get_head1(char ch) noexcept { return is_head1(ch) ? static_cast<char32_t>(ch) : static_cast<char32_t>(~0uL); }
 /// @brief	Gets character as trail of a character.
 /// @param[in]	ch 	Character.
 /// @return 	Trail of the character, or invalid character.
 constexpr inline char32_t
-get_trail(char ch) noexcept { return is_head1(ch) ? (ch & ~0b1100'0000) : static_cast<char32_t>(~0uL); }
+get_trail(char ch) noexcept { return is_trail(ch) ? (static_cast<unsigned char>(ch) & 0b0011'1111u) : static_cast<char32_t>(~0uL); }
 /// @brief	Gets character as head of two-bytes character.
 /// @param[in]	ch 	Character.
 /// @return 	Head of the two-bytes character, or invalid character.
 constexpr inline char32_t
-get_head2(char ch) noexcept { return is_head2(ch) ? (ch & ~0b1110'0000) : static_cast<char32_t>(~0uL); }
+get_head2(char ch) noexcept { return is_head2(ch) ? (static_cast<unsigned char>(ch) & 0b0001'1111u) : static_cast<char32_t>(~0uL); }
 /// @brief	Gets character as head of three-bytes character.
 /// @param[in]	ch 	Character.
 /// @return 	Head of the three-bytes character, or invalid character.
 constexpr inline char32_t
-get_head3(char ch) noexcept { return is_head3(ch) ? (ch & ~0b1111'0000) : static_cast<char32_t>(~0uL); }
+get_head3(char ch) noexcept { return is_head3(ch) ? (static_cast<unsigned char>(ch) & 0b0000'1111u) : static_cast<char32_t>(~0uL); }
 /// @brief	Gets character as head of four-bytes character.
 /// @param[in]	ch 	Character.
 /// @return 	Head of the four-bytes character, or invalid character.
 constexpr inline char32_t
-get_head4(char ch) noexcept { return is_head4(ch) ? (ch & ~0b1111'1000) : static_cast<char32_t>(~0uL); }
+get_head4(char ch) noexcept { return is_head4(ch) ? (static_cast<unsigned char>(ch) & 0b0000'0111u) : static_cast<char32_t>(~0uL); }
 /// @brief	Gets whether the @p ch is valid byte of UTF-8 character or not.
 /// @param[in]	ch 	Character.
 /// @return 	Whether the @p ch is valid byte of UTF-8 character or not.
@@ -362,38 +924,34 @@ inline std::tuple<std::string_view, char32_t>
 get_head_ucs32(std::string_view const& sv) {
 	using enum type_t;
 	if (sv.empty()) return {};
-	auto const ch = sv.at(0u);
+	auto const ch		 = sv[0u];
+	auto const trail = [&sv](std::size_t n) {
+		if (sv.size() <= n || ! is_trail(sv[n])) throw std::invalid_argument(util::escape(sv, n + 1u));
+		return get_trail(sv[n]);
+	};
 	switch (get_type(ch)) {
 	// -----------------------------------
-	case H1: return {sv.substr(1u), get_head1(sv.at(0u))};
+	case H1: return {sv.substr(1u), get_head1(ch)};
 	// -----------------------------------
 	case H2: {
-		if (! is_trail(sv.at(1u))) throw std::invalid_argument(std::string{sv.substr(1u, 1u)});
-		auto const v = get_head2(ch) << 6 | get_trail(sv.at(1u));
-		if (! is_valid(v)) throw std::invalid_argument(util::escape(sv, 2u));
+		auto const v = get_head2(ch) << 6 | trail(1u);
 		return {sv.substr(2u), v};
 	}
 	// -----------------------------------
 	case H3: {
-		if (! is_trail(sv.at(1u))) throw std::invalid_argument(std::string{sv.substr(1u, 1u)});
-		if (! is_trail(sv.at(2u))) throw std::invalid_argument(std::string{sv.substr(2u, 1u)});
-		auto const v = get_head3(ch) << 12 | get_trail(sv.at(1u)) << 6 | get_trail(sv.at(2u));
-		if (! is_valid(v)) throw std::invalid_argument(util::escape(sv, 3u));
+		auto const v = get_head3(ch) << 12 | trail(1u) << 6 | trail(2u);
 		return {sv.substr(3u), v};
 	}
 	// -----------------------------------
 	case H4: {
-		if (! is_trail(sv.at(1))) throw std::invalid_argument(std::string{sv.substr(1u, 1u)});
-		if (! is_trail(sv.at(2))) throw std::invalid_argument(std::string{sv.substr(2u, 1u)});
-		if (! is_trail(sv.at(3))) throw std::invalid_argument(std::string{sv.substr(3u, 1u)});
-		auto const v = get_head4(ch) << 18 | get_trail(sv.at(1u)) << 12 | get_trail(sv.at(2u)) << 6 | get_trail(sv.at(3u));
+		auto const v = get_head4(ch) << 18 | trail(1u) << 12 | trail(2u) << 6 | trail(3u);
 		if (! is_valid(v)) throw std::invalid_argument(util::escape(sv, 4u));
 		return {sv.substr(4u), v};
 	}
 	// -----------------------------------
 	case E:
 	default:
-		throw std::invalid_argument(std::string{sv.substr(0u, 1u)});
+		throw std::invalid_argument(util::escape(sv, 1u));
 	}
 }
 
@@ -402,17 +960,303 @@ get_head_ucs32(std::string_view const& sv) {
 ///	@return		UTF-32 string.
 inline std::u32string
 to_32string(std::string_view const& str) {
-	std::basic_ostringstream<char32_t> oss;
+	std::u32string u32;
+	u32.reserve(str.size());
 	for (auto s = str; ! s.empty();) {
 		auto const [rest, ch] = get_head_ucs32(s);
-		oss << ch;
+		u32.push_back(ch);
 		s = rest;
 	}
-	return oss.str();
+	return u32;
 }
 
 } // namespace uc
 
+// ===========================================================================
+namespace simd {
+
+/// @brief	Instruction set of the kernels.
+enum class isa_t {
+	scalar, ///< @brief	Portable scalar implementation.
+	sse2,	///< @brief	SSE2 (16 bytes per block).
+	avx2,	///< @brief	AVX2 (32 bytes per block).
+};
+
+/// @brief	Kernels, which are selected by the instruction set at runtime.
+struct kernels_t {
+	std::size_t (*skip_blanks)(char const* p, std::size_t n) noexcept;			///< @brief	Gets length of leading blanks ([ \t\v\f]).
+	std::size_t (*count)(char const* p, std::size_t n, char ch) noexcept;		///< @brief	Counts the character.
+	std::size_t (*find_either)(char const* p, std::size_t n, char a, char b) noexcept; ///< @brief	Finds either of the characters.
+	std::size_t (*skip_basic)(char const* p, std::size_t n) noexcept;			///< @brief	Gets length of leading bytes of the basic source character set.
+};
+
+namespace scalar {
+
+/// @brief	Checks if the byte is blank ([ \t\v\f]).
+/// @param[in]	ch	Byte.
+/// @return		Whether the byte is blank or not.
+constexpr inline bool
+is_blank(char ch) noexcept { return ch == ' ' || ch == '\t' || ch == '\v' || ch == '\f'; }
+
+/// @brief	Checks if the byte is in the basic source character set.
+///		They are all the printable ASCII characters except [$@`], and [\t\n\v\f\r].
+/// @param[in]	ch	Byte.
+/// @return		Whether the byte is in the basic source character set or not.
+constexpr inline bool
+is_basic(char ch) noexcept {
+	auto const c = static_cast<unsigned char>(ch);
+	return (0x20u <= c && c < 0x7Fu && c != '$' && c != '@' && c != '`') || ('\t' <= c && c <= '\r');
+}
+
+/// @copydoc	kernels_t::skip_blanks
+inline std::size_t
+skip_blanks(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	while (i < n && is_blank(p[i])) ++i;
+	return i;
+}
+/// @copydoc	kernels_t::count
+inline std::size_t
+count(char const* p, std::size_t n, char ch) noexcept { return static_cast<std::size_t>(std::count(p, p + n, ch)); }
+/// @copydoc	kernels_t::find_either
+inline std::size_t
+find_either(char const* p, std::size_t n, char a, char b) noexcept {
+	std::size_t i{};
+	while (i < n && p[i] != a && p[i] != b) ++i;
+	return i;
+}
+/// @copydoc	kernels_t::skip_basic
+inline std::size_t
+skip_basic(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	while (i < n && is_basic(p[i])) ++i;
+	return i;
+}
+
+} // namespace scalar
+
+#if defined(xxx_simd_x86)
+
+namespace sse2 {
+
+/// @brief	Gets mask of blank bytes in the block.
+/// @param[in]	v	Block.
+/// @return		Mask of blank bytes.
+inline __m128i
+blanks(__m128i v) noexcept {
+	auto const space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+	auto const tab	 = _mm_cmpeq_epi8(v, _mm_set1_epi8('\t'));
+	auto const vt	 = _mm_cmpeq_epi8(v, _mm_set1_epi8('\v'));
+	auto const ff	 = _mm_cmpeq_epi8(v, _mm_set1_epi8('\f'));
+	return _mm_or_si128(_mm_or_si128(space, tab), _mm_or_si128(vt, ff));
+}
+
+/// @copydoc	kernels_t::skip_blanks
+inline std::size_t
+skip_blanks(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	for (; i + 16u <= n; i += 16u) {
+		auto const mask = static_cast<unsigned>(_mm_movemask_epi8(blanks(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i)))));
+		if (mask != 0xFFFFu) return i + std::countr_one(mask);
+	}
+	return i + scalar::skip_blanks(p + i, n - i);
+}
+/// @copydoc	kernels_t::count
+inline std::size_t
+count(char const* p, std::size_t n, char ch) noexcept {
+	std::size_t i{}, c{};
+	auto const	target = _mm_set1_epi8(ch);
+	for (; i + 16u <= n; i += 16u) {
+		auto const mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i)), target)));
+		c += static_cast<std::size_t>(std::popcount(mask));
+	}
+	return c + scalar::count(p + i, n - i, ch);
+}
+/// @copydoc	kernels_t::find_either
+inline std::size_t
+find_either(char const* p, std::size_t n, char a, char b) noexcept {
+	std::size_t i{};
+	auto const	va = _mm_set1_epi8(a);
+	auto const	vb = _mm_set1_epi8(b);
+	for (; i + 16u <= n; i += 16u) {
+		auto const v	= _mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i));
+		auto const mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, va), _mm_cmpeq_epi8(v, vb))));
+		if (mask != 0u) return i + std::countr_zero(mask);
+	}
+	return i + scalar::find_either(p + i, n - i, a, b);
+}
+
+/// @brief	Gets mask of bytes out of the basic source character set in the block.
+/// @param[in]	v	Block.
+/// @return		Mask of the bytes, which include all the non-ASCII bytes.
+inline __m128i
+non_basics(__m128i v) noexcept {
+	auto const controls = _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)); // including non-ASCII bytes as negative
+	auto const spaces	= _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+	auto const others	= _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('$')), _mm_cmpeq_epi8(v, _mm_set1_epi8('@'))),
+									   _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('`')), _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F))));
+	return _mm_or_si128(_mm_andnot_si128(spaces, controls), others);
+}
+
+/// @copydoc	kernels_t::skip_basic
+inline std::size_t
+skip_basic(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	for (; i + 16u <= n; i += 16u) {
+		auto const mask = static_cast<unsigned>(_mm_movemask_epi8(non_basics(_mm_loadu_si128(reinterpret_cast<__m128i const*>(p + i)))));
+		if (mask != 0u) return i + std::countr_zero(mask);
+	}
+	return i + scalar::skip_basic(p + i, n - i);
+}
+
+} // namespace sse2
+
+namespace avx2 {
+
+/// @brief	Gets mask of blank bytes in the block.
+/// @param[in]	v	Block.
+/// @return		Mask of blank bytes.
+xxx_target_avx2 inline __m256i
+blanks(__m256i v) noexcept {
+	auto const space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+	auto const tab	 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t'));
+	auto const vt	 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\v'));
+	auto const ff	 = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\f'));
+	return _mm256_or_si256(_mm256_or_si256(space, tab), _mm256_or_si256(vt, ff));
+}
+
+/// @copydoc	kernels_t::skip_blanks
+xxx_target_avx2 inline std::size_t
+skip_blanks(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	for (; i + 32u <= n; i += 32u) {
+		auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(blanks(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i)))));
+		if (mask != 0xFFFF'FFFFu) return i + std::countr_one(mask);
+	}
+	return i + sse2::skip_blanks(p + i, n - i);
+}
+/// @copydoc	kernels_t::count
+xxx_target_avx2 inline std::size_t
+count(char const* p, std::size_t n, char ch) noexcept {
+	std::size_t i{}, c{};
+	auto const	target = _mm256_set1_epi8(ch);
+	for (; i + 32u <= n; i += 32u) {
+		auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i)), target)));
+		c += static_cast<std::size_t>(std::popcount(mask));
+	}
+	return c + sse2::count(p + i, n - i, ch);
+}
+/// @copydoc	kernels_t::find_either
+xxx_target_avx2 inline std::size_t
+find_either(char const* p, std::size_t n, char a, char b) noexcept {
+	std::size_t i{};
+	auto const	va = _mm256_set1_epi8(a);
+	auto const	vb = _mm256_set1_epi8(b);
+	for (; i + 32u <= n; i += 32u) {
+		auto const v	= _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i));
+		auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, va), _mm256_cmpeq_epi8(v, vb))));
+		if (mask != 0u) return i + std::countr_zero(mask);
+	}
+	return i + sse2::find_either(p + i, n - i, a, b);
+}
+
+/// @brief	Gets mask of bytes out of the basic source character set in the block.
+/// @param[in]	v	Block.
+/// @return		Mask of the bytes, which include all the non-ASCII bytes.
+xxx_target_avx2 inline __m256i
+non_basics(__m256i v) noexcept {
+	auto const controls = _mm256_cmpgt_epi8(_mm256_set1_epi8(0x20), v); // including non-ASCII bytes as negative
+	auto const spaces	= _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+	auto const others	= _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('$')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8('@'))),
+										  _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('`')), _mm256_cmpeq_epi8(v, _mm256_set1_epi8(0x7F))));
+	return _mm256_or_si256(_mm256_andnot_si256(spaces, controls), others);
+}
+
+/// @copydoc	kernels_t::skip_basic
+xxx_target_avx2 inline std::size_t
+skip_basic(char const* p, std::size_t n) noexcept {
+	std::size_t i{};
+	for (; i + 32u <= n; i += 32u) {
+		auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(non_basics(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(p + i)))));
+		if (mask != 0u) return i + std::countr_zero(mask);
+	}
+	return i + sse2::skip_basic(p + i, n - i);
+}
+
+} // namespace avx2
+
+#endif // xxx_simd_x86
+
+/// @brief	Detects the best instruction set of this processor.
+/// @return		The best instruction set.
+inline isa_t
+detect() noexcept {
+#if defined(xxx_simd_x86) && defined(_MSC_VER)
+	int info[4]{};
+	__cpuidex(info, 7, 0);
+	auto const avx2	 = (info[1] & (1 << 5)) != 0;
+	__cpuid(info, 1);
+	auto const osxsave = (info[2] & (1 << 27)) != 0;
+	return (avx2 && osxsave && (_xgetbv(0) & 0b110u) == 0b110u) ? isa_t::avx2 : isa_t::sse2;
+#elif defined(xxx_simd_x86)
+	return __builtin_cpu_supports("avx2") ? isa_t::avx2 : isa_t::sse2;
+#else
+	return isa_t::scalar;
+#endif
+}
+
+/// @brief	Gets kernels of the instruction set.
+/// @param[in]	isa		Instruction set, which shall be supported by this processor.
+/// @return		Kernels of the instruction set.
+inline kernels_t const&
+kernels(isa_t isa) noexcept {
+	static constexpr kernels_t const scalar{&scalar::skip_blanks, &scalar::count, &scalar::find_either, &scalar::skip_basic};
+#if defined(xxx_simd_x86)
+	static constexpr kernels_t const sse2{&sse2::skip_blanks, &sse2::count, &sse2::find_either, &sse2::skip_basic};
+	static constexpr kernels_t const avx2{&avx2::skip_blanks, &avx2::count, &avx2::find_either, &avx2::skip_basic};
+	switch (isa) {
+	case isa_t::avx2: return avx2;
+	case isa_t::sse2: return sse2;
+	default: return scalar;
+	}
+#else
+	return scalar;
+#endif
+}
+/// @overload
+/// @return		Kernels of the best instruction set, which is selected at the first call.
+inline kernels_t const&
+kernels() noexcept {
+	static kernels_t const& selected = kernels(detect());
+	return selected;
+}
+
+/// @brief	Gets length of leading blanks ([ \t\v\f]).
+/// @param[in]	str		String.
+/// @return		Length of the leading blanks.
+inline std::size_t
+skip_blanks(std::string_view const& str) noexcept { return kernels().skip_blanks(str.data(), str.size()); }
+/// @brief	Counts the character.
+/// @param[in]	str		String.
+/// @param[in]	ch		Character to count.
+/// @return		Number of the character.
+inline std::size_t
+count(std::string_view const& str, char ch) noexcept { return kernels().count(str.data(), str.size(), ch); }
+/// @brief	Finds either of the characters.
+/// @param[in]	str		String.
+/// @param[in]	a		Character to find.
+/// @param[in]	b		Character to find.
+/// @return		Position of the found character, or size of the @p str if not found.
+inline std::size_t
+find_either(std::string_view const& str, char a, char b) noexcept { return kernels().find_either(str.data(), str.size(), a, b); }
+/// @brief	Gets length of leading bytes of the basic source character set.
+/// @param[in]	str		String.
+/// @return		Length of the leading bytes.
+inline std::size_t
+skip_basic(std::string_view const& str) noexcept { return kernels().skip_basic(str.data(), str.size()); }
+
+} // namespace simd
+
 // ===========================================================================
 namespace util {
 
@@ -432,34 +1276,365 @@ push_back(std::vector<T> const& container, Y const& value) {
 	return c;
 }
 
-/// @brief	Loads while contexts of the file onto memory as string.
-/// @param[in]	path	Path of the file to read.
-/// @return		Contents of the file.
-inline std::string
-load_file(std::filesystem::path const& path) {
+/// @brief	Gets number of concurrent jobs by default.
+/// @return		Number of hardware threads, or one if it is unknown.
+inline std::size_t
+default_jobs() noexcept { return std::max(1u, std::thread::hardware_concurrency()); }
+
+/// @brief	Calls the function for each index in parallel.
+///		A bounded number of workers, including the calling thread, claim indices one by one from a shared cursor,
+///		so that a slow task does not hold the others and thousands of tasks do not create thousands of threads.
+/// @tparam	F	Type of @p f.
+/// @param[in]	count	Number of indices.
+/// @param[in]	jobs	Maximum number of concurrent workers.
+/// @param[in]	f		Function to call with an index.
+/// @throw	The first exception thrown by the @p f, after all the workers stop claiming indices.
+template<typename F>
+inline void
+parallel_for(std::size_t count, std::size_t jobs, F&& f) {
+	std::atomic<std::size_t> cursor{};
+	std::atomic<bool>		 failed{};
+	std::exception_ptr		 exception;
+	std::mutex				 mutex;
+
+	auto const work = [&]() {
+		for (auto i = cursor++; i < count && ! failed; i = cursor++) {
+			try {
+				f(i);
+			} catch (...) {
+				std::lock_guard lock{mutex};
+				if (! exception) exception = std::current_exception();
+				failed = true;
+			}
+		}
+	};
+	{
+		std::vector<std::jthread> workers;
+		auto const				  n = std::min(std::max(jobs, std::size_t{1u}), count);
+		workers.reserve(n);
+		for (std::size_t i = 1u; i < n; ++i) workers.emplace_back(work);
+		work();
+	}
+	if (exception) std::rethrow_exception(exception);
+}
+
+/// @brief	Bounded queue of a single producer and a single consumer without any lock.
+///		The producer and the consumer may be different threads, but each of them shall be a thread at a time.
+/// @tparam	T	Type of elements.
+template<typename T>
+class spsc_ring_t {
+public:
+	/// @brief	Pushes the element as the producer.
+	/// @tparam	U	Type of @p value.
+	/// @param[in]	value	Element, which is moved only if it is pushed.
+	/// @return		It returns false if the ring is full; otherwise, it returns true.
+	template<typename U>
+	bool try_push(U&& value) {
+		auto const tail = tail_.load(std::memory_order_relaxed);
+		if (tail - head_.load(std::memory_order_acquire) == slots_.size()) return false;
+		slots_[tail & mask_] = std::forward<U>(value);
+		tail_.store(tail + 1u, std::memory_order_release);
+		return true;
+	}
+	/// @brief	Pops the element as the consumer.
+	/// @return		The first element, or std::nullopt if the ring is empty.
+	std::optional<T> try_pop() {
+		auto const head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire)) return std::nullopt;
+		std::optional<T> value{std::move(slots_[head & mask_])};
+		head_.store(head + 1u, std::memory_order_release);
+		return value;
+	}
+
+	/// @brief	Gets capacity of the ring.
+	/// @return		Capacity, which is a power of two.
+	std::size_t capacity() const noexcept { return slots_.size(); }
+
+	/// @brief	Constructor.
+	/// @param[in]	capacity	Capacity, which is rounded up to a power of two.
+	explicit spsc_ring_t(std::size_t capacity) : slots_(std::bit_ceil(std::max(capacity, std::size_t{1u}))), mask_{slots_.size() - 1u}, head_{}, tail_{} {}
+
+private:
+	spsc_ring_t(spsc_ring_t const&) = delete;
+
+private:
+	std::vector<T>						  slots_; ///< @brief	Slots of the elements.
+	std::size_t							  mask_;  ///< @brief	Mask of indices of the slots.
+	alignas(64) std::atomic<std::size_t> head_;	  ///< @brief	Count of the popped elements, which is written by the consumer.
+	alignas(64) std::atomic<std::size_t> tail_;	  ///< @brief	Count of the pushed elements, which is written by the producer.
+};
+
+/// @brief	Immutable buffer of contents of a file.
+///		Its implementation is pluggable, e.g., a memory-mapped file or a string read at once.
+class file_buffer_t {
+public:
+	/// @brief	Gets all the bytes of the file.
+	/// @return		All the bytes of the file.
+	virtual std::string_view bytes() const noexcept = 0;
+	/// @brief	Gets contents of the file, which exclude the BOM if exists.
+	/// @return		Contents of the file.
+	std::string_view view() const noexcept {
+		auto const b = bytes();
+		return b.starts_with("\xEF\xBB\xBF") ? b.substr(3u) : b;
+	}
+
+	/// @brief	Destructor.
+	virtual ~file_buffer_t() = default;
+
+protected:
+	/// @brief	Constructor.
+	file_buffer_t() = default;
+
+private:
+	file_buffer_t(file_buffer_t const&) = delete;
+};
+
+/// @brief	Shared pointer of file buffer.
+using file_buffer_ptr_t = std::shared_ptr<file_buffer_t const>;
+
+/// @brief	File buffer, which owns a string.
+class string_buffer_t : public file_buffer_t {
+public:
+	/// @copydoc	file_buffer_t::bytes
+	std::string_view bytes() const noexcept override { return str_; }
+
+	/// @brief	Constructor.
+	/// @param[in]	str		Contents of the file.
+	explicit string_buffer_t(std::string&& str) : str_{std::move(str)} {}
+
+private:
+	std::string const str_; ///< @brief	Contents of the file.
+};
+
+#if defined(xxx_posix)
+/// @brief	File buffer, which maps a file read-only.
+class mapped_buffer_t : public file_buffer_t {
+public:
+	/// @copydoc	file_buffer_t::bytes
+	std::string_view bytes() const noexcept override { return {static_cast<char const*>(address_), size_}; }
+
+	/// @brief	Constructor.
+	/// @param[in]	fd		File descriptor to map, which can be closed after the construction.
+	/// @param[in]	size	Size of the file, which shall not be zero.
+	/// @throw	std::invalid_argument	The file cannot be mapped.
+	mapped_buffer_t(int fd, std::size_t size) : address_{::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0)}, size_{size} {
+		if (address_ == MAP_FAILED) throw std::invalid_argument("mmap:" + std::to_string(errno));
+		::madvise(address_, size_, MADV_SEQUENTIAL);
+	}
+	/// @brief	Destructor.
+	~mapped_buffer_t() override { ::munmap(address_, size_); }
+
+private:
+	void*		address_; ///< @brief	Mapped address.
+	std::size_t size_;	  ///< @brief	Size of the mapped file.
+};
+#endif // xxx_posix
+
+/// @brief	Minimum size of files to be mapped.
+///		Smaller files are read at once, since the mapping costs more than copying a few pages.
+constexpr std::size_t const mapping_threshold = 16u * 1024u;
+
+/// @brief	Opens the file as an immutable buffer.
+///		A regular file is mapped if it is large enough, otherwise it is read at once.
+///		Non-regular files such as pipes are read until their end.
+/// @param[in]	path	Path of the file to open.
+/// @return		Buffer of the file.
+/// @throw	std::invalid_argument	The file cannot be opened or read.
+inline file_buffer_ptr_t
+open_file(std::filesystem::path const& path) {
 	log::logger_t logger;
-	log::tracer_t tracer{logger, path.string()};
+	log::tracer_t tracer{logger, path};
+	prof::scope_t scope{prof::phase_t::load};
 
-	// -----------------------------------
-	//	Checks the path is valid.
-	if (path.empty() || ! std::filesystem::exists(path)) throw std::invalid_argument(path.string());
-	//	Opens the file.
+	if (path.empty()) throw std::invalid_argument(path.string());
+#if defined(xxx_posix)
+	auto const fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) throw std::invalid_argument(path.string());
+	struct closer_t {
+		int fd;
+		~closer_t() { ::close(fd); }
+	} const closer{fd};
+
+	struct ::stat st {};
+	if (::fstat(fd, &st) != 0) throw std::invalid_argument(path.string());
+	auto const regular = S_ISREG(st.st_mode);
+	auto const size	   = regular ? static_cast<std::size_t>(st.st_size) : 0u;
+	scope.add(size);
+	if (mapping_threshold <= size) return std::make_shared<mapped_buffer_t const>(fd, size);
+
+	std::string str(size, '\0');
+	for (std::size_t pos{};;) {
+		if (pos == str.size()) {
+			if (regular) break;
+			str.resize(std::max<std::size_t>(str.size() * 2u, 4096u));
+		}
+		auto const n = ::read(fd, str.data() + pos, str.size() - pos);
+		if (n < 0 && errno == EINTR) continue;
+		if (n < 0) throw std::invalid_argument(path.string());
+		if (n == 0) {
+			str.resize(pos); // The file is shrunk or the pipe is closed.
+			break;
+		}
+		pos += static_cast<std::size_t>(n);
+	}
+	return std::make_shared<string_buffer_t const>(std::move(str));
+#else
+	if (! std::filesystem::is_regular_file(path)) throw std::invalid_argument(path.string());
 	std::ifstream ifs;
 	ifs.exceptions(std::ios::badbit | std::ios::failbit);
 	ifs.open(path, std::ios::in | std::ios::binary);
-	ifs.exceptions(std::ios::badbit);
 
-	// -----------------------------------
-	//	Gets size of the file.
-	auto const size = std::filesystem::file_size(path);
-	if (size == 0u) return {}; // Nothing to read because the file is empty.
+	std::string str(static_cast<std::size_t>(std::filesystem::file_size(path)), '\0');
+	scope.add(str.size());
+	ifs.read(str.data(), static_cast<std::streamsize>(str.size()));
+	return std::make_shared<string_buffer_t const>(std::move(str));
+#endif
+}
 
-	// -----------------------------------
-	std::ostringstream oss;
-	std::copy(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>(), std::ostreambuf_iterator<char>(oss));
-	auto const s = oss.str();
-	// Removes the BOM if exists.
-	return s.starts_with("\xEF\xBB\xBF") ? s.substr(3u) : s;
+/// @brief	Loads while contexts of the file onto memory as string.
+/// @param[in]	path	Path of the file to read.
+/// @return		Contents of the file, which exclude the BOM if exists.
+inline std::string
+load_file(std::filesystem::path const& path) { return std::string{open_file(path)->view()}; }
+
+/// @brief	Identity of file, which is the same for all the paths of the file, e.g., via links.
+struct file_id_t {
+	std::uint64_t device; ///< @brief	Device of the file.
+	std::uint64_t inode;  ///< @brief	Inode of the file, or hash of the canonical path if inodes are not available.
+
+	bool operator==(file_id_t const&) const noexcept = default;
+};
+
+/// @brief	Hash of file identity.
+struct file_id_hash_t {
+	std::size_t operator()(file_id_t const& id) const noexcept { return std::hash<std::uint64_t>{}(id.inode) ^ (std::hash<std::uint64_t>{}(id.device) * 0x9E3779B97F4A7C15ull); }
+};
+
+/// @brief	Stamp of file, which changes if the file is modified.
+struct file_stamp_t {
+	file_id_t	  id;	 ///< @brief	Identity of the file.
+	std::uint64_t size;	 ///< @brief	Size of the file.
+	std::int64_t  mtime; ///< @brief	Last modification time of the file in nanoseconds.
+
+	bool operator==(file_stamp_t const&) const noexcept = default;
+};
+
+/// @brief	Gets stamp of the file.
+/// @param[in]	path	Path of the file.
+/// @return		Stamp of the file, or std::nullopt if the file does not exist.
+inline std::optional<file_stamp_t>
+file_stamp(std::filesystem::path const& path) {
+#if defined(xxx_posix)
+	struct ::stat st {};
+	if (::stat(path.c_str(), &st) != 0) return std::nullopt;
+	auto const mtime = static_cast<std::int64_t>(st.st_mtim.tv_sec) * 1'000'000'000 + st.st_mtim.tv_nsec;
+	return file_stamp_t{{static_cast<std::uint64_t>(st.st_dev), static_cast<std::uint64_t>(st.st_ino)}, static_cast<std::uint64_t>(st.st_size), mtime};
+#else
+	std::error_code error;
+	auto const		canonical = std::filesystem::canonical(path, error);
+	auto const		size	  = std::filesystem::file_size(canonical, error);
+	auto const		mtime	  = std::filesystem::last_write_time(canonical, error);
+	if (error) return std::nullopt;
+	return file_stamp_t{{0u, std::hash<std::filesystem::path::string_type>{}(canonical.native())}, size, std::chrono::duration_cast<std::chrono::nanoseconds>(mtime.time_since_epoch()).count()};
+#endif
+}
+
+/// @brief	Gets identity of the file.
+/// @param[in]	path	Path of the file.
+/// @return		Identity of the file, or std::nullopt if the file does not exist.
+inline std::optional<file_id_t>
+file_id(std::filesystem::path const& path) {
+	auto const stamp = file_stamp(path);
+	return stamp ? std::optional{stamp->id} : std::nullopt;
+}
+
+/// @brief	Hashes the bytes by XXH64, which is fast enough to validate contents of files.
+/// @param[in]	bytes	Bytes to hash.
+/// @param[in]	seed	Seed of the hash.
+/// @return		Hash of the bytes.
+inline std::uint64_t
+hash64(std::string_view const& bytes, std::uint64_t seed = 0u) noexcept {
+	constexpr std::uint64_t const prime1 = 0x9E3779B185EBCA87ull;
+	constexpr std::uint64_t const prime2 = 0xC2B2AE3D27D4EB4Full;
+	constexpr std::uint64_t const prime3 = 0x165667B19E3779F9ull;
+	constexpr std::uint64_t const prime4 = 0x85EBCA77C2B2AE63ull;
+	constexpr std::uint64_t const prime5 = 0x27D4EB2F165667C5ull;
+
+	auto const read64 = [](char const* p) noexcept {
+		std::uint64_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	};
+	auto const read32 = [](char const* p) noexcept {
+		std::uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	};
+	auto const round = [](std::uint64_t acc, std::uint64_t input) noexcept { return std::rotl(acc + input * prime2, 31) * prime1; };
+	auto const merge = [&round](std::uint64_t acc, std::uint64_t value) noexcept { return (acc ^ round(0u, value)) * prime1 + prime4; };
+
+	auto		p	 = bytes.data();
+	auto const	last = p + bytes.size();
+	std::uint64_t h;
+	if (32u <= bytes.size()) {
+		std::uint64_t v1 = seed + prime1 + prime2, v2 = seed + prime2, v3 = seed, v4 = seed - prime1;
+		for (; p + 32 <= last; p += 32) {
+			v1 = round(v1, read64(p));
+			v2 = round(v2, read64(p + 8));
+			v3 = round(v3, read64(p + 16));
+			v4 = round(v4, read64(p + 24));
+		}
+		h = std::rotl(v1, 1) + std::rotl(v2, 7) + std::rotl(v3, 12) + std::rotl(v4, 18);
+		h = merge(merge(merge(merge(h, v1), v2), v3), v4);
+	} else {
+		h = seed + prime5;
+	}
+	h += bytes.size();
+	for (; p + 8 <= last; p += 8) h = std::rotl(h ^ round(0u, read64(p)), 27) * prime1 + prime4;
+	if (p + 4 <= last) {
+		h = std::rotl(h ^ (read32(p) * prime1), 23) * prime2 + prime3;
+		p += 4;
+	}
+	for (; p < last; ++p) h = std::rotl(h ^ (static_cast<unsigned char>(*p) * prime5), 11) * prime1;
+	h ^= h >> 33;
+	h *= prime2;
+	h ^= h >> 29;
+	h *= prime3;
+	h ^= h >> 32;
+	return h;
+}
+
+/// @brief	Saves the bytes into the file atomically.
+///		The bytes are written into a temporary file in the same directory, and then it is renamed to the file,
+///		so that any reader, even in another process, sees either the previous file or the whole new file.
+/// @param[in]	path	Path of the file to save.
+/// @param[in]	bytes	Bytes to save.
+/// @throw	std::invalid_argument	The file cannot be saved.
+inline void
+save_file(std::filesystem::path const& path, std::string_view const& bytes) {
+	static std::atomic<std::uint64_t> sequence;
+#if defined(xxx_posix)
+	auto const process = static_cast<std::uint64_t>(::getpid());
+#else
+	auto const process = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+#endif
+	auto temporary = path;
+	temporary += ".tmp" + std::to_string(process) + "." + std::to_string(sequence++);
+	{
+		std::ofstream ofs{temporary, std::ios::out | std::ios::binary | std::ios::trunc};
+		ofs.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		if (! ofs.flush()) {
+			std::error_code ignored;
+			std::filesystem::remove(temporary, ignored);
+			throw std::invalid_argument(path.string());
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temporary, path, error);
+	if (error) {
+		std::filesystem::remove(temporary, error);
+		throw std::invalid_argument(path.string());
+	}
 }
 
 /// @brief	Converts a view to container.
@@ -493,8 +1668,496 @@ empty(T const& a) {
 #endif
 }
 
+
 } // namespace util
 
+// ===========================================================================
+namespace log {
+
+/// @brief	Channel from threads to a consumer thread, which consists of a ring per producer thread.
+///		Producers push elements without any lock unless their rings are full,
+///		and the consumer thread drains the rings periodically or when a ring is full.
+///		The rings of the first producer threads are also published by atomics only, so that a signal handler can drain them.
+/// @tparam	T	Type of elements.
+template<typename T>
+class channel_t {
+public:
+	/// @brief	Maximum number of the producer threads whose rings are published to @ref try_drain.
+	static constexpr std::size_t const max_published = 256u;
+
+	/// @brief	Pushes the element into the ring of this thread.
+	///		It waits for the consumer only if the ring is full, and the element is dropped if the channel stops meanwhile.
+	/// @tparam	U	Type of @p value.
+	/// @param[in]	value	Element.
+	template<typename U>
+	void push(U&& value) {
+		auto& ring = local();
+		while (! ring.try_push(std::forward<U>(value))) {
+			if (! running()) return;
+			full_ = true;
+			wakeup_.notify_one();
+			std::this_thread::yield();
+		}
+	}
+
+	/// @brief	Determines whether the consumer thread runs or not.
+	/// @return		It returns true if the consumer thread runs; otherwise, it returns false.
+	bool running() const noexcept { return running_.load(std::memory_order_relaxed); }
+
+	/// @brief	Starts the consumer thread.
+	/// @tparam	F	Type of @p consume.
+	/// @tparam	G	Type of @p flush.
+	/// @param[in]	consume		Function to receive number of the producer thread and an element.
+	/// @param[in]	flush		Function called after each drain.
+	template<typename F, typename G>
+	void start(F consume, G flush) {
+		stop();
+		running_  = true;
+		consumer_ = std::jthread{[this, consume = std::move(consume), flush = std::move(flush)](std::stop_token stop) {
+			std::unique_lock lock{mutex_};
+			while (! stop.stop_requested()) {
+				wakeup_.wait_for(lock, stop, interval_, [this] { return full_.exchange(false); });
+				drain_locked(consume, flush);
+			}
+		}};
+	}
+	/// @brief	Stops the consumer thread, while the rest of elements are left to @ref drain.
+	void stop() {
+		running_  = false;
+		consumer_ = {}; // Stops and joins.
+	}
+
+	/// @brief	Pops all the elements in the rings, which shall not be called by the consumer thread.
+	/// @tparam	F	Type of @p consume.
+	/// @tparam	G	Type of @p flush.
+	/// @param[in]	consume		Function to receive number of the producer thread and an element.
+	/// @param[in]	flush		Function called after the drain.
+	template<typename F, typename G>
+	void drain(F const& consume, G const& flush) {
+		std::lock_guard lock{mutex_};
+		drain_locked(consume, flush);
+	}
+	/// @overload
+	template<typename F>
+	void drain(F const& consume) {
+		drain(consume, [] {});
+	}
+	/// @brief	Pops all the elements in the published rings unless they are being drained, which uses atomics only, e.g., in a signal handler.
+	/// @tparam	F	Type of @p consume.
+	/// @tparam	G	Type of @p flush.
+	/// @param[in]	consume		Function to receive number of the producer thread and an element, which shall be async-signal-safe.
+	/// @param[in]	flush		Function called after the drain, which shall be async-signal-safe.
+	/// @return		It returns true if the rings are drained; otherwise, it returns false.
+	template<typename F, typename G>
+	bool try_drain(F const& consume, G const& flush) noexcept {
+		if (draining_.exchange(true, std::memory_order_acquire)) return false;
+		for (std::size_t thread{}, n = published_count_.load(std::memory_order_acquire); thread < n; ++thread) {
+			while (auto value = published_[thread].load(std::memory_order_acquire)->try_pop()) consume(thread, *value);
+		}
+		flush();
+		draining_.store(false, std::memory_order_release);
+		return true;
+	}
+
+	/// @brief	Gets number of the producer threads, which are numbered from zero in order of their first push.
+	/// @return		Number of the producer threads.
+	std::size_t threads() {
+		std::lock_guard lock{mutex_};
+		return rings_.size();
+	}
+
+	/// @brief	Constructor.
+	/// @param[in]	capacity	Capacity of the ring of each thread.
+	/// @param[in]	interval	Interval to drain the rings.
+	channel_t(std::size_t capacity, std::chrono::milliseconds interval) : id_{sequence()++}, capacity_{capacity}, interval_{interval}, mutex_{}, wakeup_{}, rings_{}, published_{}, published_count_{}, draining_{}, full_{}, running_{}, consumer_{} {}
+	/// @brief	Destructor.
+	~channel_t() { stop(); }
+
+private:
+	channel_t(channel_t const&) = delete;
+
+	/// @brief	Ring of a producer thread.
+	using ring_t = util::spsc_ring_t<T>;
+	static_assert(std::atomic<bool>::is_always_lock_free && std::atomic<ring_t*>::is_always_lock_free && std::atomic<std::size_t>::is_always_lock_free);
+
+	/// @brief	Gets the ring of this thread, which is registered at the first push.
+	///		The ring is kept after the thread exits, so that its elements are consumed.
+	ring_t& local() {
+		thread_local std::vector<std::pair<std::size_t, std::shared_ptr<ring_t>>> rings; // Rings of the channels.
+		for (auto const& [id, ring] : rings) {
+			if (id == id_) return *ring;
+		}
+		auto ring = std::make_shared<ring_t>(capacity_);
+		{
+			std::lock_guard lock{mutex_};
+			rings_.push_back(ring);
+			if (rings_.size() <= max_published) {
+				published_[rings_.size() - 1u].store(ring.get(), std::memory_order_relaxed);
+				published_count_.store(rings_.size(), std::memory_order_release);
+			}
+		}
+		return *rings.emplace_back(id_, std::move(ring)).second;
+	}
+	/// @brief	Pops all the elements in the rings, which shall lock the mutex.
+	///		It waits for @ref try_drain, since each ring has a single consumer at a time.
+	template<typename F, typename G>
+	void drain_locked(F const& consume, G const& flush) {
+		while (draining_.exchange(true, std::memory_order_acquire)) std::this_thread::yield();
+		struct release_t {
+			std::atomic<bool>& draining;
+			~release_t() { draining.store(false, std::memory_order_release); }
+		} const release{draining_};
+		for (std::size_t thread{}; thread < rings_.size(); ++thread) {
+			while (auto value = rings_[thread]->try_pop()) consume(thread, *value);
+		}
+		flush();
+	}
+	/// @brief	Gets the sequence to identify the channels.
+	static std::atomic<std::size_t>& sequence() noexcept {
+		static std::atomic<std::size_t> sequence;
+		return sequence;
+	}
+
+private:
+	std::size_t										id_;			  ///< @brief	Identity of this channel.
+	std::size_t										capacity_;		  ///< @brief	Capacity of the ring of each thread.
+	std::chrono::milliseconds						interval_;		  ///< @brief	Interval to drain the rings.
+	std::mutex										mutex_;			  ///< @brief	Mutex of the registry of the rings and the consumer.
+	std::condition_variable_any						wakeup_;		  ///< @brief	Wakes up the consumer thread.
+	std::vector<std::shared_ptr<ring_t>>			rings_;			  ///< @brief	Rings of the producer threads in order of their registration.
+	std::array<std::atomic<ring_t*>, max_published>	published_;		  ///< @brief	The first rings, which are read by atomics only.
+	std::atomic<std::size_t>						published_count_; ///< @brief	Number of the published rings.
+	std::atomic<bool>								draining_;		  ///< @brief	Whether the rings are being drained or not.
+	std::atomic<bool>								full_;			  ///< @brief	Whether a producer waits for the consumer or not.
+	std::atomic<bool>								running_;		  ///< @brief	Whether the consumer thread runs or not.
+	std::jthread									consumer_;		  ///< @brief	Consumer thread.
+};
+
+/// @brief	Writer of spans as Chrome Trace Event Format, which can be viewed by Perfetto or chrome://tracing.
+///		Each thread records its spans into its own ring without any lock, and a background thread writes them in batches.
+///		The writer is the @ref span_sink while it is open.
+class trace_writer_t {
+public:
+	/// @brief	Capacity of the ring of each thread.
+	static constexpr std::size_t const ring_capacity = 4096u;
+	/// @brief	Interval to write the recorded spans.
+	static constexpr std::chrono::milliseconds const flush_interval{10};
+
+	/// @brief	Determines whether the writer is open or not.
+	/// @return		It returns true if the writer is open; otherwise, it returns false.
+	bool is_open() const noexcept { return events_.running(); }
+
+	/// @brief	Opens the file, and then starts recording spans.
+	/// @param[in]	path	Path of the file.
+	/// @throw	std::invalid_argument	The file cannot be opened.
+	void open(std::filesystem::path const& path) {
+		close();
+		ofs_.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (! ofs_) throw std::invalid_argument("trace out:" + path.string());
+		events_.drain([](auto, auto const&) {}); // Spans recorded after the previous closing are dropped.
+		ofs_ << R"({"displayTimeUnit":"ms","traceEvents":[)";
+		delimiter_ = "\n";
+		epoch_	   = std::chrono::steady_clock::now();
+		events_.start([this](auto thread, auto const& event) { write(thread, event); }, [] {});
+		span_sink() = &record_span;
+	}
+	/// @brief	Stops recording spans, and then closes the file after writing all the recorded spans.
+	void close() {
+		if (! is_open()) return;
+		span_sink() = nullptr;
+		events_.stop();
+		events_.drain([this](auto thread, auto const& event) { write(thread, event); });
+		for (std::size_t thread{}, threads = events_.threads(); thread < threads; ++thread) {
+			ofs_ << delimiter_ << R"({"name":"thread_name","ph":"M","pid":1,"tid":)" << thread << R"(,"args":{"name":"thread #)" << thread << R"("}})";
+		}
+		ofs_ << "\n]}\n";
+		ofs_.close();
+	}
+
+	/// @brief	Records the span into the ring of this thread.
+	///		It waits for the writer only if the ring is full.
+	/// @param[in]	name	Name of the span, which shall live while the process runs.
+	/// @param[in]	detail	Detail of the span.
+	/// @param[in]	begin	Time when the span begins.
+	/// @param[in]	end		Time when the span ends.
+	void record(std::string_view name, std::string_view detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) {
+		events_.push(event_t{name, std::string{detail}, begin, end});
+	}
+
+	/// @brief	Destructor.
+	~trace_writer_t() { close(); }
+
+private:
+	/// @brief	Constructor, which is called by @ref trace_writer only.
+	trace_writer_t() : events_{ring_capacity, flush_interval}, ofs_{}, delimiter_{}, epoch_{} {}
+	trace_writer_t(trace_writer_t const&) = delete;
+
+	friend trace_writer_t& trace_writer();
+
+	/// @brief	Event of a recorded span.
+	struct event_t {
+		std::string_view					  name;	  ///< @brief	Name.
+		std::string							  detail; ///< @brief	Detail.
+		std::chrono::steady_clock::time_point begin;  ///< @brief	Time when the span begins.
+		std::chrono::steady_clock::time_point end;	  ///< @brief	Time when the span ends.
+	};
+
+	/// @brief	Records the span into the writer, which is the @ref span_sink.
+	static void record_span(std::string_view name, std::string_view detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) noexcept;
+
+	/// @brief	Writes the event as a complete event, which is called by the consumer only.
+	/// @param[in]	thread	Number of the thread.
+	/// @param[in]	event	Event.
+	void write(std::size_t thread, event_t const& event) {
+		auto const microseconds = [](auto duration) { return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()) / 1e3; };
+		ofs_ << std::exchange(delimiter_, ",\n") << R"({"name":)" << util::quote_json(event.name) << R"(,"ph":"X","pid":1,"tid":)" << thread
+			 << std::fixed << std::setprecision(3) << R"(,"ts":)" << microseconds(std::max(event.begin, epoch_) - epoch_) << R"(,"dur":)" << microseconds(event.end - std::max(event.begin, epoch_))
+			 << R"(,"args":{"detail":)" << util::quote_json(event.detail) << "}}";
+	}
+
+private:
+	channel_t<event_t>					  events_;	  ///< @brief	Channel of the recorded events.
+	std::ofstream						  ofs_;		  ///< @brief	Output file.
+	char const*							  delimiter_; ///< @brief	Delimiter of the next event.
+	std::chrono::steady_clock::time_point epoch_;	  ///< @brief	Time when the file is opened.
+};
+
+/// @brief	Gets the trace writer of the process.
+/// @return		Trace writer.
+inline trace_writer_t&
+trace_writer() {
+	static trace_writer_t writer;
+	return writer;
+}
+
+inline void
+trace_writer_t::record_span(std::string_view name, std::string_view detail, std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end) noexcept {
+	try {
+		trace_writer().record(name, detail, begin, end);
+	} catch (...) {
+		// The span is dropped, since a scope shall not fail by tracing.
+	}
+}
+
+/// @brief	Asynchronous backend of the loggers, which writes their messages to their output streams in a background thread.
+///		Each thread records its messages as binary records tagged with the output stream into its own ring without any lock or formatting,
+///		and a message longer than a record is split into continued records.
+///		The background thread formats the records and writes them, where messages to std::clog are written in batches.
+///		The backend is the @ref message_sink while it is open,
+///		and the records are drained when it is closed, e.g., at exit, when a redirection of output ends, or when the process crashes on POSIX.
+class backend_t {
+public:
+	/// @brief	Capacity of the ring of each thread.
+	static constexpr std::size_t const ring_capacity = 1024u;
+	/// @brief	Interval to write the recorded messages.
+	static constexpr std::chrono::milliseconds const flush_interval{10};
+
+	/// @brief	Determines whether the backend is open or not.
+	/// @return		It returns true if the backend is open; otherwise, it returns false.
+	bool is_open() const noexcept { return records_.running(); }
+
+	/// @brief	Starts recording messages.
+	void open() {
+		close();
+		records_.start([this](auto thread, auto const& record) { append(thread, record); }, [this] { write(); });
+		message_sink() = &record_message;
+#if defined(xxx_posix)
+		struct ::sigaction action {};
+		action.sa_handler = &crashed;
+		::sigemptyset(&action.sa_mask);
+		for (std::size_t i{}; i < crash_signals.size(); ++i) ::sigaction(crash_signals[i], &action, &previous_actions()[i]);
+#endif
+	}
+	/// @brief	Stops recording messages, and then writes all the recorded messages.
+	void close() {
+		if (! is_open()) return;
+		message_sink() = nullptr;
+#if defined(xxx_posix)
+		for (std::size_t i{}; i < crash_signals.size(); ++i) ::sigaction(crash_signals[i], &previous_actions()[i], nullptr);
+#endif
+		records_.stop();
+		records_.drain([this](auto thread, auto const& record) { append(thread, record); }, [this] { write(); });
+	}
+	/// @brief	Writes all the recorded messages without stopping.
+	void flush() {
+		if (! is_open()) return;
+		records_.drain([this](auto thread, auto const& record) { append(thread, record); }, [this] { write(); });
+	}
+
+	/// @brief	Records the message into the ring of this thread.
+	///		It waits for the backend only if the ring is full.
+	/// @param[in]	os		Output stream to write the message to, which shall live until the message is written.
+	/// @param[in]	file	Path of the source file of the call site, which shall live while the process runs.
+	/// @param[in]	line	Line number of the call site.
+	/// @param[in]	message	Message.
+	void record(std::ostream& os, std::string_view file, std::uint_least32_t line, std::string_view message) {
+		record_t record; // The text is filled up to its length only.
+		record.os	= &os;
+		record.file = file;
+		record.line = line;
+		do {
+			record.length	 = static_cast<std::uint16_t>(std::min(message.size(), record.text.size()));
+			record.continued = record.length < message.size();
+			std::memcpy(record.text.data(), message.data(), record.length);
+			records_.push(record);
+			message.remove_prefix(record.length);
+		} while (! message.empty());
+	}
+
+	/// @brief	Destructor.
+	~backend_t() { close(); }
+
+private:
+	/// @brief	Constructor, which is called by @ref backend only.
+	backend_t() : records_{ring_capacity, flush_interval}, partials_{}, batch_{}, crash_buffer_{} {}
+	backend_t(backend_t const&) = delete;
+
+	friend backend_t& backend();
+
+	/// @brief	Record of a message, or a part of a message.
+	struct record_t {
+		std::ostream*			os;		   ///< @brief	Output stream to write the message to.
+		std::string_view		file;	   ///< @brief	Path of the source file of the call site.
+		std::uint_least32_t		line;	   ///< @brief	Line number of the call site.
+		std::uint16_t			length;	   ///< @brief	Length of the text.
+		bool					continued; ///< @brief	Whether the message continues in the next record or not.
+		std::array<char, 96u>	text;	   ///< @brief	Text of the message, which makes the record two cache lines.
+	};
+
+#if defined(xxx_posix)
+	/// @brief	Signals of crashes, which drain the records.
+	static constexpr std::array<int, 5u> const crash_signals{SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+	/// @brief	Gets the actions of the signals before opening.
+	static std::array<struct ::sigaction, crash_signals.size()>& previous_actions() noexcept {
+		static std::array<struct ::sigaction, crash_signals.size()> actions{};
+		return actions;
+	}
+	/// @brief	Handles the crash, which writes the records to the standard error by async-signal-safe operations only,
+	///		and then raises the signal again by the previous action.
+	///		The records are lost if they are being drained at the crash, or if they are recorded by a thread which is not published.
+	static void crashed(int signal) noexcept;
+#endif
+
+	/// @brief	Records the message into the backend, which is the @ref message_sink.
+	static void record_message(std::ostream& os, std::string_view file, std::uint_least32_t line, std::string_view message) noexcept;
+
+	/// @brief	Appends the record to the batch, which is called by the consumer only.
+	/// @param[in]	thread	Number of the thread.
+	/// @param[in]	record	Record.
+	void append(std::size_t thread, record_t const& record) {
+		if (partials_.size() <= thread) partials_.resize(thread + 1u);
+		auto& partial = partials_[thread];
+		if (partial.empty()) {
+			auto const line = std::to_string(record.line);
+			partial.append("[").append(file_name(record.file)).append(":").append(line.size() < 5u ? 5u - line.size() : 0u, '_').append(line).append("] ");
+		}
+		partial.append(record.text.data(), record.length);
+		if (record.continued) return;
+		if (record.os == &std::clog) {
+			batch_.append(partial).push_back('\n');
+		} else {
+			record.os->write(partial.data(), static_cast<std::streamsize>(partial.size())).put('\n').flush();
+		}
+		partial.clear();
+	}
+	/// @brief	Writes the batch, which is called by the consumer only.
+	void write() {
+		if (batch_.empty()) return;
+		std::clog.write(batch_.data(), static_cast<std::streamsize>(batch_.size())).flush();
+		batch_.clear();
+	}
+
+private:
+	channel_t<record_t>		 records_;		///< @brief	Channel of the recorded messages.
+	std::vector<std::string> partials_;		///< @brief	Formatted parts of the continued messages per thread.
+	std::string				 batch_;		///< @brief	Formatted messages to std::clog to write.
+	std::array<char, 4096u>	 crash_buffer_; ///< @brief	Buffer to format the records at a crash, which is allocated beforehand.
+};
+
+/// @brief	Gets the asynchronous backend of the loggers of the process.
+/// @return		Backend.
+inline backend_t&
+backend() {
+	static backend_t backend;
+	return backend;
+}
+
+inline void
+backend_t::record_message(std::ostream& os, std::string_view file, std::uint_least32_t line, std::string_view message) noexcept {
+	try {
+		backend().record(os, file, line, message);
+	} catch (...) {
+		// The message is dropped, since logging shall not fail.
+	}
+}
+
+inline void
+flush() noexcept {
+	if (! message_sink().load(std::memory_order_relaxed)) return; // Nothing is recorded unless the backend is open.
+	try {
+		backend().flush();
+	} catch (...) {
+		// The messages are dropped, since logging shall not fail.
+	}
+}
+
+#if defined(xxx_posix)
+inline void
+backend_t::crashed(int signal) noexcept {
+	auto&		self   = backend();
+	auto&		buffer = self.crash_buffer_;
+	std::size_t size{};
+	auto const	write = [&buffer, &size]() noexcept {
+		 for (std::string_view str{buffer.data(), size}; ! str.empty();) {
+			 auto const n = ::write(STDERR_FILENO, str.data(), str.size());
+			 if (n < 0 && errno == EINTR) continue;
+			 if (n <= 0) break;
+			 str.remove_prefix(static_cast<std::size_t>(n));
+		 }
+		 size = 0u;
+	};
+	auto const put = [&buffer, &size, &write](std::string_view str) noexcept {
+		while (! str.empty()) {
+			if (size == buffer.size()) write();
+			auto const n = std::min(str.size(), buffer.size() - size);
+			std::memcpy(buffer.data() + size, str.data(), n);
+			size += n;
+			str.remove_prefix(n);
+		}
+	};
+	auto		continuing = false;
+	std::size_t current{};
+	// The partial messages are not modified while the records are drained here.
+	self.records_.try_drain(
+		[&](auto thread, auto const& record) noexcept {
+			if (std::exchange(current, thread) != thread && std::exchange(continuing, false)) put("\n"); // The message of the previous thread is incomplete.
+			if (! continuing) {
+				if (thread < self.partials_.size() && ! self.partials_[thread].empty()) {
+					put(self.partials_[thread]);
+				} else {
+					std::array<char, 16u> line{};
+					auto const			  last = std::to_chars(line.data(), line.data() + line.size(), record.line).ptr;
+					put("[");
+					put(file_name(record.file));
+					put(":");
+					put(std::string_view{line.data(), last});
+					put("] ");
+				}
+			}
+			put(std::string_view{record.text.data(), record.length});
+			if (! record.continued) put("\n");
+			continuing = record.continued;
+		},
+		write);
+	for (std::size_t i{}; i < crash_signals.size(); ++i) {
+		if (crash_signals[i] == signal) ::sigaction(signal, &previous_actions()[i], nullptr);
+	}
+	::raise(signal);
+}
+#endif
+
+} // namespace log
+
 /// @brief	Regex result for std::string_view.
 using svmatch = std::match_results<std::string_view::const_iterator>;
 